@@ -37,6 +37,17 @@ class RayTracer {
         inline void updateCameraPosition(const point3& pos) { cam->setPos(pos); }
         inline void updateCameraOrientation(const dcm& dcm) { cam->setDCM(dcm); } 
 
+        /**
+         * @brief Register an upcoming camera pose, whose rasters are loaded in the 
+         * background when the prefetching is enabled.
+         * @details When no pose is registered between two runs, the next pose is 
+         * extrapolated from the last two rendered ones.
+         *
+         * @param pos Upcoming camera position.
+         * @param dcm Upcoming camera orientation.
+         */
+        void addUpcomingCameraPose(const point3& pos, const dcm& dcm);
+
         // Image Generation Routines
         cv::Mat createImageOptical(int type = CV_8UC1); 
         cv::Mat createImageDEM(int type = CV_8UC1, bool normalize = true); 
@@ -72,6 +83,12 @@ class RayTracer {
         
         LogLevel logLevel;
 
+        // Poses of the last two rendered frames, used to extrapolate the next one
+        point3 lastPos[2];
+        dcm lastDCM[2];
+        size_t nRenderedPoses = 0;
+        bool upcomingPoses = false;
+
         void checkCamPointer(); 
         void checkRenderStatus(); 
 
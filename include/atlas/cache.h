@@ -0,0 +1,136 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+class RasterContainer;
+
+/**
+ * @class RasterCache
+ * @brief Byte-budgeted cache of the rasters loaded by one or more raster containers.
+ * @details The loaded rasters are kept in least-recently-used order. Whenever a raster is
+ * loaded, and at the end of each frame, the least recently used rasters are unloaded
+ * until the memory they use fits within the budget. Rasters pinned by their container,
+ * i.e., those accessed by the queries in flight, are never unloaded, thus the budget can
+ * only be exceeded by the rasters that are concurrently in use. The memory of each 
+ * raster is measured whenever it is accessed and at the end of each frame, and the 
+ * total is kept up to date with such measures.
+ */
+class RasterCache {
+
+    public:
+
+        /**
+         * @brief Construct a new Raster Cache object.
+         * @param budget Maximum memory, in bytes, used by the loaded rasters.
+         */
+        RasterCache(size_t budget);
+
+        /* Delete copy constructors and assignments */
+        RasterCache(const RasterCache&) = delete;
+        RasterCache& operator=(const RasterCache&) = delete;
+
+        inline size_t budget() const { return _budget; }
+        inline void setBudget(size_t budget) { _budget = budget; }
+
+        /**
+         * @brief Record the use of a raster by the current frame.
+         * @details The raster becomes the most recently used one. If it was not
+         * registered, the access is counted as a miss and the least recently used
+         * rasters are evicted to make room for it.
+         *
+         * @param c Raster container.
+         * @param k Raster index within the container.
+         * @param loaded True if the raster had to be loaded.
+         */
+        void access(RasterContainer* c, size_t k, bool loaded);
+
+        /**
+         * @brief Register a raster loaded ahead of its use.
+         * @details The raster becomes the most recently used one, without affecting the 
+         * access statistics.
+         *
+         * @param c Raster container.
+         * @param k Raster index within the container.
+         */
+        void insert(RasterContainer* c, size_t k);
+
+        /**
+         * @brief Remove a raster that has been unloaded by its container.
+         * @param c Raster container.
+         * @param k Raster index within the container.
+         */
+        void erase(RasterContainer* c, size_t k);
+
+        /**
+         * @brief Remove all the rasters of a container.
+         * @param c Raster container.
+         */
+        void erase(RasterContainer* c);
+
+        /**
+         * @brief Evict the least recently used unpinned rasters until the memory used by
+         * the cached rasters fits within the budget.
+         */
+        void enforce();
+
+        /**
+         * @brief Return the memory, in bytes, used by the cached rasters when they were 
+         * last measured.
+         */
+        size_t usage();
+
+        inline size_t nEntries() const { return entries.size(); }
+
+        // Access statistics
+        inline ui64_t nHits() const { return hits; }
+        inline ui64_t nMisses() const { return misses; }
+        inline ui64_t nEvictions() const { return evictions; }
+
+        void resetStatistics();
+
+    private:
+
+        struct Entry {
+            RasterContainer* container;
+            size_t raster;
+            size_t memory;  // Last measured memory, in bytes
+        };
+
+        using Key = std::pair<const RasterContainer*, size_t>;
+
+        size_t _budget;
+
+        // Cached rasters, from the most to the least recently used, and their locations
+        std::list<Entry> entries;
+        std::map<Key, std::list<Entry>::iterator> locations;
+
+        // Sum of the memory of all the entries
+        size_t total = 0;
+
+        std::mutex mutex;
+
+        std::atomic<ui64_t> hits{0};
+        std::atomic<ui64_t> misses{0};
+        std::atomic<ui64_t> evictions{0};
+
+        /* Move a raster to the front of the list, registering it if required, and update 
+         * its memory. */
+        void moveToFront(RasterContainer* c, size_t k);
+
+        // Remove an entry from the list
+        std::list<Entry>::iterator remove(std::list<Entry>::iterator it);
+
+        // Evict rasters with the mutex already locked
+        void evict();
+
+};
+
+#endif
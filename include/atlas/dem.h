@@ -11,7 +11,10 @@ class DEM : public RasterManager {
 
 
         DEM(WorldOptions opts, ui32_t nThreads);
-        DEM(const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs); 
+        DEM(
+            const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs, 
+            const std::string& indexPath = ""
+        ); 
         
         inline double minAltitude() const { return _minAltitude; }; 
         inline double maxAltitude() const { return _maxAltitude; };
@@ -11,7 +11,10 @@ class DOM : public RasterManager {
     public: 
 
         DOM(WorldOptions opts, ui32_t nThreads);
-        DOM(const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs); 
+        DOM(
+            const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs, 
+            const std::string& indexPath = ""
+        ); 
 
         double getColor(const point2& s, double res, ui32_t threadid = 0); 
 
@@ -44,6 +44,16 @@ class ScreenGrid {
         inline void setRayResolution(double res) { dt = res; }
         inline double getRayResolution() const { return dt; }
 
+        /* Set the radii bounding the surface seen by the grid rays. If no surface is 
+         * seen, the minimum radius is larger than the maximum one. */
+        inline void setRadiusBounds(double rMin, double rMax) { 
+            _minRadius = rMin; 
+            _maxRadius = rMax;
+        }
+
+        inline double minRadius() const { return _minRadius; }
+        inline double maxRadius() const { return _maxRadius; }
+
         inline void addRayDistance(double distance) { rayDistances.push_back(distance); }
         inline const std::vector<double>* getRayDistances() const {
             return &rayDistances;
@@ -71,6 +81,10 @@ class ScreenGrid {
         // Ray resolutions
         double dt; 
 
+        // Radii bounding the surface seen by the grid
+        double _minRadius; 
+        double _maxRadius;
+
         std::vector<double> rayDistances;
 };
 
@@ -10,7 +10,8 @@
 
 using Pixel = point2; 
 
-#define MAX_PIX_SAMPLES     (8)
+// Maximum number of samples rendered for each pixel
+#define MAX_PIX_SAMPLES     (16)
 
 /**
  * @class TaskedPixel
@@ -27,7 +28,7 @@ class TaskedPixel {
          * @param u Pixel horizontal coordinate on the image plane.
          * @param v Pixel vertical coordinate on the image plane.
          * @param dt Resolution for the ray propagation.
-         * @param nSamples Number of samples for this pixel.
+         * @param nSamples Number of samples for this pixel, at most MAX_PIX_SAMPLES.
          */
         TaskedPixel(ui32_t id, double u, double v, double dt, size_t nSamples = 1);
 
@@ -56,15 +57,25 @@ class TaskedPixel {
          */
         double tMax;
 
+        /**
+         * @brief Minimum radius of the surface seen by the pixel.
+         */
+        double rMin; 
+
+        /**
+         * @brief Maximum radius of the surface seen by the pixel.
+         */
+        double rMax;
+
         /**
          * @brief Horizontal coordinates, on the image plane, of all the pixel samples.
          */
-        std::vector<double> u; 
+        double u[MAX_PIX_SAMPLES]; 
 
         /**
          * @brief Vertical coordinates, on the image plane, of all the pixel samples.
          */
-        std::vector<double> v;
+        double v[MAX_PIX_SAMPLES];
         
 };
 
@@ -77,14 +88,25 @@ struct PixelData {
     point3 s;       // Spherical coordinates of the intersection point
 };
 
+class RenderBuffer;
+
 /**
  * @class RenderedPixel
- * @brief Class storing all the rendered information for a given pixel.
+ * @brief Lightweight view over the rendered samples of a pixel stored in a RenderBuffer.
+ * @note The view is only valid as long as the buffer it refers to is not modified.
  */
 class RenderedPixel {
 
     public: 
 
+        /**
+         * @brief Construct a new Rendered Pixel view.
+         * 
+         * @param buffer Buffer storing the pixel samples.
+         * @param id Rendered pixel ID.
+         */
+        RenderedPixel(const RenderBuffer* buffer, ui32_t id);
+
         /**
          * @brief Pixel ID
          */
@@ -96,88 +118,210 @@ class RenderedPixel {
         size_t nSamples;
 
         /**
-         * @brief Rendered pixel data for each sample.
+         * @brief Return the rendered data of a given sample.
+         * @param k Sample index.
          */
-        std::vector<PixelData> data;
+        PixelData data(size_t k) const; 
 
         /**
-         * @brief Construct a new Rendered Pixel object.
+         * @brief Return the resolution used for the propagation of the ray of this pixel.
          * 
-         * @param id Rendered pixel ID.
-         * @param nSamples Number of rendered samples for this pixel.
+         * @return double Ray resolution.
          */
-        RenderedPixel(ui32_t id, size_t nSamples, double dt);
+        double pixResolution() const; 
 
         /**
-         * @brief Automatically construct a new RenderedPixel object from a TaskedPixel. 
-         * @param pix Tasked pixel.
+         * @brief Return the distance of the first pixel sample (i.e., the ray from the 
+         * center of the aperture to the center of the pixel.)
          * 
-         * @note The new object automatically inherits the ID and the number of pixel 
-         * samples from the input TaskedPixel.
+         * @return double Ray distance.
          */
-        inline RenderedPixel(TaskedPixel pix) : RenderedPixel(
-            pix.id, pix.nSamples, pix.dt
-        ) {};
+        double pixDistance() const; 
 
         /**
-         * @brief Update the number of samples taken for this pixel.
-         * @details This function only updates the total number of samples and reserves 
-         * enough space within the internal vectors. 
-         * @param newSamples Total number of rendered samples.
+         * @brief Return the minimum ray distance across all pixel samples.
+         * @return double Minimum ray distance.
          */
-        void updateSamples(size_t newSamples); 
+        double pixMinDistance() const; 
 
         /**
-         * @brief Add new rendered information. 
-         * @param d Rendered pixel data.
+         * @brief Return the maximum ray distance across all pixel samples.
+         * @return double Maximum ray distance.
          */
-        void addPixelData(const PixelData& d); 
+        double pixMaxDistance() const; 
 
         /**
-         * @brief Return the resolution used for the propagation of the ray of this pixel.
+         * @brief Return the averaged distance across all pixel samples.
+         * @return double Average distance.
          * 
-         * @return double Ray resolution.
+         * @note Samples that have an infinite ray distance are excluded from the mean. 
          */
-        inline double pixResolution() const { return res; }
+        double pixMeanDistance() const; 
+
+    private: 
+
+        const RenderBuffer* buffer;
+
+};
+
+/**
+ * @class RenderBuffer
+ * @brief Columnar storage of the rendered samples of all the image pixels.
+ * @details The ray distance, radius, longitude and latitude of the samples are stored in 
+ * separate contiguous arrays. Each pixel stores the offset of its samples within them, 
+ * their number and its ray resolution. Single-sample pixels are stored in the slot of 
+ * their ID, whereas those with more samples are appended after the single-sample slots, 
+ * thus the samples of a first rendering are contiguous and sorted by pixel ID.
+ * 
+ * @note Different pixels can be written concurrently, provided their samples were 
+ * allocated beforehand. The allocation itself is not thread-safe and it can reallocate 
+ * the sample arrays unless enough space was reserved with reserveSamples.
+ */
+class RenderBuffer {
+
+    public: 
 
         /**
-         * @brief Return the distance of the first pixel sample (i.e., the ray from the 
-         * center of the aperture to the center of the pixel.)
+         * @brief Construct a new Render Buffer object.
+         * @param nPixels Number of image pixels.
+         */
+        RenderBuffer(ui32_t nPixels = 0); 
+
+        /**
+         * @brief Clear the buffer and resize it for a given number of pixels.
+         * @details All the pixels are left without any sample and with an infinite ray 
+         * resolution.
          * 
-         * @return double Ray distance.
+         * @param nPixels Number of image pixels.
          */
-        inline double pixDistance() const { return data[0].t; } 
+        void reset(ui32_t nPixels);
 
         /**
-         * @brief Return the minimum ray distance across all pixel samples.
-         * @return double Minimum ray distance.
+         * @brief Reserve space for additional samples beyond those already allocated.
+         * @param n Number of additional samples.
          */
-        inline double pixMinDistance() const { return tMin; }; 
+        void reserveSamples(size_t n); 
 
         /**
-         * @brief Return the maximum ray distance across all pixel samples.
-         * @return double Maximum ray distance.
+         * @brief Allocate the samples of a pixel, replacing its previous ones.
+         * @details The new samples are initialised with an infinite ray distance.
+         * 
+         * @param id Pixel ID.
+         * @param n Number of samples, at most MAX_PIX_SAMPLES.
+         * @param dt Ray resolution of the pixel.
          */
-        inline double pixMaxDistance() const { return tMax; }; 
+        void allocatePixel(ui32_t id, size_t n, double dt);
 
         /**
-         * @brief Return the averaged distance across all pixel samples.
-         * @return double Average distance.
+         * @brief Update the data of an allocated pixel sample.
          * 
-         * @note Samples that have an infinite ray distance are excluded from the mean. 
+         * @param id Pixel ID.
+         * @param k Sample index.
+         * @param d Rendered sample data.
          */
-        double pixMeanDistance() const; 
+        inline void setSample(ui32_t id, size_t k, const PixelData& d) {
+            size_t j = _offsets[id] + k; 
+            _t[j] = d.t; 
+            _radius[j] = d.s[0]; 
+            _lon[j] = d.s[1]; 
+            _lat[j] = d.s[2];
+        }
+
+        /**
+         * @brief Return the data of a pixel sample.
+         * 
+         * @param id Pixel ID.
+         * @param k Sample index.
+         */
+        inline PixelData getSample(ui32_t id, size_t k) const {
+            size_t j = _offsets[id] + k; 
+            return PixelData{_t[j], point3(_radius[j], _lon[j], _lat[j])};
+        }
+
+        /**
+         * @brief Return a view over the samples of a pixel.
+         * @param id Pixel ID.
+         */
+        inline RenderedPixel pixel(ui32_t id) const { return RenderedPixel(this, id); }
+
+        /**
+         * @brief Return the number of image pixels.
+         */
+        inline ui32_t nPixels() const { return _nPixels; }
+
+        /**
+         * @brief Return the number of samples of a pixel.
+         * @param id Pixel ID.
+         */
+        inline size_t pixSamples(ui32_t id) const { return _counts[id]; }
+
+        /**
+         * @brief Return the offset of the first sample of a pixel in the sample arrays.
+         * @param id Pixel ID.
+         */
+        inline size_t pixOffset(ui32_t id) const { return _offsets[id]; }
+
+        /**
+         * @brief Return the ray resolution of a pixel.
+         * @param id Pixel ID.
+         */
+        inline double pixResolution(ui32_t id) const { return _res[id]; }
+
+        /**
+         * @brief Return the minimum ray distance across all the samples of a pixel.
+         * @param id Pixel ID.
+         */
+        double pixMinDistance(ui32_t id) const; 
+
+        /**
+         * @brief Return the maximum ray distance across all the samples of a pixel.
+         * @param id Pixel ID.
+         */
+        double pixMaxDistance(ui32_t id) const;
+
+        /**
+         * @brief Return the ray resolutions of all the pixels.
+         */
+        inline const double* resolutions() const { return _res.data(); }
+
+        /**
+         * @brief Return the ray distances of all the samples.
+         */
+        inline const double* t() const { return _t.data(); }
+
+        /**
+         * @brief Return the radii of the impact points of all the samples.
+         */
+        inline const double* radius() const { return _radius.data(); }
+
+        /**
+         * @brief Return the longitudes, in radians, of the impact points of all the samples.
+         */
+        inline const double* lon() const { return _lon.data(); }
+
+        /**
+         * @brief Return the latitudes, in radians, of the impact points of all the samples.
+         */
+        inline const double* lat() const { return _lat.data(); }
 
     private: 
 
-        double res;
+        ui32_t _nPixels; 
 
-        double tMin; 
-        double tMax; 
-        
+        // Number of allocated samples
+        size_t nUsed; 
 
-};
+        // Per-pixel sample offsets, sample counts and ray resolutions
+        std::vector<ui32_t> _offsets; 
+        std::vector<ui8_t> _counts; 
+        std::vector<double> _res;
 
+        // Per-sample data
+        std::vector<double> _t; 
+        std::vector<double> _radius; 
+        std::vector<double> _lon; 
+        std::vector<double> _lat;
 
+};
 
-#endif 
\ No newline at end of file
+#endif
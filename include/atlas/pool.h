@@ -5,12 +5,21 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <functional>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// Initial number of tasks each worker deque can store before growing
+#define POOL_DEQUE_CAPACITY (256)
+
+// Number of tasks the common queue stores without locking
+#define POOL_QUEUE_CAPACITY (4096)
+
 /**
  * @class ThreadWorker
  * @brief Cache class storing information on a specific thread.
@@ -38,6 +47,117 @@ class ThreadWorker {
 };
 
 
+/**
+ * @class PoolTask
+ * @brief Task executed by the workers of a ThreadPool.
+ * @details Tasks are only moved, never copied, thus the data captured by their callables 
+ * is moved into them as well.
+ */
+class PoolTask {
+
+    public: 
+
+        virtual ~PoolTask() = default; 
+        virtual void run(const ThreadWorker& wk) = 0;
+
+};
+
+template <typename F> 
+class PoolCallable : public PoolTask {
+
+    public: 
+
+        explicit PoolCallable(F&& f) : f(std::move(f)) {}
+        explicit PoolCallable(const F& f) : f(f) {}
+
+        void run(const ThreadWorker& wk) override { f(wk); }
+
+    private: 
+        F f;
+
+};
+
+/**
+ * @class WorkStealingDeque
+ * @brief Chase-Lev deque storing the tasks of a pool worker.
+ * @details The owner worker pushes and pops tasks at the bottom of the deque, whereas the 
+ * other workers steal them from its top without any lock. The deque grows when full, 
+ * and its previous buffers are kept until it is destroyed, since a thief might still be 
+ * reading them.
+ */
+class WorkStealingDeque {
+
+    public: 
+
+        WorkStealingDeque(size_t capacity = POOL_DEQUE_CAPACITY);
+
+        // Owner operations
+        void push(PoolTask* task);
+        PoolTask* pop();
+
+        // Thief operation, returns nullptr if the deque is empty or the steal failed
+        PoolTask* steal();
+
+    private: 
+
+        struct Buffer {
+            Buffer(size_t n) : mask(n - 1), slots(new std::atomic<PoolTask*>[n]) {}
+            size_t mask; 
+            std::unique_ptr<std::atomic<PoolTask*>[]> slots;
+        };
+
+        std::atomic<std::int64_t> top{0}, bottom{0}; 
+        std::atomic<Buffer*> buffer;
+
+        // Current and retired buffers
+        std::vector<std::unique_ptr<Buffer>> buffers;
+
+};
+
+/**
+ * @class TaskQueue
+ * @brief Multi-producer multi-consumer FIFO queue storing the tasks added from outside a 
+ * pool.
+ * @details The tasks are stored in a bounded ring whose slots carry a sequence number, 
+ * thus producers and consumers only synchronise on the slots they claim, without any 
+ * lock. When the ring is full, the tasks overflow into a locked queue, which receives all 
+ * the following tasks until it is drained, so that the FIFO order is preserved.
+ */
+class TaskQueue {
+
+    public: 
+
+        TaskQueue(size_t capacity = POOL_QUEUE_CAPACITY);
+
+        void push(PoolTask* task);
+
+        // Returns nullptr if the queue is empty or if its first task is still being pushed
+        PoolTask* pop();
+
+    private: 
+
+        struct Slot {
+            std::atomic<size_t> seq; 
+            PoolTask* task;
+        };
+
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+
+        // Positions of the next slots to be read and written, on separate cache lines
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+
+        // Tasks that did not fit in the ring
+        std::queue<PoolTask*> overflow; 
+        std::mutex overflowMutex;
+        std::atomic<bool> overflowing{false};
+
+        bool tryPush(PoolTask* task);
+        PoolTask* tryPop();
+
+};
+
 /**
  * @class ThreadPool 
  * @brief Class representing a pool of threads.
@@ -106,9 +226,16 @@ class ThreadPool {
 
         /**
          * @brief Queue a task for execution.
-         * @param task Task function.
+         * @details Tasks queued by a worker of the pool are pushed on its own deque, from 
+         * which idle workers steal them, whereas those queued by other threads are 
+         * shared among the workers through a common queue.
+         * 
+         * @param task Task callable, invoked with the worker executing it.
          */
-        void addTask(std::function<void(const ThreadWorker&)> task);
+        template <typename F> 
+        void addTask(F&& task) {
+            pushTask(new PoolCallable<std::decay_t<F>>(std::forward<F>(task)));
+        }
 
     private: 
 
@@ -117,13 +244,20 @@ class ThreadPool {
 
         // List of worker threads
         std::vector<std::thread> workers; 
-        // Queue storing all the jobs that need to be performed. 
-        std::queue<std::function<void(const ThreadWorker&)>> tasks; 
 
-        // Mutex to synchronize access to all the shared data.
-        std::mutex queueMutex; 
-        // Condition variable to notify workers
+        // Task deque of each worker
+        std::vector<std::unique_ptr<WorkStealingDeque>> deques; 
+
+        // Queue storing the tasks added by threads outside the pool
+        TaskQueue tasks; 
+
+        // Number of tasks waiting in the deques or in the queue
+        std::atomic<size_t> queuedTasks = 0; 
+
+        // Mutex and condition used by the idle workers to wait for new tasks
+        std::mutex idleMutex; 
         std::condition_variable task_cv; 
+        std::atomic<size_t> nIdle = 0;
         
         // Number of pending/uncompleted tasks
         std::atomic<size_t> pendingTasks = 0;
@@ -138,6 +272,11 @@ class ThreadPool {
         // starting to process them.
         bool started = false;
 
+        void pushTask(PoolTask* task);
+
+        // Retrieve a task from the worker deque, the common queue or the other workers
+        PoolTask* findTask(size_t id, ui32_t& seed);
+
         void workerLoop(ThreadWorker wk);
 };
 
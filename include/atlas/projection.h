@@ -0,0 +1,129 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include "gdal_priv.h"
+#include "types.h"
+#include "vec2.h"
+
+#include <cstddef>
+
+/**
+ * @brief Map projections with a native implementation.
+ */
+enum class ProjectionType {
+    NONE,
+    EQUIRECTANGULAR,
+    POLAR_STEREOGRAPHIC,
+    ORTHOGRAPHIC
+};
+
+/**
+ * @class MapProjection
+ * @brief Closed-form spherical map projection.
+ * @details The common lunar projections are evaluated in closed form, avoiding the
+ * overhead of the generic OGR coordinate transformations. Geographic coordinates are
+ * expressed in degrees, with the longitude first, whereas map coordinates are expressed in
+ * the linear units of the projected reference system. The projection kernels are 
+ * resolved once, on construction, so that each batch is processed by a branch-free loop.
+ */
+class MapProjection {
+
+    public:
+
+        /**
+         * @brief Construct an invalid projection, which can't be evaluated.
+         */
+        MapProjection();
+
+        /**
+         * @brief Construct the native projection of a reference system.
+         * @details The projection is invalid if the reference system is not a projected
+         * one on a sphere or if its projection is not natively supported.
+         *
+         * @param crs Projected reference system.
+         */
+        MapProjection(const OGRSpatialReference* crs);
+
+        inline ProjectionType type() const { return _type; }
+        inline bool isValid() const { return _type != ProjectionType::NONE; }
+
+        /**
+         * @brief Project a batch of geographic coordinates.
+         * @param n Number of points.
+         * @param x Longitudes, in degrees. On output, the map x-coordinates.
+         * @param y Latitudes, in degrees. On output, the map y-coordinates.
+         */
+        inline void forward(size_t n, double* x, double* y) const { 
+            forwardKernel(*this, n, x, y); 
+        }
+
+        /**
+         * @brief Convert a batch of map coordinates to geographic ones.
+         * @param n Number of points.
+         * @param x Map x-coordinates. On output, the longitudes in degrees.
+         * @param y Map y-coordinates. On output, the latitudes in degrees.
+         */
+        inline void inverse(size_t n, double* x, double* y) const { 
+            inverseKernel(*this, n, x, y); 
+        }
+
+        inline point2 forward(const point2& s) const {
+            point2 m(s);
+            forward(1, &m.e[0], &m.e[1]);
+            return m;
+        }
+
+        inline point2 inverse(const point2& m) const {
+            point2 s(m);
+            inverse(1, &s.e[0], &s.e[1]);
+            return s;
+        }
+
+    private:
+
+        ProjectionType _type;
+
+        // Body radius, in map units
+        double R;
+
+        // Projection centre, in radians
+        double lon0, lat0;
+
+        double falseEasting, falseNorthing;
+
+        // Pole sign (polar) and projection scale, in map units per radian
+        double sign, scale;
+
+        // Trigonometric functions of the projection centre (orthographic)
+        double sinLat0, cosLat0;
+
+        // Batched conversions of the projection type
+        using Kernel = void (*)(const MapProjection&, size_t, double*, double*);
+        Kernel forwardKernel, inverseKernel;
+
+        static void identity(const MapProjection& p, size_t n, double* x, double* y);
+
+        static void forwardEquirectangular(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+        static void inverseEquirectangular(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+
+        static void forwardPolarStereographic(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+        static void inversePolarStereographic(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+
+        static void forwardOrthographic(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+        static void inverseOrthographic(
+            const MapProjection& p, size_t n, double* x, double* y
+        );
+
+};
+
+#endif
@@ -2,11 +2,18 @@
 #define RASTERFILE_H 
 
 #include "affine.h"
+#include "cache.h"
 #include "gdal_priv.h"
+#include "projection.h"
 #include "types.h"
 #include "vec2.h"
+#include "vec3.h"
+#include "volume.h"
 
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -31,6 +38,204 @@ struct RasterDescriptor {
 
 
 
+// Maximum cone ratio (horizontal over vertical distance) stored in cone-step maps
+#define MAX_CONE_RATIO      (50.0)
+
+// Margin, in pixels, by which the DDA marching steps cross the cell boundaries
+#define DDA_CELL_MARGIN     (1e-3)
+
+// Maximum number of points processed together by the batched data queries
+#define MAX_RASTER_BATCH    (16)
+
+// Side, in pixels, of the square tiles storing the maximum band slopes
+#define SLOPE_TILE_SIZE     (64)
+
+// Minimum side, in pixels, of the blocks in which the band data is loaded on demand
+#define RASTER_BLOCK_SIZE   (256)
+
+// Code marking the no data pixels of the quantized bands
+#define RASTER_QUANT_NODATA (0xFFFF)
+
+// Alignment, in bytes, of the header and of the blocks within the tile cache files
+#define TILE_CACHE_ALIGNMENT (4096)
+
+// Maximum number of cells of the grid indexing the rasters of a container
+#define RASTER_INDEX_MAX_CELLS (4096)
+
+// Points sampled along each border of a geographic region to bound its pixel footprint
+#define PREFETCH_EDGE_SAMPLES (8)
+
+// Maximum number of overview levels of each raster band
+#define RASTER_MAX_OVERVIEWS (8)
+
+// Regions, along each axis, in which the lattices approximating the projections are built
+#define PROJECTION_LATTICE_REGIONS (16)
+
+// Maximum refinement level of the lattice regions, which are split in 2^level cells a side
+#define PROJECTION_LATTICE_MAX_LEVEL (5)
+
+/**
+ * @brief Sparse table of the data blocks of a raster band.
+ * @details Each entry is null until the corresponding block is read from the file. The 
+ * table owns the memory of the loaded blocks, which is released on its destruction, 
+ * unless the blocks are served from a memory-mapped tile cache.
+ */
+struct RasterBlockTable {
+
+    RasterBlockTable(size_t n) : blocks(n) {}
+    ~RasterBlockTable();
+
+    /* Allocate and release the storage of a block of n floats. The storage is untyped, 
+     * since the band pixels are stored with their own type, followed by the pyramid 
+     * levels. */
+    static float* allocate(size_t n);
+    static void release(const float* p);
+
+    std::vector<std::atomic<const float*>> blocks;
+    std::atomic<size_t> nLoaded{0};
+
+    // Mapped tile cache the blocks point to, if any
+    std::shared_ptr<void> mapping;
+
+    // Serialises the block reads, which can be triggered by any thread
+    std::mutex mutex;
+
+    // Overview levels of the band, from the finest to the coarsest one
+    std::vector<std::unique_ptr<RasterBlockTable>> overviews;
+
+    /* Band-wide maximum-value pyramid levels and slope maps. They are written under the 
+     * mutex and read without locking. Each entry keeps its conservative initial value 
+     * until all the blocks it depends on are loaded, when it is set to its exact value, 
+     * thus it never depends on the order in which the blocks are loaded. */
+    std::vector<std::vector<std::atomic<float>>> pyramid;
+    std::vector<std::atomic<float>> tileSlopes;
+    std::vector<std::atomic<float>> slopes;
+
+    // Entries that hold their exact value, only accessed under the mutex
+    std::vector<std::vector<bool>> pyramidReady;
+    std::vector<bool> tileSlopesReady;
+
+};
+
+/**
+ * @brief Reduction of the band pixels used to build the overview levels.
+ */
+enum class OverviewReduction {
+    NONE, 
+    MEAN, 
+    MIN, 
+    MAX
+};
+
+/**
+ * @brief Outcome of the intersection between a segment and a raster surface.
+ * @details UNKNOWN is returned when the surface can't be reconstructed along the whole 
+ * segment, e.g., because the segment leaves the raster or crosses pixels without data.
+ */
+enum class SegmentHit {
+    NONE, 
+    HIT, 
+    UNKNOWN
+};
+
+/**
+ * @brief Representation of the band pixels within the loaded blocks.
+ * @details UINT8, INT16 and UINT16 store the native file values. QUANT16 stores integer 
+ * values as 16-bit offsets from the band minimum, reserving the largest code for the no 
+ * data pixels. FLOAT32 stores any other band.
+ */
+enum class RasterStorage : ui8_t {
+    FLOAT32, 
+    UINT8, 
+    INT16, 
+    UINT16, 
+    QUANT16
+};
+
+enum class LatticeRegionState : ui8_t {
+    EMPTY, 
+    BUILDING, 
+    READY, 
+    EXACT
+};
+
+/**
+ * @brief Lattices of exact pixel coordinates approximating the projection of a raster.
+ * @details The geographic bounds of the raster are split in a grid of regions. The first 
+ * time a region is queried, it is covered with a uniform lattice, which is refined until 
+ * the bilinear interpolation of its nodes matches the exact projection within the 
+ * tolerance. Regions where this is not possible are flagged to be projected exactly.
+ */
+struct ProjectionLattice {
+
+    struct Region {
+        std::atomic<LatticeRegionState> state{LatticeRegionState::EMPTY};
+        ui32_t size = 0;            // Cells along each axis
+        std::vector<double> nodes;  // Pixel coordinates of the (size + 1)^2 nodes
+    };
+
+    ProjectionLattice(double tol) : 
+        tolerance(tol), regions(PROJECTION_LATTICE_REGIONS*PROJECTION_LATTICE_REGIONS) {}
+
+    double tolerance; // Maximum interpolation error, in pixels
+    std::vector<Region> regions;
+
+};
+
+/**
+ * @brief Header of the tile cache files.
+ * @details The header identifies the source raster and the layout of the cached data, so 
+ * that outdated or incompatible caches are detected and rebuilt. 
+ */
+struct TileCacheHeader {
+    char tag[4]; 
+    ui32_t version; 
+    ui32_t width, height; 
+    ui32_t blockWidth, blockHeight; 
+    ui32_t storage, reserved;
+    double transform[6];
+    double noData, vMin, vMax; 
+    double scale, offset;
+    ui64_t size, mtime;
+};
+
+/**
+ * @brief Header of the cone-step map cache files.
+ * @details The header stores the cone ratio limit and the raster file size and 
+ * modification time, so that the maps of updated rasters are rebuilt.
+ */
+struct ConeMapHeader {
+    char tag[4]; 
+    ui32_t version; 
+    ui32_t width, height;
+    double ratio;
+    ui64_t size, mtime;
+};
+
+/**
+ * @brief Metadata of a raster band, from which the band is set up without reading its 
+ * file.
+ */
+struct RasterBandMetadata {
+    ui32_t xBlock, yBlock; 
+    ui32_t width, height; 
+    ui32_t type;    // GDAL data type
+    double vMin, vMax, noData; 
+};
+
+/**
+ * @brief Metadata of a raster file, stored in the raster index.
+ * @details The size and modification time of the raster file, and the modification time 
+ * of its projection file, identify the version of the raster the metadata was read from.
+ */
+struct RasterMetadata {
+    ui64_t size = 0, mtime = 0, prjMtime = 0; 
+    ui32_t width = 0, height = 0; 
+    double transform[6];  // Affine transformation elements
+    std::string wkt;      // Map reference system
+    std::vector<RasterBandMetadata> bands;
+};
+
 /* -------------------------------------------------------
                         RASTER BAND
 ---------------------------------------------------------- */
@@ -54,6 +259,39 @@ class RasterBand {
          */
         RasterBand(const RasterDescriptor& d, std::shared_ptr<GDALDataset> pd, int i);
 
+        /**
+         * @brief Construct a new RasterBand object from its stored metadata, without 
+         * opening the raster file.
+         * @details The band must be attached to its GDAL band before loading its data.
+         * 
+         * @param d Raster descriptor.
+         * @param m Band metadata.
+         */
+        RasterBand(const RasterDescriptor& d, const RasterBandMetadata& m);
+
+        /**
+         * @brief Return the band metadata, from which the band can be constructed again.
+         */
+        RasterBandMetadata metadata() const;
+
+        /**
+         * @brief Attach the band to the GDAL band its data is read from.
+         * @details GDAL datasets can't be read from concurrent threads, thus all the 
+         * bands of a dataset share the mutex that serialises their reads.
+         *
+         * @param p GDAL band.
+         * @param m Mutex of the dataset.
+         */
+        inline void attach(GDALRasterBand* p, std::shared_ptr<std::mutex> m) { 
+            pBand = p; 
+            ioMutex = std::move(m);
+        }
+
+        /**
+         * @brief Return true if the band is attached to its GDAL band.
+         */
+        inline bool isAttached() const { return pBand != nullptr; }
+
         // Retrieve the minimum raster value; 
 
         /**
@@ -111,15 +349,82 @@ class RasterBand {
         inline double noDataVal() const { return _noDataVal; } 
 
         /**
-         * @brief Return true if the underlying data has been loaded into memory.
+         * @brief Return the representation of the pixels stored in memory.
+         * @details It is selected from the GDAL data type and the value range of the band, 
+         * so that the stored values are always exact: 8 and 16-bit bands keep their 
+         * native type, whereas wider integer bands spanning at most 65535 values are 
+         * quantized to 16 bits. Floating-point bands are stored as 32-bit floats.
          */
-        inline bool isLoaded() const { return nLoadedElements > 0; }
+        inline RasterStorage storage() const { return _storage; }
 
         /**
-         * @brief Load the raster band data into memory.
+         * @brief Return true if the band is ready to provide its data.
+         */
+        inline bool isLoaded() const { return table != nullptr; }
+
+        /**
+         * @brief Return the number of data blocks currently stored in memory.
+         */
+        inline size_t nLoadedBlocks() const { return table ? table->nLoaded.load() : 0; }
+
+        /**
+         * @brief Return the heap memory, in bytes, used by the band data and its 
+         * auxiliary maps. Blocks served from a memory-mapped tile cache are not counted.
+         */
+        size_t memoryUsage() const;
+
+        /**
+         * @brief Prepare the raster band to load its data.
+         * @details The band data is split in blocks, whose size is a multiple of the 
+         * natural block size of the file. Each block is read the first time one of its 
+         * pixels is accessed, thus only the regions that are actually sampled are stored 
+         * in memory.
          */
         void loadData(); 
 
+        /**
+         * @brief Read all the band data blocks that are not yet in memory.
+         */
+        void loadBlocks();
+
+        /**
+         * @brief Read the band data blocks overlapping a pixel region, if not yet in 
+         * memory.
+         *
+         * @param u0 Leftmost pixel column.
+         * @param v0 Uppermost pixel row.
+         * @param u1 Rightmost pixel column.
+         * @param v1 Lowermost pixel row.
+         */
+        void loadBlocks(ui32_t u0, ui32_t v0, ui32_t u1, ui32_t v1);
+
+        /**
+         * @brief Serve the band data from a memory-mapped tile cache file.
+         * @details The cache stores the data blocks, together with their pyramid levels, 
+         * at page-aligned offsets, followed by the band-wide pyramid levels and slope 
+         * tiles. The blocks are read from disk by the operating system only when they are 
+         * accessed, and the processes mapping the same file share a single copy of them.
+         *
+         * @param path Cache file path.
+         * @param header Expected header, whose band-dependent fields are filled by this 
+         * function. 
+         * @return true If the cache is valid and it has been mapped.
+         */
+        bool mapTileCache(const std::filesystem::path& path, const TileCacheHeader& header);
+
+        /**
+         * @brief Write the band data to a tile cache file. 
+         * @details The blocks are written as they are read and released once the 
+         * band-wide structures no longer need them, which are written last. The file is 
+         * first written to a temporary path and then renamed.
+         *
+         * @param path Cache file path.
+         * @param header Cache header, whose band-dependent fields are filled by this 
+         * function.
+         * @return true If the file has been written.
+         */
+        bool writeTileCache(const std::filesystem::path& path, const TileCacheHeader& header);
+
         /**
          * @brief Unload the raster band data from memory.
          */
@@ -146,13 +451,203 @@ class RasterBand {
          */
         double getData(ui32_t u, ui32_t v) const;  
 
+        /**
+         * @brief Set the reduction used to build the overview levels of the band.
+         * @details The k-th overview level halves the resolution of the previous one, 
+         * with level 0 being the band itself. Its blocks are read from the matching GDAL 
+         * overview, if the reduction is the mean and the file embeds one (e.g., in COG 
+         * files), otherwise they are reduced from the finer level the first time they 
+         * are accessed. The setting applies from the next loading of the band.
+         */
+        void setOverviewReduction(OverviewReduction mode);
+        inline OverviewReduction overviewReduction() const { return overviewMode; }
+
+        inline ui32_t nOverviewLevels() const { return nOverviews; }
+
+        /**
+         * @brief Bilinearly interpolate an overview level at given pixel coordinates.
+         * 
+         * @param pix Band pixel coordinates.
+         * @param level Overview level, clamped to the available ones. 
+         * @return double Interpolated value, in physical units, excluding no data pixels. 
+         * If none of the surrounding pixels has data, the no data value is returned.
+         */
+        double getOverviewData(const point2& pix, ui32_t level) const;
+
+        /**
+         * @brief Bilinearly interpolate the band at given pixel coordinates.
+         * @details The surrounding pixels are read directly from the band blocks, without 
+         * any bounds check, and the no data ones are excluded from the interpolation.
+         * 
+         * @param pix Pixel coordinates, which must lie within the band limits.
+         * @return double Interpolated value, in physical units. If none of the 
+         * surrounding pixels has data, NaN is returned.
+         */
+        double interpolate(const point2& pix) const;
+
+        /**
+         * @brief Bilinearly interpolate the band at a batch of pixel coordinates.
+         * @details The weights of the whole batch are computed at once, in loops that 
+         * the compiler can vectorise.
+         * 
+         * @param n Number of points.
+         * @param x Pixel column coordinates, which must lie within the band limits.
+         * @param y Pixel row coordinates, which must lie within the band limits.
+         * @param h Interpolated values, in physical units. 
+         */
+        void interpolate(size_t n, const double* x, const double* y, double* h) const;
+
+        /**
+         * @brief Return the number of levels of the maximum-value pyramid.
+         * @details The pyramid is built as the band blocks are loaded. The k-th level
+         * (zero-based) stores the maximum value of square tiles with a side of 2^(k+1)
+         * pixels. Tiles covering any block that is not loaded yet store the band maximum.
+         */
+        inline size_t nPyramidLevels() const { return nLevels; }
+
+        /**
+         * @brief Return the maximum value of the pyramid tile containing a given pixel.
+         *
+         * @param u Horizontal pixel coordinate.
+         * @param v Vertical pixel coordinate.
+         * @param k Pyramid level, in zero-based notation.
+         * @return double Maximum tile value, in physical units. No data pixels are
+         * excluded, thus tiles made only of no data pixels return -inf.
+         */
+        double getTileMax(ui32_t u, ui32_t v, size_t k) const;
+
+        /**
+         * @brief Compute the distance a ray can safely travel without reaching the band
+         * surface.
+         * @details The pyramid levels are traversed looking for the largest tile around
+         * the given pixel whose maximum value is still below the ray height. The
+         * returned distance is bounded both by the vertical clearance from such
+         * maximum and by the horizontal distance from the tile edges.
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param h Ray height, in the same physical units of the band values.
+         * @param pixSize Minimum ground size of a pixel, in the same units of h.
+         * @return double Safe travel distance.
+         */
+        double getSafeDistance(const point2& pix, double h, double pixSize) const;
+
+        /**
+         * @brief Retrieve the current upper bound of the band values.
+         * @details The bound is the top of the maximum-value pyramid, which holds the 
+         * band maximum until all the blocks are loaded. 
+         * 
+         * @return double Maximum band value, in physical units.
+         */
+        double getPyramidMaximum() const;
+
+        /**
+         * @brief Return the highest corner with data of the cell whose top-left corner 
+         * is a given pixel.
+         *
+         * @param u Horizontal pixel coordinate.
+         * @param v Vertical pixel coordinate.
+         * @return double Maximum corner value, or -inf if no corner has data.
+         */
+        double getCellMaximum(ui32_t u, ui32_t v) const;
+
+        /**
+         * @brief Build the cone-step map of the band.
+         * @details For each pixel, the map stores the ratio between the horizontal 
+         * distance (in pixels) and the height (in physical units) of the widest upward 
+         * cone that does not intersect the bilinear band surface. The cone apex lies on 
+         * the highest corner of the cell with corner on the pixel, one pixel behind the 
+         * cell, so that the cone bounds the rays anywhere above the cell. The whole band 
+         * data is read by this function.
+         *
+         * @param maxRatio Maximum cone ratio, in pixels per physical unit.
+         */
+        void buildConeMap(double maxRatio);
+
+        /**
+         * @brief Assign a previously computed cone-step map to the band.
+         * @param map Cone ratios, stored row by row.
+         */
+        void setConeMap(std::vector<float> map); 
+
+        inline const std::vector<float>& getConeMap() const { return cones; }
+        inline bool isConeMapLoaded() const { return !cones.empty(); }
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the cone-step map.
+         * @details The ray is advanced within the cone of the pixel below it, taking into 
+         * account the horizontal and vertical components of its direction. 
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param h Ray height, in the same physical units of the band values.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @param pixSize Minimum ground size of a pixel, in the same units of h.
+         * @return double Safe travel distance.
+         */
+        double getConeDistance(
+            const point2& pix, double h, double a, double b, double pixSize
+        ) const;
+
+        /**
+         * @brief Return the maximum slope around the tile containing a given pixel.
+         * @details The slopes are computed once the band blocks around the tile are 
+         * loaded and they bound the gradient of the bilinear band surface within the 
+         * tile and its 8 neighbours.
+         *
+         * @param u Horizontal pixel coordinate.
+         * @param v Vertical pixel coordinate.
+         * @return double Maximum slope, in physical units per pixel. Tiles with no data 
+         * pixels return inf.
+         */
+        double getTileSlope(ui32_t u, ui32_t v) const;
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the maximum slope 
+         * around its footprint. 
+         * @details The surface below the ray can't rise faster than the maximum slope, 
+         * thus the ray is safe until its height above the surface, decreased at such 
+         * rate along its horizontal motion, is exhausted (i.e., sphere tracing).
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param h Ray height, in the same physical units of the band values.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @param pixSize Minimum ground size of a pixel, in the same units of h.
+         * @return double Safe travel distance.
+         */
+        double getSlopeDistance(
+            const point2& pix, double h, double a, double b, double pixSize
+        ) const;
+
+        /**
+         * @brief Intersect a segment with the bilinear surface of the band.
+         * @details The cells crossed by the segment footprint are traversed in order and 
+         * the segment is intersected in closed form with the bilinear patch of each cell,
+         * whose corners are the band pixels. The segment footprint is assumed linear in 
+         * pixel space, whereas its height is described by a quadratic function.
+         *
+         * @param p0 Pixel coordinates of the segment start.
+         * @param p1 Pixel coordinates of the segment end.
+         * @param h Segment heights at its start, middle and end points.
+         * @param x Segment fraction, in [0, 1], of the first intersection. 
+         * @return SegmentHit HIT if the intersection was found, NONE if the segment 
+         * does not intersect the surface and UNKNOWN if any of the crossed cells is 
+         * not entirely defined before the intersection.
+         */
+        SegmentHit intersectSegment(
+            const point2& p0, const point2& p1, const point3& h, double& x
+        ) const;
+
 
     private: 
 
         // We can't make this a shared_ptr because when the band is destroyed
         // it interferes with the original GDALDataset that container it, i guess..
-        GDALRasterBand* pBand;
-        std::shared_ptr<float> data;
+        GDALRasterBand* pBand = nullptr;
+        GDALDataType _dataType;
+
+        // Mutex serialising the reads of the dataset the band belongs to
+        std::shared_ptr<std::mutex> ioMutex;
 
         ui32_t _xBlock, _yBlock;      
         ui32_t _width, _height; 
@@ -162,7 +657,91 @@ class RasterBand {
 
         double _noDataVal;
 
-        ui32_t nLoadedElements = 0; 
+        // Pixel representation and the offset of the quantized values
+        RasterStorage _storage = RasterStorage::FLOAT32; 
+        double storageOffset = 0.0;
+
+        /* Size of the blocks in which the data is loaded, its base-2 logarithm and the 
+         * number of blocks per axis. */
+        ui32_t blockWidth, blockHeight; 
+        ui32_t blockBitsX, blockBitsY;
+        ui32_t nBlocksX, nBlocksY; 
+
+        // Loaded data blocks, shared by all the copies of the band
+        std::shared_ptr<RasterBlockTable> table; 
+
+        /* Size of each level of the maximum-value pyramid (in physical units). The first 
+         * levels, whose tiles fit within a block, are stored after the data of each 
+         * block, padded to a whole number of floats, whereas the remaining ones are 
+         * stored for the whole band in the block table. */
+        size_t nLevels = 0, nBlockLevels = 0;
+        std::vector<size_t> levelOffset;
+        std::vector<ui32_t> pyramidWidth;
+        std::vector<ui32_t> pyramidHeight;
+
+        // Overview levels, with the size of each of them (level 0 is the band)
+        OverviewReduction overviewMode = OverviewReduction::NONE;
+        ui32_t nOverviews = 0;
+        std::vector<ui32_t> overviewWidth, overviewHeight, overviewBlocksX;
+
+        // GDAL overviews matching each level, if any
+        std::vector<GDALRasterBand*> overviewBands;
+
+        // Cone-step map, in pixels per physical unit
+        std::vector<float> cones; 
+
+        /* Size of the maps, stored in the block table, of the maximum slope within and 
+         * around each tile, in physical units per pixel. */
+        ui32_t slopesWidth, slopesHeight;
+
+        // Return the data of a block, reading it from the file if required
+        const float* getBlock(ui32_t bu, ui32_t bv) const;
+        const float* loadBlock(size_t b) const;
+
+        // Return a raw pixel value, reading its block if required
+        float getValue(ui32_t u, ui32_t v) const;
+
+        // Decode the raw value of the i-th pixel of a block
+        inline float decodeValue(const float* pData, size_t i) const;
+
+        /* Retrieve the raw values of the cell whose upper-left pixel is (u, v), in row 
+         * order. Returns a mask whose bits are set for the pixels with data. */
+        inline ui32_t getCell(ui32_t u, ui32_t v, float* val) const;
+
+        // Read the pixels of a block region in the band storage
+        CPLErr readBlock(float* pData, ui32_t x0, ui32_t y0, ui32_t w, ui32_t h) const;
+
+        // Return the value of a pyramid tile, reading its block if required
+        float getLevelValue(size_t k, ui32_t i, ui32_t j) const;
+
+        /* Return the value of a pyramid tile (k >= 0) or of a raw pixel (k < 0) without 
+         * reading any block. Returns false if the block is not loaded. */
+        bool peekValue(int k, ui32_t i, ui32_t j, float& val) const;
+
+        // Select the band storage and the size of the data blocks
+        void initLayout();
+
+        void initPyramid();
+        void initSlopeMap();
+        void initOverviews();
+
+        // Return a raw value of an overview level, reading its block if required
+        float getOverviewValue(ui32_t level, ui32_t u, ui32_t v) const;
+        const float* loadOverviewBlock(ui32_t level, size_t b) const;
+
+        // Fill the band-dependent fields of a tile cache header
+        TileCacheHeader getTileCacheHeader(const TileCacheHeader& header) const;
+
+        // Size, in bytes, of each cached block and of the whole cache file
+        size_t getTileCacheStride() const;
+        size_t getTileCacheSize() const;
+
+        // Update the structures depending on the pixels within [x0, x1) x [y0, y1)
+        void buildBlockPyramid(float* pData) const;
+        void updatePyramid(ui32_t x0, ui32_t y0, ui32_t x1, ui32_t y1) const;
+        void updateSlopeMap(ui32_t x0, ui32_t y0, ui32_t x1, ui32_t y1) const;
+
+        float computeConeRatio(ui32_t u, ui32_t v, double maxRatio) const;
 };
 
 
@@ -187,6 +766,31 @@ class RasterFile {
          */
         RasterFile(const RasterDescriptor& desc, size_t nThreads = 1);
 
+        /**
+         * @brief Construct a new Raster File object from its stored metadata.
+         * @details The raster dataset is not opened until the data of one of its bands 
+         * is loaded.
+         * 
+         * @param desc Raster descriptor object.
+         * @param m Raster metadata, usually retrieved from the raster index.
+         * @param nThreads Number of parallel threads that may access its data.
+         */
+        RasterFile(const RasterDescriptor& desc, const RasterMetadata& m, size_t nThreads = 1);
+
+        /**
+         * @brief Return the raster metadata, from which the raster can be set up again 
+         * without opening its dataset.
+         * @details The file identifiers are left empty, see getRasterStamp.
+         */
+        RasterMetadata metadata() const;
+
+        /**
+         * @brief Open the raster dataset, if not already open, and attach its bands.
+         * @note This function is not thread-safe. 
+         */
+        void open();
+        inline bool isOpen() const { return pDataset != nullptr; }
+
         /**
          * @brief Get the name of the underlying raster file. 
          * @return std::string Raster file name.
@@ -199,6 +803,13 @@ class RasterFile {
          */
         inline std::filesystem::path getFilePath() const { return filepath; }
 
+        /**
+         * @brief Set the directory storing the cone-step map and tile cache files.
+         * @param dir Cache directory. An empty path stores the caches next to the raster 
+         * file.
+         */
+        inline void setCacheDirectory(const std::filesystem::path& dir) { cacheDir = dir; }
+
         /**
          * @brief Return the horizontal size of the raster.
          * @return ui32_t Raster width, in pixels.
@@ -227,6 +838,16 @@ class RasterFile {
          */
         inline double resolution() const { return _resolution; }
 
+        /**
+         * @brief Return a lower bound on the ground size of a raster pixel.
+         * @details The value is estimated by sampling the pixel footprint on the reference
+         * body at several locations within the raster and it includes a safety margin
+         * to account for the projection distortions between the samples.
+         *
+         * @return double Minimum pixel ground size, in meters.
+         */
+        inline double minPixelSize() const { return _minPixelSize; }
+
         /**
          * @brief Return the number of supported threads.
          * @details The number of threads is used to create a different transformation 
@@ -312,21 +933,213 @@ class RasterFile {
          */
         bool isWithinGeographicBounds(const point2& p) const; 
 
+        /**
+         * @brief Compute the ground distance between a point and the raster geographic
+         * limits.
+         * @details The distance is a lower bound, i.e., any point whose ground distance
+         * from p is smaller than this value is guaranteed to be within the raster limits.
+         * Longitude limits spanning the whole body are ignored. The bound is tighter 
+         * when only the points close to p are of interest, since the parallels shrink 
+         * with the latitudes they reach rather than with the raster ones.
+         *
+         * @param p Point storing the longitude and latitude, in degrees.
+         * @param dMax Largest distance of interest, in meters.
+         * @return double Distance from the closest raster limit, in meters, clamped to 
+         * dMax.
+         */
+        double distanceToGeographicBounds(const point2& p, double dMax) const;
+
+        /**
+         * @brief Compute the ground distance between a point outside the raster and its 
+         * geographic limits.
+         * @details The distance is a lower bound, i.e., no point within the raster limits 
+         * is closer to p than this value.
+         *
+         * @param p Point storing the longitude and latitude, in degrees.
+         * @return double Distance from the raster limits, in meters. 0 if p is within 
+         * them.
+         */
+        double distanceFromGeographicBounds(const point2& p) const;
+
+        /**
+         * @brief Compute the distance a ray can safely travel without hitting the surface
+         * described by the first raster band.
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param s Longitude and latitude of the ray footprint, in degrees.
+         * @param h Ray altitude, in meters.
+         * @param level Overview level of the surface, whose footprint shrinks the 
+         * distance.
+         * @return double Safe travel distance, in meters.
+         */
+        double getSafeDistance(
+            const point2& pix, const point2& s, double h, ui32_t level = 0
+        ) const;
+
+        /**
+         * @brief Compute the distance a ray travels before entering the next raster cell.
+         * @details The cells are visited as in the Amanatides-Woo traversal, i.e., the 
+         * distance is the smallest among those required to cross the next column and row 
+         * boundaries, plus a margin of DDA_CELL_MARGIN pixels. If the ray direction is 
+         * unknown, a quarter of the minimum pixel size is returned so that the direction 
+         * can be estimated from the next sample without skipping any cell.
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param dpix Ray direction in pixel space, in pixels per meter.
+         * @return double Distance to the next cell, in meters.
+         */
+        double getCellDistance(const point2& pix, const point2& dpix) const;
+
+        /**
+         * @brief Return the highest corner of the first raster band cell containing a 
+         * pixel. 
+         * @details Since the band surface is bilinearly interpolated within each cell, 
+         * no point of the cell is higher than such value. The corners without data are 
+         * ignored.
+         *
+         * @param pix Pixel coordinates.
+         * @return double Maximum cell altitude, or -inf if no corner has data.
+         */
+        double getCellMaximum(const point2& pix) const;
+
+        /**
+         * @brief Return the bounding volume of the first raster band surface.
+         * @details The volume encloses the raster geographic limits between the minimum 
+         * and maximum band altitudes, thus rays that do not cross it can't hit the 
+         * surface described by this raster.
+         */
+        inline const SphericalVolume& getBoundingVolume() const { return volume; }
+
+        // Angular size of the largest pixel side, in radians
+        inline double getAngularResolution() const { return _angularRes; }
+
         // Raster Bands Interfaces 
         
-        inline void loadBand(size_t i) { bands[i].loadData(); };
+        inline void loadBand(size_t i) { open(); bands[i].loadData(); };
         inline void unloadBand(size_t i) { bands[i].unloadData(); }; 
         inline bool isBandLoaded(size_t i) const { return bands[i].isLoaded(); }; 
 
+        // Read all the data blocks of a loaded raster band
+        inline void loadBandBlocks(size_t i) { bands[i].loadBlocks(); }
+
+        /**
+         * @brief Read the data blocks of a loaded raster band that overlap a geographic 
+         * region.
+         *
+         * @param i Band index.
+         * @param lonBounds Region longitude limits, in degrees.
+         * @param latBounds Region latitude limits, in degrees.
+         * @param threadid Thread ID.
+         */
+        void prefetchBand(
+            size_t i, const double* lonBounds, const double* latBounds, ui32_t threadid = 0
+        );
+
+        /**
+         * @brief Load the cone-step map of a raster band.
+         * @details The map is read from its cache file. If such file does not exist or is 
+         * outdated, the map is computed from the band data, which must be already loaded, 
+         * and the cache file is updated.
+         *
+         * @param i Band index.
+         */
+        void loadConeMap(size_t i);
+
+        /**
+         * @brief Check whether the cache file of a band cone-step map is up to date.
+         * @param i Band index.
+         */
+        bool hasConeMapCache(size_t i) const;
+
+        /**
+         * @brief Load a raster band from its tile cache.
+         * @details If the cache file does not exist or is outdated, the whole band is read and the cache file is 
+         * written. If the cache can't be used, the band is loaded from the raster file.
+         *
+         * @param i Band index.
+         */
+        void loadTileCache(size_t i);
+        inline bool isConeMapLoaded(size_t i) const { return bands[i].isConeMapLoaded(); }
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the cone-step map of 
+         * the first raster band.
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param s Longitude and latitude of the ray footprint, in degrees.
+         * @param h Ray altitude, in meters.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @return double Safe travel distance, in meters.
+         */
+        double getConeDistance(
+            const point2& pix, const point2& s, double h, double a, double b
+        ) const;
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the maximum slopes of 
+         * the first raster band.
+         *
+         * @param pix Pixel coordinates of the ray footprint.
+         * @param s Longitude and latitude of the ray footprint, in degrees.
+         * @param h Ray altitude, in meters.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @return double Safe travel distance, in meters.
+         */
+        double getSlopeDistance(
+            const point2& pix, const point2& s, double h, double a, double b
+        ) const;
+
+        /**
+         * @brief Intersect a segment with the bilinear surface of the first raster band.
+         * @details The segment footprint is linearly mapped in pixel space. If such 
+         * approximation is not accurate enough, or if the segment leaves the raster, 
+         * the outcome is unknown.
+         *
+         * @param s0 Longitude and latitude of the segment start, in degrees.
+         * @param sm Longitude and latitude of the segment middle point, in degrees.
+         * @param s1 Longitude and latitude of the segment end, in degrees.
+         * @param h Segment altitudes at its start, middle and end points, in meters.
+         * @param x Segment fraction, in [0, 1], of the first intersection. 
+         * @param threadid Thread ID.
+         * @return SegmentHit Intersection outcome.
+         */
+        SegmentHit intersectSegment(
+            const point2& s0, const point2& sm, const point2& s1, const point3& h, 
+            double& x, ui32_t threadid = 0
+        ) const;
+
         void loadBands(); 
         void unloadBands(); 
 
+        // Return the heap memory, in bytes, used by the loaded raster bands
+        size_t memoryUsage() const;
+
         inline double getBandNoDataValue(ui32_t i) const { return bands[i].noDataVal(); }
 
         inline double getBandData(ui32_t u, ui32_t v, ui32_t i = 0) const { 
             return bands[i].getData(u, v);
         }
 
+        inline double getOverviewData(const point2& pix, ui32_t level, ui32_t i = 0) const {
+            return bands[i].getOverviewData(pix, level);
+        }
+
+        // Bilinearly interpolate a band at one or more clamped pixel locations
+        inline double interpolateBand(const point2& pix, ui32_t i = 0) const {
+            return bands[i].interpolate(pix);
+        }
+
+        inline void interpolateBand(
+            size_t n, const double* x, const double* y, double* h, ui32_t i = 0
+        ) const {
+            bands[i].interpolate(n, x, y, h);
+        }
+
+        // Set the reduction used to build the overview levels of all the bands
+        void setOverviewReduction(OverviewReduction mode);
+
         inline const RasterBand* getRasterBand(ui32_t i) const { return &bands[i]; }
 
         // Transformation Functions
@@ -340,12 +1153,44 @@ class RasterFile {
         point2 sph2pix(const point2& s, ui32_t threadid = 0) const;
         point2 pix2sph(const point2& p, ui32_t threadid = 0) const; 
 
-        inline const OGRSpatialReference* crs() const { return pDataset->GetSpatialRef(); }
+        /**
+         * @brief Convert a batch of geographic coordinates to pixel coordinates.
+         * @details All the points are projected with a single transformation call, which 
+         * is significantly cheaper than projecting them one at a time.
+         *
+         * @param n Number of points.
+         * @param x Longitudes, in degrees. On output, the pixel column coordinates.
+         * @param y Latitudes, in degrees. On output, the pixel row coordinates.
+         * @param threadid Thread ID.
+         */
+        void sph2pix(size_t n, double* x, double* y, ui32_t threadid = 0) const;
+
+        inline const OGRSpatialReference* crs() const { return &mapCRS; }
+
+        /**
+         * @brief Return true if the map coordinates are computed with a native closed-form 
+         * projection rather than with OGR.
+         */
+        inline bool hasNativeProjection() const { return projection.isValid(); }
+
+        /**
+         * @brief Approximate the conversion from geographic to pixel coordinates with 
+         * bilinearly interpolated lattices, built lazily for each region of the raster.
+         * @details The lattices are only used by rasters without a native projection. 
+         *
+         * @param tol Maximum interpolation error, in pixels. 0 disables the lattices.
+         */
+        void setProjectionLattice(double tol);
+        inline bool hasProjectionLattice() const { return lattice != nullptr; }
 
     private: 
 
         std::filesystem::path filepath;
+        std::filesystem::path cacheDir;
         std::shared_ptr<GDALDataset> pDataset;
+        std::shared_ptr<std::mutex> ioMutex = std::make_shared<std::mutex>();
+
+        OGRSpatialReference mapCRS; // Map reference system
 
         std::string filename; 
 
@@ -359,10 +1204,16 @@ class RasterFile {
         double _left, _right; 
 
         double _resolution;     
+        double _minPixelSize;
+
+        double _radius;     // Reference body radius
+        double _angularRes; // Angular size of the largest pixel side, in radians
 
         double lon_bounds[2];  // Raster longitude bounds
         double lat_bounds[2];  // Raster latitude bounds
 
+        SphericalVolume volume; // Bounding volume of the first band surface
+
         Affine transform;  // Affine dataset transformation.
         Affine iTransform; // Inverse affine transformation.
 
@@ -375,6 +1226,12 @@ class RasterFile {
         // Inverse transformation (from projected to geographic) 
         std::vector<std::shared_ptr<OGRCoordinateTransformation>> m2sT; 
 
+        // Native projection, used in place of the OGR transformations when valid
+        MapProjection projection;
+
+        // Interpolation lattices of the non-native projections, if enabled
+        std::shared_ptr<ProjectionLattice> lattice;
+
         // Store raster bands 
         std::vector<RasterBand> bands;
 
@@ -382,8 +1239,66 @@ class RasterFile {
 
         void setupTransformations(); 
 
+        // Convert a batch of geographic coordinates to unclamped pixel coordinates
+        bool projectPixels(size_t n, double* x, double* y, ui32_t threadid) const;
+
+        /* Interpolate the pixel coordinates of a point, building its lattice region if 
+         * required. Returns false if the point must be projected exactly. */
+        bool interpolatePixel(const point2& s, point2& pix, ui32_t threadid) const;
+
+        void buildLatticeRegion(
+            ProjectionLattice::Region& r, ui32_t i, ui32_t j, ui32_t threadid
+        ) const;
+
+        void computeMinPixelSize();
+
+        // Setup the quantities derived from the raster size, transform and reference system
+        void initialize(const RasterDescriptor& desc);
+
+        // Clamp a pixel location within the raster limits
+        void clampPixel(point2& pix) const;
+
+        // Return the path of a band cache file, with the given extension
+        std::filesystem::path getCachePath(size_t i, const std::string& ext) const;
+
+        // Fill the header of a band cone-step map cache, returns false if it can't be used
+        bool getConeMapHeader(ConeMapHeader& header) const;
+
 };
 
+/**
+ * @brief Retrieve the size and modification time of a raster file, and the modification 
+ * time of its projection file, if any.
+ *
+ * @param path Raster file path.
+ * @param m Metadata whose file identifiers are updated.
+ * @return true If the file identifiers are available.
+ */
+bool getRasterStamp(const std::filesystem::path& path, RasterMetadata& m);
+
+/**
+ * @brief Read the metadata of the rasters stored in an index file, keyed by their 
+ * absolute path.
+ * @details Missing or incompatible index files are treated as empty ones.
+ *
+ * @param path Index file path.
+ * @return std::map<std::string, RasterMetadata> Raster metadata.
+ */
+std::map<std::string, RasterMetadata> readRasterIndex(const std::filesystem::path& path);
+
+/**
+ * @brief Write the metadata of a set of rasters to an index file.
+ * @details The file is first written to a temporary path and then renamed, so that 
+ * concurrent readers never retrieve a partial index.
+ *
+ * @param path Index file path.
+ * @param index Raster metadata, keyed by the absolute path of the rasters.
+ * @return true If the file has been written.
+ */
+bool writeRasterIndex(
+    const std::filesystem::path& path, const std::map<std::string, RasterMetadata>& index
+);
+
 
 
 /* -------------------------------------------------------
@@ -395,23 +1310,204 @@ enum class RasterLoadingStatus {
     COMPLETED
 };
 
+enum class RasterLoadState : ui8_t {
+    UNLOADED, 
+    LOADING, 
+    READY
+};
+
+/**
+ * @struct RasterStatus
+ * @brief Loading and usage state of a raster within its container.
+ * @details Each raster is loaded and unloaded under its own mutex, so that threads only 
+ * wait for the rasters they need, while different rasters are loaded concurrently. The 
+ * pin count is atomic, thus a raster already pinned by another thread is accessed 
+ * without locking.
+ */
+struct RasterStatus {
+
+    std::atomic<RasterLoadState> state{RasterLoadState::UNLOADED};
+
+    // Number of threads with in-flight queries on the raster, which prevent its unloading
+    std::atomic<ui32_t> pins{0};
+
+    // Set once the raster is accessed within the current frame
+    bool accessed = false;
+
+    // Consecutive cleanups without any use
+    ui16_t unusedFrames = 0;
+
+    // Set once the raster is prefetched for the next frame, holding one pin until cleanup
+    bool prefetched = false;
+
+    // Number of prefetches reading the raster blocks outside the mutex
+    ui16_t nPrefetching = 0;
+
+    // Set when the raster is explicitly unloaded while its blocks are being prefetched
+    bool unloadPending = false;
+
+    // Serialises the loading, unloading and prefetching of the raster
+    std::mutex mutex;
+
+};
+
+/**
+ * @struct RasterSample
+ * @brief Descriptor of the raster location that provided a data sample.
+ * @details The descriptor is filled when the data is retrieved and can be later used to 
+ * query additional information about the same location (e.g., the safe ray travel 
+ * distance) without searching the rasters again.
+ */
+struct RasterSample {
+    size_t container = SIZE_MAX; // Index of the container (manager-level)
+    size_t raster = SIZE_MAX;    // Index of the raster within its container
+    double res = 0.0;            // Resolution of the container
+    ui32_t level = 0;            // Overview level the sample is retrieved from
+    point2 pix;                  // Pixel coordinates of the sample
+    point2 s;                    // Longitude and latitude of the sample, in degrees
+};
+
 class RasterContainer {
 
     public: 
 
         RasterContainer(double res, size_t nThreads = 1); 
+        ~RasterContainer();
 
         inline size_t nRasters() const { return rasters.size(); }; 
 
         inline double getResolution() const { return _resolution; }; 
         double getData(const point2& s, bool interp, ui32_t threadid = 0);
+        double getData(const point2& s, bool interp, RasterSample& smp, ui32_t threadid = 0);
+
+        // Retrieve the data of the active points of a batch, grouping them by raster
+        void getData(
+            size_t n, const point2* s, bool interp, const bool* mask, double* h, 
+            RasterSample* smp, ui32_t threadid = 0
+        );
+
+        /* Release the rasters pinned by the data queries of a thread, whose samples can't 
+         * be used afterwards. */
+        void releaseRasters(ui32_t threadid);
+
+        // Retrieve the safe ray travel distance around a sample
+        double getSafeDistance(const RasterSample& smp, double h) const;
+
+        /* Bound the distance, up to dMax, a ray at altitude h can travel from s without 
+         * hitting the surface of any raster. The rasters containing s are pinned. */
+        double boundSafeDistance(const point2& s, double h, double dMax, ui32_t threadid);
+        double getConeDistance(const RasterSample& smp, double h, double a, double b) const;
+        double getSlopeDistance(const RasterSample& smp, double h, double a, double b) const;
+
+        SegmentHit intersectSegment(
+            const RasterSample& smp, const point2& s0, const point2& sm, const point2& s1, 
+            const point3& h, double& x, ui32_t threadid = 0
+        ) const;
+
+        /**
+         * @brief Append the t-intervals in which a ray crosses the bounding volumes of 
+         * the rasters.
+         * @details Only the rasters overlapping the geographic footprint of the ray 
+         * segment are retrieved from the index. The intervals are neither clipped nor 
+         * merged.
+         * 
+         * @param ray Ray object.
+         * @param t0 Minimum t-value.
+         * @param t1 Maximum t-value.
+         * @param intervals Vector to which the intervals are appended.
+         */
+        void getRayIntervals(
+            const Ray& ray, double t0, double t1, std::vector<Interval>& intervals
+        ) const;
+
+        /**
+         * @brief Update the radii bounding the surface seen by a cone of rays.
+         * @details Only the rasters overlapping the geographic footprint of the cone are 
+         * retrieved from the index. The outer radius of the loaded rasters is bounded 
+         * by the top of their maximum-value pyramid.
+         * 
+         * @param apex Cone apex (i.e., the origin of all the rays).
+         * @param dir Unit vector along the cone axis.
+         * @param angle Cone half-angle, in radians.
+         * @param rStop Radius at which the rays are stopped.
+         * @param rMin Minimum surface radius, decreased by the rasters within the cone.
+         * @param rMax Maximum surface radius, increased by the rasters within the cone.
+         */
+        void getRadiusBounds(
+            const point3& apex, const vec3& dir, double angle, double rStop, 
+            double& rMin, double& rMax
+        ) const;
         
         inline const RasterFile* getRasterFile(size_t i) const { return &rasters[i]; }
 
-        inline void loadRaster(size_t i) { rasters[i].loadBand(0); }
-        inline void unloadRaster(size_t i) { rasters[i].unloadBand(0); }
+        // Radius of the inner sphere enclosed by the raster bounding volumes
+        inline double minRadius() const { return indexMinRadius; }
+
+        // Enable the loading of the cone-step maps together with the raster bands
+        inline void enableConeMaps(bool flag) { useConeMaps = flag; }
+
+        /* Build the cone-step maps of the rasters whose cache is missing or outdated, 
+         * each on a worker of a pool, and write their cache files. */
+        void buildConeMaps();
+
+        // Store the cone-step map and tile cache files in the given directory
+        void setCacheDirectory(const std::string& dir);
+
+        // Enable the loading of the raster bands from their tile caches
+        inline void enableTileCache(bool flag) { useTileCache = flag; }
+
+        /* Enable the reading of all the band blocks when the rasters are loaded, so that 
+         * their pyramids and slope maps are exact before any query. */
+        inline void enableBlockPreloading(bool flag) { preloadBlocks = flag; }
+
+        // Interpolate the raster projections with lattices of the given tolerance, in pixels
+        void setProjectionLattice(double tol);
+
+        /* Build the overview levels of the rasters with the given reduction. The samples 
+         * are then retrieved from the overview level stored in their descriptor. */
+        void setOverviewReduction(OverviewReduction mode);
+
+        /**
+         * @brief Attach a cache that bounds the memory used by the loaded rasters.
+         * @details When a cache is attached, the rasters are unloaded by the cache, in 
+         * least-recently-used order, rather than after a fixed number of unused frames.
+         */
+        void setCache(RasterCache* cache);
+
+        // Unload a raster if it is not used by the current frame
+        bool evictRaster(size_t i);
+        inline size_t getRasterMemory(size_t i) const { return rasters[i].memoryUsage(); }
+
+        void loadRaster(size_t i);
+        void unloadRaster(size_t i);
+
+        inline RasterLoadState getRasterState(size_t i) const { 
+            return status[i]->state.load(std::memory_order_acquire); 
+        }
+
+        /**
+         * @brief Load the rasters overlapping a geographic region, together with their 
+         * data blocks within the region, ahead of their use.
+         * @details The raster locks are only held while the raster bands are opened, so 
+         * that concurrent data queries are not stalled by the block reads. Prefetched 
+         * rasters are pinned until the next cleanup, thus they are neither unloaded by it 
+         * nor evicted by the cache before the frame they are loaded for.
+         *
+         * @param region Geographic region.
+         * @param threadid Thread ID.
+         * @return true If each longitude range of the region is covered by a single raster.
+         */
+        bool prefetch(const GeoRegion& region, ui32_t threadid = 0);
 
         void appendRaster(RasterDescriptor desc); 
+        void appendRaster(RasterFile&& file); 
+
+        /**
+         * @brief Build the grid index locating the rasters of the container.
+         * @details The index is built once, after all the rasters have been appended, 
+         * and it must be built before any data is queried.
+         */
+        void buildIndex();
 
         void loadRasters(); 
         void unloadRasters();
@@ -425,12 +1521,63 @@ class RasterContainer {
 
         size_t nThreads; 
 
-        // Mutex to handle raster loading\unloading. 
-        std::mutex rasterUpdateMutex;
-        std::vector<ui8_t> rastersUsed; 
-        std::vector<ui8_t> rastersFlag;
+        // Loading and usage state of each raster
+        std::vector<std::unique_ptr<RasterStatus>> status;
+
+        bool useConeMaps = false;
+        bool useTileCache = false;
+        bool preloadBlocks = false;
+        double latticeTolerance = 0.0;
+        OverviewReduction overviewMode = OverviewReduction::NONE;
+        std::string cacheDir;
+
+        RasterCache* cache = nullptr;
+
+        /* Uniform longitude/latitude grid over the raster bounds. The rasters overlapping 
+         * each cell are stored contiguously, sorted by increasing index. */
+        double indexLon = 0.0, indexLat = 0.0; 
+        double indexStepLon = 1.0, indexStepLat = 1.0; 
+        ui32_t indexWidth = 0, indexHeight = 0;
+        std::vector<ui32_t> indexOffsets; 
+        std::vector<ui32_t> indexRasters; 
+
+        // Radii and angular margin, in radians, enclosing the raster bounding volumes
+        double indexMinRadius = 0.0, indexMaxRadius = 0.0; 
+        double indexMargin = 0.0;
+
+        /* Rasters with a lower index that overlap each raster, which take precedence 
+         * within the overlapping region. */
+        std::vector<std::vector<ui32_t>> rasterPriors;
+
+        /* Last raster hit by a thread and the rasters pinned by its queries, padded to 
+         * avoid false sharing among the threads. */
+        struct alignas(64) RasterHint {
+            size_t raster = 0;
+            std::vector<size_t> pinned;
+        };
+
+        std::vector<RasterHint> lastRaster;
+
+        ui32_t getIndexColumn(double lon) const;
+        ui32_t getIndexRow(double lat) const;
+
+        // Call f(k) once for each raster k overlapping a geographic region
+        template <typename F> 
+        void forEachRaster(const GeoRegion& region, F&& f) const;
+
+        // Return the first raster containing a point, without acquiring it
+        size_t locateRaster(const point2& s, ui32_t threadid);
 
-        double interpolateRaster(const point2& pix, size_t rid) const;
+        size_t findRaster(const point2& s, ui32_t threadid);
+
+        // Load a raster, if required, and pin it until the thread releases its rasters
+        void acquireRaster(size_t k, ui32_t threadid);
+
+        // Load a raster with its mutex already locked, returns false if it was loaded
+        bool openRaster(size_t i);
+
+        // Unload a raster with its mutex already locked
+        void closeRaster(size_t i);
 
 };
 
@@ -443,10 +1590,23 @@ class RasterManager {
             RasterDescriptor desc, size_t nThreads = 1, bool displayLogs = false
         );
 
+        /**
+         * @brief Construct a new RasterManager object from a set of raster files.
+         * @details The rasters are opened in parallel. If an index file is provided, the 
+         * rasters whose metadata is stored in it are set up without opening their 
+         * datasets, which are opened only when their data is loaded. The metadata of the 
+         * remaining rasters is then added to the index.
+         *
+         * @param descs Raster descriptors.
+         * @param nThreads Number of threads.
+         * @param displayLogs Flag to display the loading status.
+         * @param indexPath Raster index file path. An empty path disables the index.
+         */
         RasterManager(
             std::vector<RasterDescriptor> descs, 
             size_t nThreads = 1, 
-            bool displayLogs = false
+            bool displayLogs = false, 
+            const std::string& indexPath = ""
         ); 
 
         virtual ~RasterManager() = default;
@@ -462,8 +1622,243 @@ class RasterManager {
         }
         
         double getData(const point2& s, double res, ui32_t threadid = 0);
+        double getData(const point2& s, double res, RasterSample& smp, ui32_t threadid = 0);
         inline double getLastResolution(ui32_t threadid = 0) { return lastRes[threadid]; };
 
+        /**
+         * @brief Retrieve the data of a batch of points. 
+         * @details The points are grouped by container and raster so that the map 
+         * projections of all the points falling in the same raster are computed with a 
+         * single call. The latest used resolution of the thread is not updated, since 
+         * each point stores its own in the sample descriptor.
+         * 
+         * @param n Number of points.
+         * @param s Longitude and latitude of each point, in degrees.
+         * @param res Desired resolution of each point.
+         * @param mask Flags identifying the points to retrieve. Other points are left 
+         * untouched. 
+         * @param h Output data of each point. -inf if no data is available.
+         * @param smp Output sample descriptor of each point.
+         * @param threadid Thread ID.
+         */
+        void getData(
+            size_t n, const point2* s, const double* res, const bool* mask, double* h, 
+            RasterSample* smp, ui32_t threadid = 0
+        );
+
+        /**
+         * @brief Release the rasters pinned by the data queries of a thread.
+         * @details Each query pins the rasters it samples, so that they are not unloaded 
+         * while the samples it returned are used. The pins are released once the 
+         * thread is done with such samples, or at the next cleanup.
+         *
+         * @param threadid Thread ID.
+         */
+        void releaseRasters(ui32_t threadid = 0);
+
+        /**
+         * @brief Compute the distance a ray can safely travel without hitting the 
+         * surface, starting from a retrieved sample.
+         * @details The distance is the minimum among the one of the raster that provided 
+         * the sample and those of the rasters of the other containers within reach. The 
+         * rasters containing the sample footprint are bounded with their pyramids, thus 
+         * they are pinned until the thread releases its rasters.
+         * 
+         * @param smp Sample descriptor.
+         * @param h Ray altitude, in meters.
+         * @param dMin Minimum distance of interest, in meters. Distances below it are 
+         * not bounded by the other containers.
+         * @param threadid Thread ID.
+         * @return double Safe travel distance, in meters. If the sample was not 
+         * retrieved from any raster, 0 is returned.
+         */
+        double getSafeDistance(
+            const RasterSample& smp, double h, double dMin = 0.0, ui32_t threadid = 0
+        );
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the cone-step map of 
+         * the raster that provided a sample.
+         * @details Cone-step maps must be enabled via `enableConeMaps`.
+         * 
+         * @param smp Sample descriptor.
+         * @param h Ray altitude, in meters.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @return double Safe travel distance, in meters. If the sample was not 
+         * retrieved from any raster, 0 is returned.
+         */
+        double getConeDistance(const RasterSample& smp, double h, double a, double b) const;
+
+        /**
+         * @brief Compute the distance a ray can safely travel using the maximum slopes of 
+         * the raster that provided a sample.
+         * 
+         * @param smp Sample descriptor.
+         * @param h Ray altitude, in meters.
+         * @param a Horizontal component of the ray direction.
+         * @param b Vertical component of the ray direction, positive when descending.
+         * @return double Safe travel distance, in meters. If the sample was not 
+         * retrieved from any raster, 0 is returned.
+         */
+        double getSlopeDistance(const RasterSample& smp, double h, double a, double b) const;
+
+        /**
+         * @brief Compute the distance a ray travels before entering the next cell of the 
+         * raster that provided a sample.
+         * @details The ray direction in pixel space is estimated from the previous sample 
+         * of the same ray, which must be retrieved from the same raster. 
+         * 
+         * @param smp Sample descriptor.
+         * @param prev Sample descriptor of the previous ray sample.
+         * @param dt Distance between the two samples, in meters.
+         * @return double Distance to the next cell, in meters. If the sample was not 
+         * retrieved from any raster, 0 is returned.
+         */
+        double getCellDistance(
+            const RasterSample& smp, const RasterSample& prev, double dt
+        ) const;
+
+        /**
+         * @brief Return the maximum altitude of the raster cell that provided a sample. 
+         * 
+         * @param smp Sample descriptor.
+         * @return double Maximum cell altitude. If the sample was not retrieved from any 
+         * raster, -inf is returned.
+         */
+        double getCellMaximum(const RasterSample& smp) const;
+
+        /**
+         * @brief Compute the t-intervals in which a ray may hit the surface described by 
+         * the rasters.
+         * @details The ray is intersected with the bounding volumes of the rasters 
+         * that the container indexes locate along it, and the resulting intervals are 
+         * merged. 
+         * 
+         * @param ray Ray object.
+         * @param t0 Minimum t-value.
+         * @param t1 Maximum t-value.
+         * @param intervals Output disjoint intervals within [t0, t1], sorted by 
+         * increasing t-values.
+         */
+        void getRayIntervals(
+            const Ray& ray, double t0, double t1, std::vector<Interval>& intervals
+        ) const;
+
+        /**
+         * @brief Compute the radii bounding the surface seen by a cone of rays.
+         * @details Only the rasters whose bounding volume may be crossed by the rays 
+         * contribute to the bounds. The maximum radius of the loaded rasters is bounded 
+         * by their maximum-value pyramids. 
+         * 
+         * @param apex Cone apex (i.e., the origin of all the rays).
+         * @param dir Unit vector along the cone axis.
+         * @param angle Cone half-angle, in radians.
+         * @param rMin Minimum surface radius.
+         * @param rMax Maximum surface radius.
+         * @return true If at least one raster is within the cone.
+         */
+        bool getRadiusBounds(
+            const point3& apex, const vec3& dir, double angle, double& rMin, double& rMax
+        ) const;
+
+        /**
+         * @brief Intersect a ray segment with the surface of the raster that provided a 
+         * sample.
+         * @details The surface is bilinearly interpolated within each raster cell. 
+         * 
+         * @param smp Sample descriptor.
+         * @param s0 Longitude and latitude of the segment start, in degrees.
+         * @param sm Longitude and latitude of the segment middle point, in degrees.
+         * @param s1 Longitude and latitude of the segment end, in degrees.
+         * @param h Segment altitudes at its start, middle and end points, in meters.
+         * @param x Segment fraction, in [0, 1], of the first intersection. 
+         * @param threadid Thread ID.
+         * @return SegmentHit Intersection outcome, UNKNOWN if the sample was not 
+         * retrieved from any raster.
+         */
+        SegmentHit intersectSegment(
+            const RasterSample& smp, const point2& s0, const point2& sm, const point2& s1, 
+            const point3& h, double& x, ui32_t threadid = 0
+        ) const;
+
+        /**
+         * @brief Enable or disable the cone-step maps of all the rasters. 
+         * @details When enabled, the cone-step map of each raster is loaded (or 
+         * computed) together with its data.
+         */
+        void enableConeMaps(bool flag = true);
+
+        /**
+         * @brief Build the cone-step maps of all the rasters and write their caches.
+         * @details Only the rasters whose cache is missing or outdated are read. This 
+         * should be called before rendering, so that the maps are not computed when 
+         * their rasters are first loaded.
+         */
+        void buildConeMaps();
+
+        /**
+         * @brief Set the directory storing the cone-step map and tile cache files.
+         * @param dir Cache directory. An empty path stores the caches next to the raster 
+         * files.
+         */
+        void setCacheDirectory(const std::string& dir);
+
+        /**
+         * @brief Enable or disable the reading of all the band blocks when the rasters 
+         * are loaded.
+         * @details The band-wide pyramid levels and slope maps are otherwise refined as 
+         * the blocks are read on demand, thus the marching steps depend on the blocks 
+         * read so far.
+         */
+        void enableBlockPreloading(bool flag = true);
+
+        /**
+         * @brief Enable or disable the tile caches of all the rasters.
+         * @details When enabled, the raster bands are served from memory-mapped tile 
+         * cache files, which are written the first time each raster is loaded.
+         */
+        void enableTileCache(bool flag = true);
+
+        /**
+         * @brief Approximate the projections of the rasters without a native one with 
+         * interpolation lattices.
+         * @param tol Maximum interpolation error, in pixels. 0 disables the lattices.
+         */
+        void setProjectionLattice(double tol);
+
+        /**
+         * @brief Retrieve the data from the overview levels of the rasters, rather than 
+         * from their pixels, when they are finer than the requested resolution.
+         * @details The level with the coarsest pixels that are still finer than the 
+         * requested resolution is sampled, which reduces aliasing and improves the 
+         * locality of the accesses for distant terrain. The safe travel distances of 
+         * such samples are shrunk by the overview footprint, whereas the cone-step and 
+         * slope distances are not available.
+         *
+         * @param mode Overview reduction. NONE samples the raster pixels.
+         */
+        void setOverviewReduction(OverviewReduction mode);
+
+        /**
+         * @brief Attach a byte-budgeted cache to all the containers.
+         * @details The cache is shared with other managers and must outlive this one. 
+         * A null pointer restores the frame-count based raster cleanup.
+         */
+        void setCache(RasterCache* cache);
+
+        /**
+         * @brief Load the rasters and the data blocks covering a geographic region ahead 
+         * of their use.
+         * @details The containers are visited in the same order of the data queries at 
+         * the given resolution, until a raster covering the whole region is found.
+         *
+         * @param region Geographic region.
+         * @param res Expected query resolution.
+         * @param threadid Thread ID, which must not be used by concurrent queries.
+         */
+        void prefetch(const GeoRegion& region, double res, ui32_t threadid = 0);
+
         inline const RasterContainer* getRasterContainer(size_t i) const { 
             return containers[i].get();
         };
@@ -476,11 +1871,17 @@ class RasterManager {
     protected: 
 
         std::vector<std::unique_ptr<RasterContainer>> containers;
+        RasterCache* cache = nullptr;
         std::vector<double> _resolutions;
 
         std::vector<double> lastRes; 
 
         size_t _nRasters;
+
+        OverviewReduction overviewMode = OverviewReduction::NONE;
+
+        // Overview level of a container matching the requested resolution
+        ui32_t getOverviewLevel(double res, size_t k) const;
         
     private: 
 
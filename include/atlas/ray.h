@@ -3,6 +3,21 @@
 
 #include "vec3.h"
 
+#include <cmath>
+#include <vector>
+
+/* Number of rays traced together in a packet. The lane loops are left to the compiler 
+ * auto-vectoriser, thus the size is only a hint matching the wider vector units. */
+#if defined(__AVX2__) || defined(__AVX__)
+#define RAY_PACKET_SIZE (8)
+#else
+#define RAY_PACKET_SIZE (4)
+#endif
+
+/* Maximum distance, in world units, travelled by a ray within a single-precision local 
+ * frame before its origin is moved forward. It keeps the float offsets millimetric. */
+#define PACKET_FRAME_EXTENT (8192.0)
+
 /** 
  * @class Ray 
  * @brief Class representing a ray object. 
@@ -16,8 +31,10 @@ class Ray {
          * @param origin Ray origin point.
          * @param direction Ray direction. The constructor will automatically take care of 
          * normalising the input vector.
+         * @param spread Ray differential, i.e., the growth of the ray footprint width per 
+         * unit distance travelled. A null value disables the footprint tracking.
          */
-        Ray(const point3& origin, const vec3& direction);
+        Ray(const point3& origin, const vec3& direction, double spread = 0.0);
 
         /**
          * @brief Return the ray origin point.
@@ -31,6 +48,20 @@ class Ray {
          */
         const vec3& direction() const;
 
+        /**
+         * @brief Return the ray differential, i.e., the footprint growth per unit distance.
+         * @return double Ray spread, in radians.
+         */
+        inline double spread() const { return _spread; }
+
+        /**
+         * @brief Compute the width of the ray footprint at a given distance from the origin.
+         * 
+         * @param t Distance from the origin, in world units.
+         * @return double Footprint width, in world units, across the ray direction.
+         */
+        inline double footprint(double t) const { return t*_spread; }
+
         /**
          * @brief Compute the position along the ray at a given distance from the origin.
          * 
@@ -61,10 +92,165 @@ class Ray {
         point3 p; 
         vec3 d; 
 
+        double _spread;
+
         // Useful quantities
         double pd; 
         double pd2; 
         double p2; 
 };
 
+
+/**
+ * @class RayPacket
+ * @brief Class representing a packet of coherent rays that are traced together.
+ * @details Besides the rays, the packet stores their origin and direction components in 
+ * a lane-wise layout (i.e., all the x-components are contiguous, then all the 
+ * y-components and so on), so that the position updates of all the rays can be 
+ * vectorised. The components of unused lanes are set to zero.
+ */
+class RayPacket {
+    public: 
+
+        /**
+         * @brief Construct a new empty Ray Packet object.
+         */
+        RayPacket();
+
+        /**
+         * @brief Return the number of rays in the packet.
+         * @return size_t Number of rays.
+         */
+        inline size_t size() const { return rays.size(); }
+
+        /**
+         * @brief Check whether the packet has no free lanes.
+         * @return true If the packet stores RAY_PACKET_SIZE rays.
+         */
+        inline bool isFull() const { return rays.size() == RAY_PACKET_SIZE; }
+
+        /**
+         * @brief Return the ray stored in a given lane.
+         * @param i Lane index.
+         * @return const Ray& Ray object.
+         */
+        inline const Ray& operator[](size_t i) const { return rays[i]; }
+
+        /**
+         * @brief Return a component of the ray origins of all the lanes.
+         * @param i Component index (0, 1 or 2).
+         * @return const double* Array of RAY_PACKET_SIZE elements.
+         */
+        inline const double* origin(size_t i) const { return o[i]; }
+
+        /**
+         * @brief Return a component of the ray directions of all the lanes.
+         * @param i Component index (0, 1 or 2).
+         * @return const double* Array of RAY_PACKET_SIZE elements.
+         */
+        inline const double* direction(size_t i) const { return d[i]; }
+
+        /**
+         * @brief Add a ray in the first free lane of the packet.
+         * @param ray Ray object.
+         * 
+         * @throws std::range_error If the packet is full.
+         */
+        void push(const Ray& ray);
+
+        /**
+         * @brief Remove all the rays from the packet.
+         */
+        void clear();
+
+    private: 
+        std::vector<Ray> rays;
+
+        double o[3][RAY_PACKET_SIZE]; 
+        double d[3][RAY_PACKET_SIZE];
+};
+
+
+/**
+ * @class PacketFrames
+ * @brief Single-precision local frames of the rays of a packet.
+ * @details Each lane expresses its ray position as a float offset from a frame origin 
+ * placed along the ray, which is moved forward once the ray travels farther than 
+ * PACKET_FRAME_EXTENT. The heights above a reference sphere are computed from the 
+ * offsets without cancellation, so that the position updates of all the lanes run on 
+ * float vectors, which hold twice as many lanes as the double ones.
+ */
+class PacketFrames {
+    public: 
+
+        /**
+         * @brief Construct a new Packet Frames object.
+         * @param radius Radius of the sphere the heights are referred to.
+         */
+        PacketFrames(double radius);
+
+        /**
+         * @brief Move the frame of a lane to a given position along its ray.
+         * 
+         * @param j Lane index.
+         * @param ray Ray object of the lane.
+         * @param t t-value of the new frame origin.
+         */
+        void reset(size_t j, const Ray& ray, double t);
+
+        /**
+         * @brief Move the frame of a lane only if its ray has travelled farther than 
+         * PACKET_FRAME_EXTENT from the frame origin.
+         * 
+         * @param j Lane index.
+         * @param ray Ray object of the lane.
+         * @param t Current t-value of the ray.
+         */
+        inline void follow(size_t j, const Ray& ray, double t) {
+            if (std::fabs(t - ta[j]) > PACKET_FRAME_EXTENT) {
+                reset(j, ray, t);
+            }
+        }
+
+        /**
+         * @brief Compute the local positions and the heights of all the lanes.
+         * @param t t-values of the lanes (RAY_PACKET_SIZE elements).
+         */
+        void update(const double* t);
+
+        /**
+         * @brief Return the height of a lane above the reference sphere, as computed by 
+         * the last update.
+         * @param j Lane index.
+         */
+        inline float height(size_t j) const { return h[j]; }
+
+        /**
+         * @brief Return the position of a lane, as computed by the last update.
+         * @param j Lane index.
+         */
+        inline point3 position(size_t j) const {
+            return point3(cx[j] + qx[j], cy[j] + qy[j], cz[j] + qz[j]);
+        }
+
+    private: 
+
+        double radius;
+
+        // Frame origins and their t-values
+        double cx[RAY_PACKET_SIZE], cy[RAY_PACKET_SIZE], cz[RAY_PACKET_SIZE];
+        double ta[RAY_PACKET_SIZE];
+
+        // Unit vectors towards the frame origins and ray directions
+        float ux[RAY_PACKET_SIZE], uy[RAY_PACKET_SIZE], uz[RAY_PACKET_SIZE];
+        float dx[RAY_PACKET_SIZE], dy[RAY_PACKET_SIZE], dz[RAY_PACKET_SIZE];
+
+        // Frame origin radii and heights above the reference sphere
+        float rc[RAY_PACKET_SIZE], hc[RAY_PACKET_SIZE];
+
+        // Local positions and heights
+        float qx[RAY_PACKET_SIZE], qy[RAY_PACKET_SIZE], qz[RAY_PACKET_SIZE];
+        float h[RAY_PACKET_SIZE];
+};
+
 #endif 
\ No newline at end of file
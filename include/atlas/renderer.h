@@ -9,9 +9,14 @@
 #include "types.h"
 #include "world.h"
 
-#include <mutex>
+#include <atomic>
+#include <memory>
 #include <vector>
 
+/* Minimum number of pixels rendered by a single task, batches are split until this size. 
+ * The batches of the adaptive tracing pass are never split. */
+#define RENDER_TASK_GRAIN (32)
+
 enum class RenderingStatus {
     WAITING,
     INITIALISED, 
@@ -34,10 +39,10 @@ class Renderer {
             opts = options;
         } 
 
-        void importRenderedData(const std::vector<RenderedPixel>& pixels); 
+        void importRenderedData(RenderBuffer&& buffer); 
 
-        inline const std::vector<RenderedPixel>* getRenderedPixels() const {
-            return &renderedPixels;
+        inline const RenderBuffer* getRenderBuffer() const {
+            return &renderBuffer;
         }
         
     private: 
@@ -47,11 +52,9 @@ class Renderer {
 
         RenderingStatus status;
 
-        // Mutex to synchronise access to shared data.
-        std::mutex renderMutex; 
-
-        // List storing the output of each render task
-        std::vector<RenderedPixel> renderedPixels; 
+        /* Buffer storing the rendered samples by pixel ID. It is allocated before the 
+         * rendering starts, so that each task writes its pixels directly in their slots. */
+        RenderBuffer renderBuffer; 
 
         // Temporary queue to store the pixels that will be dispatch to the render
         std::vector<TaskedPixel> taskQueue;
@@ -68,22 +71,43 @@ class Renderer {
         // Keep track of the total number of pixels to render
         ui32_t nPixels;
 
-        // This function stores the output of each render task in the original class
-        void saveRenderTaskOutput(const std::vector<RenderedPixel> &pixels); 
- 
         // This function renders a batch of pixels
         void renderTask(
             const ThreadWorker&, const Camera* cam, World& w, 
-            const std::vector<TaskedPixel>& pixels
+            const TaskedPixel* pixels, size_t n
+        );
+
+        // This function renders a batch of pixels tracing packets of coherent rays
+        void renderPacketTask(
+            const ThreadWorker&, const Camera* cam, World& w, 
+            const TaskedPixel* pixels, size_t n
         );
 
         // Add a rendering task to the thread pool
         void dispatchTaskQueue(
-            const std::vector<TaskedPixel>& task, const Camera* cam, World& w
+            std::vector<TaskedPixel>&& task, const Camera* cam, World& w
         );
 
-        // Add a pixel to the task queue and dispatch it when batch-size is reached.
-        inline void updateTaskQueue(const TaskedPixel& tp) { taskQueue.push_back(tp); } 
+        /* Batch of pixels dispatched to the pool. The tasks it is split into only store a 
+         * raw pointer to it, and the last one to complete releases it. */
+        struct RenderBatch {
+            RenderBatch(std::vector<TaskedPixel>&& p) : pixels(std::move(p)) {}
+            std::vector<TaskedPixel> pixels; 
+            std::atomic<size_t> nTasks{1};
+        };
+
+        // Add a task rendering the pixels in [i0, i1) of a batch, split down to the grain
+        void dispatchTaskRange(
+            RenderBatch* batch, size_t i0, size_t i1, size_t grain, const Camera* cam, 
+            World& w
+        );
+
+        /* Add a pixel to the task queue and dispatch it when batch-size is reached. The 
+         * pixel samples are allocated in the render buffer before it is dispatched. */
+        inline void updateTaskQueue(const TaskedPixel& tp) { 
+            renderBuffer.allocatePixel(tp.id, tp.nSamples, tp.dt);
+            taskQueue.push_back(tp); 
+        } 
         void updateTaskQueue(const TaskedPixel& tp, const Camera* cam, World& w); 
 
         // Add the task to the thread pool and clear the vector 
@@ -94,6 +118,17 @@ class Renderer {
 
         double initializeGrids(const Camera* cam, World& w);
 
+        // Create a tasked pixel with the ray resolution and radius bounds of its grid
+        TaskedPixel createGridPixel(
+            const ScreenGrid& grid, ui32_t id, ui32_t u, ui32_t v
+        ) const;
+
+        /* Bound the t-values of a ray with the radii of the surface seen by its pixel. 
+         * Returns false if the ray can't hit such surface. */
+        bool boundRayInterval(
+            const Ray& ray, const TaskedPixel& tp, double& tMin, double& tMax
+        ) const;
+
         void generateBasicRenderTasks(const ScreenGrid& grid, const Camera* cam, World& w);
         void generateRowAdaptiveRenderTasks(
             const ScreenGrid& grid, const Camera* cam, World& w
@@ -116,10 +151,6 @@ class Renderer {
         void setupRenderer(const Camera* cam, World& w); 
         void postProcessRender(const Camera* cam, World& w);  
 
-        // This function post-processes the outputs of all tasks to generated an 
-        // orderered list of pixels.
-        void sortRenderOutput(); 
-
         // Retrieve the min\max t-values of each pixel depending on its boundaries
         void computePixelBoundaries(const Camera* cam, ui32_t s);
 
@@ -14,6 +14,13 @@ enum class LogLevel {
     DETAILED
 } ;
 
+enum class MarchingMode {
+    FIXED, 
+    CONE, 
+    DDA, 
+    LIPSCHITZ
+};
+
 class SSAAOptions {
 
     public: 
@@ -41,6 +48,9 @@ class RenderingOptions {
 
         bool adaptiveTracing = true;
 
+        // Trace packets of coherent rays together, sharing their DEM queries
+        bool packetTracing = false;
+
 
 };
 
@@ -62,9 +72,48 @@ class WorldOptions {
 
         ui16_t rasterUsageThreshold = 2;
 
+        /* Maximum memory, in bytes, used by the loaded rasters. When set, the least 
+         * recently used rasters are unloaded to fit within the budget and the usage 
+         * threshold is ignored. 0 disables the budget. */
+        size_t rasterMemoryBudget = 0;
+
+        /* Number of background threads loading the rasters seen by upcoming camera poses. 
+         * 0 disables the prefetching. */
+        ui32_t prefetchThreads = 0;
+
         float minRes = 1;
         float maxRes = 100;
 
+        bool emptySpaceSkipping = true;
+
+        MarchingMode marchingMode = MarchingMode::FIXED;
+
+        bool coverageCulling = true;
+
+        /* March the ray packets in single precision, within local frames along each ray. 
+         * The impact points are still refined in double precision. */
+        bool mixedPrecision = false;
+
+        bool rayDifferentials = false;
+
+        bool tileCache = false;
+
+        /* Maximum error, in pixels, of the lattices interpolating the projections of the 
+         * rasters without a native one. 0 disables the lattices. */
+        double latticeTolerance = 0.0;
+
+        /* Reduction used to build the raster overview levels, which are sampled when the 
+         * raster pixels are finer than the ray resolution. NONE samples the pixels. */
+        OverviewReduction overviewReduction = OverviewReduction::NONE;
+
+        /* Index file storing the metadata of the DEM and DOM rasters, which are opened 
+         * only when their data is loaded once indexed. An empty path disables the index. */
+        std::string rasterIndex = "";
+
+        /* Directory storing the cone-step map and tile cache files of the rasters. An empty 
+         * path stores them next to the raster files. */
+        std::string cacheDirectory = "";
+
 };
 
 class RayTracerOptions {
@@ -0,0 +1,146 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include "ray.h"
+#include "vec3.h"
+
+#include <vector>
+
+/**
+ * @brief Ray parameter interval [t0, t1].
+ */
+struct Interval {
+    double t0;
+    double t1;
+};
+
+/**
+ * @brief Sort a set of intervals and merge the overlapping ones.
+ * @param intervals Intervals to be merged. On output, the disjoint intervals sorted by
+ * increasing t-values.
+ */
+void mergeIntervals(std::vector<Interval>& intervals);
+
+/**
+ * @brief Geographic region, whose longitude range is split in two when it crosses the
+ * antimeridian.
+ */
+struct GeoRegion {
+    size_t n = 0;       // Number of longitude ranges
+    double lon[2][2];   // Longitude limits of each range, in degrees
+    double lat[2];      // Latitude limits, in degrees
+};
+
+/**
+ * @brief Bound the radial projection of a segment on the sphere.
+ * @details The segment projects onto a great circle arc, whose limits are enlarged by an
+ * angular margin. The whole longitude range is returned if the enlarged arc reaches a
+ * pole.
+ *
+ * @param p0 Segment start.
+ * @param p1 Segment end.
+ * @param margin Angular margin, in radians.
+ * @return GeoRegion Region containing the projected segment.
+ */
+GeoRegion getArcRegion(const point3& p0, const point3& p1, double margin = 0.0);
+
+/**
+ * @brief Bound a spherical cap.
+ *
+ * @param axis Unit vector towards the cap centre.
+ * @param angle Cap half-angle, in radians.
+ * @return GeoRegion Region containing the cap.
+ */
+GeoRegion getCapRegion(const vec3& axis, double angle);
+
+/**
+ * @brief Bound the radial projection of the portion of a cone of rays that lies within 
+ * a radial shell.
+ * @details Each ray is bounded from its entry in the outer sphere until it either enters 
+ * the inner sphere or it leaves the outer one. The whole sphere is returned if the apex 
+ * is within the outer sphere.
+ *
+ * @param apex Cone apex (i.e., the origin of all the rays).
+ * @param dir Unit vector along the cone axis.
+ * @param angle Cone half-angle, in radians.
+ * @param rMin Inner shell radius.
+ * @param rMax Outer shell radius.
+ * @param margin Angular margin, in radians.
+ * @return GeoRegion Region containing the projected rays.
+ */
+GeoRegion getConeRegion(
+    const point3& apex, const vec3& dir, double angle, double rMin, double rMax, 
+    double margin = 0.0
+);
+
+/**
+ * @class SphericalVolume
+ * @brief Conservative bounding volume of a geographic region between two radii.
+ * @details The volume is the intersection between a radial shell and the cone whose apex
+ * is the body centre and which contains the spherical cap enclosing the region limits.
+ */
+class SphericalVolume {
+
+    public:
+
+        /**
+         * @brief Construct a new empty Spherical Volume object.
+         */
+        SphericalVolume();
+
+        /**
+         * @brief Construct a new Spherical Volume object.
+         * @details If the region spans more than a hemisphere in longitude, only the
+         * radial shell bounds the volume.
+         *
+         * @param lonBounds Longitude limits, in degrees.
+         * @param latBounds Latitude limits, in degrees.
+         * @param rMin Inner shell radius.
+         * @param rMax Outer shell radius.
+         * @param margin Angular margin added to the cap, in radians.
+         */
+        SphericalVolume(
+            const double* lonBounds, const double* latBounds, double rMin, double rMax,
+            double margin = 0.0
+        );
+
+        inline double minRadius() const { return rMin; }
+        inline double maxRadius() const { return rMax; }
+
+        /**
+         * @brief Compute the t-intervals in which a ray is within the volume.
+         *
+         * @param ray Ray object.
+         * @param out Vector to which the (at most two) sorted intervals are appended.
+         * @return size_t Number of intervals found.
+         */
+        size_t intersect(const Ray& ray, std::vector<Interval>& out) const;
+
+        /**
+         * @brief Check whether a cone of rays may intersect the volume.
+         * @details The test is conservative, i.e., it is performed against the bounding 
+         * sphere of the volume. 
+         *
+         * @param apex Cone apex (i.e., the origin of all the rays).
+         * @param dir Unit vector along the cone axis.
+         * @param angle Cone half-angle, in radians.
+         * @return true If any ray of the cone may cross the volume.
+         */
+        bool intersectCone(const point3& apex, const vec3& dir, double angle) const;
+
+    private:
+
+        double rMin, rMax;
+
+        vec3 axis;      // Unit vector towards the cap centre
+        double cosCap;  // Cosine of the cap half-angle (-1 if the cone is unbounded)
+
+        point3 center;  // Centre of the bounding sphere 
+        double radius;  // Radius of the bounding sphere
+
+        // Compute the t-interval within the cap cone, returns false if it is not crossed
+        bool intersectCap(const Ray& ray, double& t0, double& t1) const;
+
+};
+
+#endif
@@ -1,18 +1,24 @@
 #ifndef WORLD_H 
 #define WORLD_H 
 
+#include "cache.h"
 #include "camera.h"
 #include "dem.h"
 #include "dom.h"
 #include "grid.h"
 #include "pixel.h"
+#include "pool.h"
 #include "ray.h"
 #include "settings.h"
 #include "types.h"
 
+#include <memory>
 #include <vector>
 #include <string>
 
+// Rays sampled along each image axis to estimate the ground footprint of a camera pose
+#define PREFETCH_GRID_SIZE (9)
+
 
 class World {
 
@@ -28,13 +34,42 @@ class World {
             const Ray& r, double dt, double tMin, double tMax, ui32_t threadid, 
             double maxErr = -1.0
     ); 
+
+        /**
+         * @brief Trace a packet of rays at once.
+         * @details The rays are marched together and, at each step, the DEM samples of 
+         * all the active rays are retrieved with a single batched query. Rays that have 
+         * already terminated are masked out. Only the ray positions and radii are computed 
+         * in branch-free lane loops, whereas the spherical conversions, the marching steps 
+         * and the impact searches are evaluated one lane at a time, thus the gain mainly 
+         * comes from the batched queries. The output of each ray is identical to the one 
+         * of `traceRay`, unless the mixed-precision marching is enabled, in which case the 
+         * lane loops run in float within local frames along each ray.
+         * 
+         * @param packet Packet of rays.
+         * @param dt Ray resolution of each ray. When the ray differentials are enabled, 
+         * this is the minimum resolution, which grows with the ray footprint.
+         * @param tMin Minimum t-value of each ray. If 0, it is ignored.
+         * @param tMax Maximum t-value of each ray. If 0, it is ignored.
+         * @param data Output pixel data of each ray.
+         * @param threadid Thread ID.
+         * @param maxErr Maximum impact localisation error. 
+         */
+        void traceRayPacket(
+            const RayPacket& packet, const double* dt, const double* tMin, 
+            const double* tMax, PixelData* data, ui32_t threadid, double maxErr = -1.0
+        );
         
         inline double sampleDEM(const point2& p, double dt) { 
-            return dem.getData(p, dt, 0);
+            double h = dem.getData(p, dt, 0);
+            dem.releaseRasters(0);
+            return h;
         }; 
 
         inline double sampleDOM(const point2& p, double dt) { 
-            return dom.getColor(p, dt, 0); 
+            double c = dom.getColor(p, dt, 0); 
+            dom.releaseRasters(0);
+            return c;
         };
 
         // DEM interface functions
@@ -48,6 +83,9 @@ class World {
         // Compute the distance at which points are evaluated along a ray
         void computeRayResolution(ScreenGrid& grid, const Camera* cam);
 
+        // Compute the radii bounding the DEM surface seen by the rays of a grid
+        void computeRadiusBounds(ScreenGrid& grid, const Camera* cam);
+
         // Removes both DEM and DOM unused files
         void cleanup(); 
         // Unloads unused DEM files to reduce memory consumption.
@@ -55,6 +93,30 @@ class World {
         // Unloads unused DOM files to reduce memory consumption.
         inline void cleanupDOM() { dom.cleanupRasters(opts.rasterUsageThreshold); }
 
+        /* Return the cache bounding the memory used by the DEM and DOM rasters, or a null 
+         * pointer if no memory budget is set. */
+        inline RasterCache* getRasterCache() { return cache.get(); }
+
+        /**
+         * @brief Load, in the background, the DEM and DOM rasters seen by a camera from an 
+         * upcoming pose.
+         * @details The ground footprint is estimated from a grid of rays, generated with 
+         * the current camera pose and moved to the upcoming one, which are intersected with 
+         * the spheres bounding the DEM surface. The rasters overlapping the footprint, and 
+         * their data blocks within it, are then loaded at the expected ray resolution. 
+         * Nothing is done if the prefetching is disabled.
+         *
+         * @param cam Camera object.
+         * @param pos Upcoming camera position.
+         * @param orientation Upcoming camera orientation.
+         */
+        void prefetch(const Camera* cam, const point3& pos, const dcm& orientation);
+
+        inline bool isPrefetchingEnabled() const { return prefetchPool != nullptr; }
+
+        // Wait for the completion of all the queued prefetching requests
+        void waitPrefetching();
+
         // Update the minimum / maximum rendering resolutions
         inline void setMinRayResolution(double res) { opts.minRes = res; }
         inline void setMaxRayResolution(double res) { opts.maxRes = res; }
@@ -65,18 +127,84 @@ class World {
 
     private: 
     
+        // Shared raster cache, which must outlive both the DEM and the DOM
+        std::unique_ptr<RasterCache> cache;
+
         DEM dem;
         DOM dom;
 
         WorldOptions opts;
-        
-        // True if DEM data should be interpolated because of resolution limitations.
-        bool interp = false;
+
+        // Per-thread buffers storing the marching t-intervals of each packet lane
+        std::vector<std::vector<Interval>> rayIntervals;
+
+        ui32_t nThreads;
+
+        /* Background threads loading the rasters of upcoming poses. Since their 
+         * transformations follow those of the rendering threads, they are stopped 
+         * before the rasters are destroyed. */
+        std::unique_ptr<ThreadPool> prefetchPool;
+
+        // Load the rasters seen by a grid of rays at the expected resolution
+        void prefetchRays(const std::vector<Ray>& rays, double pixAngle, double minRes, 
+            double maxRes, ui32_t threadid);
 
         double computeGSD(ScreenGrid& grid, const Camera* cam); 
+
+        // Compute the t-values bounding the marching of a ray
+        bool getMarchingInterval(
+            const Ray& ray, double tMin, double tMax, double& tk, double& tEnd
+        ) const;
+
+        /* Compute the disjoint t-intervals in which a ray can hit the surface. Returns 
+         * false if there are none. */
+        bool getMarchingIntervals(
+            const Ray& ray, double tMin, double tMax, std::vector<Interval>& intervals
+        ) const;
+
+        /* Advance the ray by a step, moving it to the interval containing its next 
+         * sample. The last sample of each interval is placed at its end. The interval 
+         * index is set to the number of intervals once the ray has left all of them. */
+        void advanceRay(
+            const std::vector<Interval>& intervals, size_t& i, double& tk, double& dtk, 
+            RasterSample& prev, double dt
+        ) const;
+
+        /* Compute the ray resolution at a given t-value, i.e., the minimum step and the 
+         * DEM resolution. With the ray differentials, this is half the ray footprint, 
+         * bounded by the grid resolution and by the maximum one. */
+        double getRayResolution(const Ray& ray, double t, double dt) const;
+
+        // Compute the next step of a ray which is above the surface
+        double getMarchingStep(
+            const Ray& ray, const point3& pos, double r, const RasterSample& smp, double dt, 
+            ui32_t threadid
+        );
+
+        /* Compute the distance a ray travels before leaving the DEM cell of a sample. The 
+         * previous sample (dtk meters before) is used to estimate the ray direction. */
+        double getCellStep(
+            const Ray& ray, const point3& pos, double r, const RasterSample& smp, 
+            const RasterSample& prev, double dtk, double dt
+        ) const;
+
+        // Intersect a ray segment with the surface of the DEM cell of a sample
+        SegmentHit intersectCell(
+            PixelData& data, const Ray& ray, const RasterSample& smp, double t0, double t1, 
+            ui32_t threadid
+        );
+
+        // Intersect a ray segment with the bilinear surface of the raster of a sample
+        SegmentHit intersectSurface(
+            PixelData& data, const Ray& ray, const RasterSample& smp, double t0, double t1, 
+            ui32_t threadid
+        );
+
+        /* Refine the impact location of a ray within [t0, t1], sampling the DEM at the 
+         * resolution res of the footprint where the impact was detected. */
         void findImpactLocation(
-            PixelData& data, const Ray& ray, double dt, double tk, ui32_t threadid,
-            double maxErr = -1.0
+            PixelData& data, const Ray& ray, const RasterSample& smp, double res, 
+            double t0, double t1, ui32_t threadid, double maxErr = -1.0
         );
 
 };
@@ -57,6 +57,7 @@ void init_atlas(py::module_ &m) {
         .def("updateCamera", &RayTracer::updateCamera)
         .def("updateCameraPosition", &RayTracer::updateCameraPosition)
         .def("updateCameraOrientation", &RayTracer::updateCameraOrientation)
+        .def("addUpcomingCameraPose", &RayTracer::addUpcomingCameraPose)
 
         .def("createImageOptical", [](RayTracer& self, int type) -> py::array {
             
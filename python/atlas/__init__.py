@@ -3,6 +3,8 @@
 from ._atlas import PinholeCamera, RealCamera         # type: ignore
 from ._atlas import RayTracer                    # type: ignore
 from ._atlas import LogLevel                          # type: ignore
+from ._atlas import MarchingMode                      # type: ignore
+from ._atlas import OverviewReduction                 # type: ignore
 
 import os
 import glob 
@@ -36,6 +38,9 @@ def RayTracerOptions(filename: str):
         
         if 'adaptive-tracing' in cfg_renderer.keys(): 
             opts.optsRenderer.adaptiveTracing = cfg_renderer['adaptive-tracing']
+
+        if 'packet-tracing' in cfg_renderer.keys(): 
+            opts.optsRenderer.packetTracing = cfg_renderer['packet-tracing']
             
         # Retrieve Antialiasing (SSAA) options
         if 'ssaa' in cfg_renderer.keys():
@@ -85,9 +90,45 @@ def RayTracerOptions(filename: str):
         
         if 'raster-usage-threshold' in cfg_world.keys(): 
             opts.optsWorld.rasterUsageThreshold = cfg_world['raster-usage-threshold']
+
+        if 'raster-memory-budget' in cfg_world.keys(): 
+            opts.optsWorld.rasterMemoryBudget = int(cfg_world['raster-memory-budget'])
+
+        if 'prefetch-threads' in cfg_world.keys(): 
+            opts.optsWorld.prefetchThreads = int(cfg_world['prefetch-threads'])
         
         if 'min-resolution' in cfg_world.keys(): 
             opts.optsWorld.minRes = float(cfg_world['min-resolution'])
+
+        if 'empty-space-skipping' in cfg_world.keys(): 
+            opts.optsWorld.emptySpaceSkipping = bool(cfg_world['empty-space-skipping'])
+
+        if 'marching-mode' in cfg_world.keys(): 
+            opts.optsWorld.marchingMode = MarchingMode(cfg_world['marching-mode'])
+
+        if 'coverage-culling' in cfg_world.keys(): 
+            opts.optsWorld.coverageCulling = bool(cfg_world['coverage-culling'])
+
+        if 'ray-differentials' in cfg_world.keys(): 
+            opts.optsWorld.rayDifferentials = bool(cfg_world['ray-differentials'])
+
+        if 'tile-cache' in cfg_world.keys(): 
+            opts.optsWorld.tileCache = bool(cfg_world['tile-cache'])
+
+        if 'lattice-tolerance' in cfg_world.keys(): 
+            opts.optsWorld.latticeTolerance = float(cfg_world['lattice-tolerance'])
+
+        if 'overview-reduction' in cfg_world.keys(): 
+            opts.optsWorld.overviewReduction = OverviewReduction(cfg_world['overview-reduction'])
+
+        if 'raster-index' in cfg_world.keys(): 
+            opts.optsWorld.rasterIndex = str(cfg_world['raster-index'])
+
+        if 'cache-directory' in cfg_world.keys(): 
+            opts.optsWorld.cacheDirectory = str(cfg_world['cache-directory'])
+
+        if 'mixed-precision' in cfg_world.keys(): 
+            opts.optsWorld.mixedPrecision = bool(cfg_world['mixed-precision'])
     
     return opts 
     
\ No newline at end of file
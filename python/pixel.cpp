@@ -19,24 +19,34 @@ void init_pixel(py::module_ &m) {
 
     py::class_<RenderedPixel>(m, "RenderedPixel") 
 
-        .def(
-            py::init<ui32_t, size_t, double>(), 
-            py::arg("id"), py::arg("nSamples"), py::arg("dt")
-        )
+        .def_readonly("id", &RenderedPixel::id)
+        .def_readonly("nSamples", &RenderedPixel::nSamples)
 
-        .def_readwrite("id", &RenderedPixel::id)
-        .def_readwrite("nSamples", &RenderedPixel::nSamples)
-        .def_readwrite("data", &RenderedPixel::data)
-
-        .def("updateSamples", &RenderedPixel::updateSamples)
-        .def("addPixelData", &RenderedPixel::addPixelData)
+        .def("data", &RenderedPixel::data, py::arg("k"))
 
         .def("pixResolution", &RenderedPixel::pixResolution)
 
         .def("pixDistance", &RenderedPixel::pixDistance)
-        .def("pixMeanDistance", &RenderedPixel::pixMinDistance)
+        .def("pixMeanDistance", &RenderedPixel::pixMeanDistance)
 
         .def("pixMinDistance", &RenderedPixel::pixMinDistance)
         .def("pixMaxDistance", &RenderedPixel::pixMaxDistance);
 
+    py::class_<RenderBuffer>(m, "RenderBuffer") 
+
+        .def(py::init<ui32_t>(), py::arg("nPixels") = 0)
+
+        .def("nPixels", &RenderBuffer::nPixels)
+        .def("pixSamples", &RenderBuffer::pixSamples, py::arg("id"))
+        .def("pixOffset", &RenderBuffer::pixOffset, py::arg("id"))
+        .def("pixResolution", &RenderBuffer::pixResolution, py::arg("id"))
+
+        .def("pixel", &RenderBuffer::pixel, py::arg("id"), py::keep_alive<0, 1>())
+        .def("getSample", &RenderBuffer::getSample, py::arg("id"), py::arg("k"))
+
+        .def("allocatePixel", &RenderBuffer::allocatePixel, 
+            py::arg("id"), py::arg("n"), py::arg("dt"))
+        .def("setSample", &RenderBuffer::setSample, 
+            py::arg("id"), py::arg("k"), py::arg("data"));
+
 }
\ No newline at end of file
@@ -49,6 +49,26 @@ void init_raster(py::module_ &m) {
         // .def_readwrite("lat_bounds", &RasterDescriptor::lat_bounds);
 
 
+    py::class_<RasterCache>(m, "RasterCache")
+
+        .def("budget", &RasterCache::budget)
+        .def("setBudget", &RasterCache::setBudget)
+        .def("usage", &RasterCache::usage)
+        .def("enforce", &RasterCache::enforce)
+
+        .def("nEntries", &RasterCache::nEntries)
+        .def("nHits", &RasterCache::nHits)
+        .def("nMisses", &RasterCache::nMisses)
+        .def("nEvictions", &RasterCache::nEvictions)
+        .def("resetStatistics", &RasterCache::resetStatistics);
+
+    py::enum_<RasterStorage>(m, "RasterStorage")
+        .value("FLOAT32", RasterStorage::FLOAT32)
+        .value("UINT8", RasterStorage::UINT8)
+        .value("INT16", RasterStorage::INT16)
+        .value("UINT16", RasterStorage::UINT16)
+        .value("QUANT16", RasterStorage::QUANT16);
+
     py::class_<RasterBand>(m, "RasterBand")
 
         .def(py::init<RasterDescriptor, std::shared_ptr<GDALDataset>, int>())
@@ -58,8 +78,16 @@ void init_raster(py::module_ &m) {
         .def("offset", &RasterBand::offset)
         .def("scale", &RasterBand::scale)
         .def("noDataVal", &RasterBand::noDataVal)
+        .def("storage", &RasterBand::storage)
         .def("loadData", &RasterBand::loadData)
         .def("unloadData", &RasterBand::unloadData)
+        .def("loadBlocks", &RasterBand::loadBlocks)
+        .def("isLoaded", &RasterBand::isLoaded)
+        .def("nLoadedBlocks", &RasterBand::nLoadedBlocks)
+        .def("memoryUsage", &RasterBand::memoryUsage)
+        .def("setOverviewReduction", &RasterBand::setOverviewReduction)
+        .def("nOverviewLevels", &RasterBand::nOverviewLevels)
+        .def("getOverviewData", &RasterBand::getOverviewData)
 
         .def("getData", [](RasterBand& b, ui16_t i) {
             return b.getData(i);
@@ -74,6 +102,8 @@ void init_raster(py::module_ &m) {
         .def(py::init<RasterDescriptor, size_t>(), py::arg("file"), py::arg("nThreads") = 1)
 
         .def("getFileName", &RasterFile::getFileName)
+        .def("open", &RasterFile::open)
+        .def("isOpen", &RasterFile::isOpen)
 
         .def("width", &RasterFile::width)
         .def("height", &RasterFile::height)
@@ -90,6 +120,9 @@ void init_raster(py::module_ &m) {
 
         .def("getAffine", &RasterFile::getAffine)
         .def("getInvAffine", &RasterFile::getInvAffine)
+        .def("hasNativeProjection", &RasterFile::hasNativeProjection)
+        .def("setProjectionLattice", &RasterFile::setProjectionLattice)
+        .def("hasProjectionLattice", &RasterFile::hasProjectionLattice)
 
         .def("getLongitudeBounds", [](RasterFile& rf){
             std::array<double, 2> bounds;
@@ -111,6 +144,14 @@ void init_raster(py::module_ &m) {
         .def("unloadBand", &RasterFile::unloadBand)
         .def("unloadBands", &RasterFile::unloadBands)
 
+        .def("memoryUsage", &RasterFile::memoryUsage)
+
+        .def("loadConeMap", &RasterFile::loadConeMap, py::arg("i"))
+        .def("hasConeMapCache", &RasterFile::hasConeMapCache, py::arg("i"))
+        .def("setCacheDirectory", [](RasterFile& r, const std::string& dir) { 
+            r.setCacheDirectory(dir); 
+        })
+
         .def("getBandNoDataValue", &RasterFile::getBandNoDataValue)
         .def("getBandData", &RasterFile::getBandData)
 
@@ -122,26 +163,43 @@ void init_raster(py::module_ &m) {
         .def("sph2map", &RasterFile::sph2map)
         .def("map2sph", &RasterFile::map2sph)
 
-        .def("sph2pix", &RasterFile::sph2pix)
+        .def("sph2pix", py::overload_cast<const point2&, ui32_t>(
+            &RasterFile::sph2pix, py::const_
+        ))
         .def("pix2sph", &RasterFile::pix2sph);
 
 
+    py::enum_<RasterLoadState>(m, "RasterLoadState")
+        .value("UNLOADED", RasterLoadState::UNLOADED)
+        .value("LOADING", RasterLoadState::LOADING)
+        .value("READY", RasterLoadState::READY);
+
     py::class_<RasterContainer>(m, "RasterContainer")
 
         .def(py::init<double, size_t>(), py::arg("res"), py::arg("nThreads") = 1)
 
         .def("nRasters", &RasterContainer::nRasters)
         .def("getResolution", &RasterContainer::getResolution)
-        .def("getData", &RasterContainer::getData)
+        .def("getData", py::overload_cast<const point2&, bool, ui32_t>(
+            &RasterContainer::getData
+        ))
 
         .def("getRasterFile", &RasterContainer::getRasterFile, 
             py::return_value_policy::reference)
 
         .def("loadRaster", &RasterContainer::loadRaster)
         .def("unloadRaster", &RasterContainer::unloadRaster)
+        .def("getRasterState", &RasterContainer::getRasterState)
+
+        .def("releaseRasters", &RasterContainer::releaseRasters, py::arg("threadid") = 0)
 
         .def("loadRasters", &RasterContainer::loadRasters)
         .def("unloadRasters", &RasterContainer::unloadRasters)
+
+        .def("enableConeMaps", &RasterContainer::enableConeMaps)
+        .def("buildConeMaps", &RasterContainer::buildConeMaps)
+        .def("setCacheDirectory", &RasterContainer::setCacheDirectory)
+        .def("enableBlockPreloading", &RasterContainer::enableBlockPreloading)
         
         .def("cleanupRasters", &RasterContainer::cleanupRasters); 
 
@@ -150,8 +208,9 @@ void init_raster(py::module_ &m) {
         .def(py::init<RasterDescriptor, size_t, bool>(), 
              py::arg("file"), py::arg("nThreads") = 1, py::arg("displayInfo") = false)
 
-        .def(py::init<std::vector<RasterDescriptor>, size_t, bool>(), 
-             py::arg("files"), py::arg("nThreads") = 1, py::arg("displayInfo") = false)
+        .def(py::init<std::vector<RasterDescriptor>, size_t, bool, std::string>(), 
+             py::arg("files"), py::arg("nThreads") = 1, py::arg("displayInfo") = false, 
+             py::arg("indexPath") = "")
 
         .def("nRasters", &RasterManager::nRasters)
         .def("nContainers", &RasterManager::nContainers)
@@ -160,14 +219,24 @@ void init_raster(py::module_ &m) {
         .def("getMaxResolution", &RasterManager::getMaxResolution)
         .def("getResolutions", &RasterManager::getResolutions)
 
-        .def("getData", &RasterManager::getData)
+        .def("getData", py::overload_cast<const point2&, double, ui32_t>(
+            &RasterManager::getData
+        ))
         .def("getLastResolution", &RasterManager::getLastResolution)
 
         .def("getRasterContainer", &RasterManager::getRasterContainer, 
             py::return_value_policy::reference)
 
+        .def("releaseRasters", &RasterManager::releaseRasters, py::arg("threadid") = 0)
+
         .def("loadRasters", &RasterManager::loadRasters)
         .def("unloadRasters", &RasterManager::unloadRasters)
+
+        .def("enableConeMaps", &RasterManager::enableConeMaps, py::arg("flag") = true)
+        .def("buildConeMaps", &RasterManager::buildConeMaps)
+        .def("setCacheDirectory", &RasterManager::setCacheDirectory)
+        .def("enableBlockPreloading", &RasterManager::enableBlockPreloading, 
+             py::arg("flag") = true)
         
         .def("cleanupRasters", &RasterManager::cleanupRasters); 
 
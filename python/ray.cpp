@@ -11,10 +11,13 @@ void init_ray(py::module_ &m) {
 
     py::class_<Ray>(m, "Ray")
 
-        .def(py::init<point3, vec3>(), py::arg("origin"), py::arg("direction"))
+        .def(py::init<point3, vec3, double>(), 
+            py::arg("origin"), py::arg("direction"), py::arg("spread") = 0.0)
 
         .def("origin", &Ray::origin)
         .def("direction", &Ray::direction)
+        .def("spread", &Ray::spread)
+        .def("footprint", &Ray::footprint)
 
         .def("at", &Ray::at)
         .def("minDistance", &Ray::minDistance)
@@ -15,8 +15,8 @@ void init_renderer(py::module_ &m) {
             py::arg("nThreads") = 1
         )
         
-        .def("getRenderedPixels", &Renderer::getRenderedPixels, 
-            py::return_value_policy::reference)
+        .def("getRenderBuffer", &Renderer::getRenderBuffer, 
+            py::return_value_policy::reference_internal)
 
         .def("render", &Renderer::render)
         .def("updateRenderingOptions", &Renderer::updateRenderingOptions)
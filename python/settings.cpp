@@ -14,6 +14,21 @@ void init_settings(py::module_ &m) {
         .value("DETAILED", LogLevel::DETAILED)
         .export_values();  // Optional: Exports values to the module's namespace
 
+    /* MARCHING MODE */
+    py::enum_<MarchingMode>(m, "MarchingMode")
+        .value("FIXED", MarchingMode::FIXED)
+        .value("CONE", MarchingMode::CONE)
+        .value("DDA", MarchingMode::DDA)
+        .value("LIPSCHITZ", MarchingMode::LIPSCHITZ)
+        .export_values();
+
+    /* OVERVIEW REDUCTION */
+    py::enum_<OverviewReduction>(m, "OverviewReduction")
+        .value("NONE", OverviewReduction::NONE)
+        .value("MEAN", OverviewReduction::MEAN)
+        .value("MIN", OverviewReduction::MIN)
+        .value("MAX", OverviewReduction::MAX);
+
     /* SSAA OPTIONS */
     py::class_<SSAAOptions>(m, "SSAAOptions")
         .def(py::init<>())
@@ -33,7 +48,8 @@ void init_settings(py::module_ &m) {
         .def_readwrite("gridWidth", &RenderingOptions::gridWidth)
         .def_readwrite("gridHeight", &RenderingOptions::gridHeight)
         .def_readwrite("logLevel", &RenderingOptions::logLevel)
-        .def_readwrite("adaptiveTracing", &RenderingOptions::adaptiveTracing);
+        .def_readwrite("adaptiveTracing", &RenderingOptions::adaptiveTracing)
+        .def_readwrite("packetTracing", &RenderingOptions::packetTracing);
 
     /* WORLD OPTIONS */
     py::class_<WorldOptions>(m, "WorldOptions")
@@ -60,8 +76,20 @@ void init_settings(py::module_ &m) {
         .def_readwrite("domFiles", &WorldOptions::domFiles)
         .def_readwrite("logLevel", &WorldOptions::logLevel)
         .def_readwrite("rasterUsageThreshold", &WorldOptions::rasterUsageThreshold)
+        .def_readwrite("rasterMemoryBudget", &WorldOptions::rasterMemoryBudget)
+        .def_readwrite("prefetchThreads", &WorldOptions::prefetchThreads)
         .def_readwrite("minRes", &WorldOptions::minRes)
-        .def_readwrite("maxRes", &WorldOptions::maxRes);
+        .def_readwrite("maxRes", &WorldOptions::maxRes)
+        .def_readwrite("emptySpaceSkipping", &WorldOptions::emptySpaceSkipping)
+        .def_readwrite("marchingMode", &WorldOptions::marchingMode)
+        .def_readwrite("coverageCulling", &WorldOptions::coverageCulling)
+        .def_readwrite("rayDifferentials", &WorldOptions::rayDifferentials)
+        .def_readwrite("tileCache", &WorldOptions::tileCache)
+        .def_readwrite("latticeTolerance", &WorldOptions::latticeTolerance)
+        .def_readwrite("overviewReduction", &WorldOptions::overviewReduction)
+        .def_readwrite("rasterIndex", &WorldOptions::rasterIndex)
+        .def_readwrite("cacheDirectory", &WorldOptions::cacheDirectory)
+        .def_readwrite("mixedPrecision", &WorldOptions::mixedPrecision);
 
     /* RAYTRACER OPTIONS */
     py::class_<RayTracerOptions>(m, "RayTracerOptions")
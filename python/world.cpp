@@ -24,6 +24,12 @@ void init_world(py::module_ &m) {
         .def("cleanup", &World::cleanup)
         .def("cleanupDEM", &World::cleanupDEM)
         .def("cleanupDOM", &World::cleanupDOM)
+
+        .def("getRasterCache", &World::getRasterCache, py::return_value_policy::reference_internal)
+
+        .def("prefetch", &World::prefetch)
+        .def("waitPrefetching", &World::waitPrefetching)
+        .def("isPrefetchingEnabled", &World::isPrefetchingEnabled)
         
         .def("computeRayResolution", &World::computeRayResolution)
 
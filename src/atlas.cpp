@@ -44,9 +44,37 @@ void RayTracer::run() {
 
     // Ray trace all the pixels in the camera
     renderer.render(cam, world);    
+
+    if (!world.isPrefetchingEnabled()) {
+        return;
+    }
+
+    lastPos[0] = lastPos[1]; lastPos[1] = cam->getPos();
+    lastDCM[0] = lastDCM[1]; lastDCM[1] = cam->getDCM();
+    nRenderedPoses++;
+
+    /* Without any registered pose, the next one is extrapolated assuming the camera 
+     * keeps its last linear and angular velocities. */
+    if (!upcomingPoses && nRenderedPoses > 1) {
+        world.prefetch(
+            cam, 2.0*lastPos[1] - lastPos[0], 
+            lastDCM[1]*lastDCM[0].transpose()*lastDCM[1]
+        );
+    }
+
+    upcomingPoses = false;
     
 }
 
+void RayTracer::addUpcomingCameraPose(const point3& pos, const dcm& dcm) {
+
+    checkCamPointer();
+
+    world.prefetch(cam, pos, dcm);
+    upcomingPoses = true;
+
+}
+
 
 // Settings Retrieval
 double RayTracer::getAltitude(const point3& pos, const dcm& dcm, double dt, double maxErr) {
@@ -101,20 +129,15 @@ cv::Mat RayTracer::createImageOptical(int type) {
     // Check rendering status 
     checkRenderStatus();
 
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
 
     /* For the DOM I should use the minimum pixel resolution, so that I ensure the
      * lighting is consistent as much as possible across the image. So we iterate 
      * across all pixels and retrieve the minimum ray resolution. */
-    auto it = std::min_element(
-        pixels->begin(), pixels->end(),
-        [](const RenderedPixel& a, const RenderedPixel& b) {
-            return a.pixResolution() < b.pixResolution();
-        }
+    double minRayRes = *std::min_element(
+        pixels->resolutions(), pixels->resolutions() + pixels->nPixels()
     );
 
-    double minRayRes = it->pixResolution();
-
     // Create a grayscale image (8-bit single-channel)
     cv::Mat image(cam->height(), cam->width(), type, cv::Scalar(0));
 
@@ -123,20 +146,30 @@ cv::Mat RayTracer::createImageOptical(int type) {
 
     ui32_t u, v;
     uchar* pRow;
+
+    const double* t = pixels->t(); 
+    const double* lon = pixels->lon(); 
+    const double* lat = pixels->lat();
      
-    for (auto& p : *pixels) {
+    for (ui32_t id = 0; id < pixels->nPixels(); id++) {
         
         // Retrieve pixel coordinates on the image
-        cam->getPixelCoordinates(p.id, u, v); 
+        cam->getPixelCoordinates(id, u, v); 
+
+        size_t j0 = pixels->pixOffset(id);
+        size_t nk = pixels->pixSamples(id);
+        if (nk == 0) {
+            continue;
+        }
 
         c = 0.0;
-        for (size_t k = 0; k < p.nSamples; k++) {
+        for (size_t j = j0; j < j0 + nk; j++) {
 
-            if (p.data[k].t != inf) {
+            if (t[j] != inf) {
                 
                 // Retrieve sample longitude and latitudes in degrees
-                s[0] = rad2deg(p.data[k].s[1]); 
-                s[1] = rad2deg(p.data[k].s[2]); 
+                s[0] = rad2deg(lon[j]); 
+                s[1] = rad2deg(lat[j]); 
                 
                 // Sample the DOM at that location
                 c += world.sampleDOM(s, minRayRes);
@@ -144,7 +177,7 @@ cv::Mat RayTracer::createImageOptical(int type) {
         }
 
         // Average the pixel color through all the samples.
-        c /= (255*p.nSamples); 
+        c /= (255*nk); 
 
         // Update the pixel content
         updateImageContent(image, u, v, c);
@@ -164,7 +197,10 @@ cv::Mat RayTracer::createImageDEM(int type, bool normalize) {
     // Check rendering status 
     checkRenderStatus();
 
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
+
+    const double* t = pixels->t(); 
+    const double* r = pixels->radius();
 
     // Create a grayscale image (8-bit single-channel)
     cv::Mat image(cam->height(), cam->width(), type, cv::Scalar(0));
@@ -182,14 +218,16 @@ cv::Mat RayTracer::createImageDEM(int type, bool normalize) {
     if (normalize) 
     {
         // Parse all pixels to find the min and maximum distances
-        for (auto& p : *pixels) {
-            for (size_t k = 0; k < p.nSamples; k++)
+        for (ui32_t id = 0; id < pixels->nPixels(); id++) {
+
+            size_t j0 = pixels->pixOffset(id);
+            for (size_t j = j0; j < j0 + pixels->pixSamples(id); j++)
             {
-                if (p.data[k].t != inf)
+                if (t[j] != inf)
                 {
                     // If we found an intersection
-                    minR = fmin(p.data[k].s[0], minR);
-                    maxR = fmax(p.data[k].s[0], maxR);
+                    minR = fmin(r[j], minR);
+                    maxR = fmax(r[j], maxR);
                 }
             }
         }
@@ -205,22 +243,28 @@ cv::Mat RayTracer::createImageDEM(int type, bool normalize) {
 
     double dR = maxR - minR; 
 
-    for (auto& p : *pixels) {
+    for (ui32_t id = 0; id < pixels->nPixels(); id++) {
         
         // Retrieve pixel coordinates on the image
-        cam->getPixelCoordinates(p.id, u, v); 
+        cam->getPixelCoordinates(id, u, v); 
+
+        size_t j0 = pixels->pixOffset(id);
+        size_t nk = pixels->pixSamples(id);
+        if (nk == 0) {
+            continue;
+        }
 
         c = 0.0;
-        for (size_t k = 0; k < p.nSamples; k++) {
+        for (size_t j = j0; j < j0 + nk; j++) {
 
-            if (p.data[k].t != inf) {
+            if (t[j] != inf) {
                 // Retrieve point distance from center and normalise 
-                c += (p.data[k].s[0] - minR)/dR;
+                c += (r[j] - minR)/dR;
             }
         }
 
         // Average the pixel color through all the samples.
-        c /= p.nSamples;
+        c /= nk;
 
         // Update the pixel content
         updateImageContent(image, u, v, c);
@@ -239,7 +283,8 @@ cv::Mat RayTracer::createDepthMap(int type) {
     // Check rendering status 
     checkRenderStatus();
 
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
+    const double* t = pixels->t();
 
     // Create a grayscale image (8-bit single-channel)
     cv::Mat image(cam->height(), cam->width(), type, cv::Scalar(0));
@@ -248,13 +293,15 @@ cv::Mat RayTracer::createDepthMap(int type) {
     double dMin = inf; 
     double dMax = -inf; 
     
-    for (auto& p : *pixels) {
-
-        if (p.pixMaxDistance() != inf)
-            dMax = fmax(p.pixMaxDistance(), dMax); 
+    for (ui32_t id = 0; id < pixels->nPixels(); id++) {
 
-        if (p.pixMinDistance() != inf)
-            dMin = fmin(p.pixMinDistance(), dMin);  
+        size_t j0 = pixels->pixOffset(id);
+        for (size_t j = j0; j < j0 + pixels->pixSamples(id); j++) {
+            if (t[j] != inf) {
+                dMax = fmax(t[j], dMax); 
+                dMin = fmin(t[j], dMin);  
+            }
+        }
 
     }
     
@@ -270,21 +317,27 @@ cv::Mat RayTracer::createDepthMap(int type) {
     double c; 
     ui32_t u, v;
 
-    for (auto& p : *pixels) {
+    for (ui32_t id = 0; id < pixels->nPixels(); id++) {
 
         // Retrieve the pixel coordinates
-        cam->getPixelCoordinates(p.id, u, v); 
+        cam->getPixelCoordinates(id, u, v); 
+
+        size_t j0 = pixels->pixOffset(id);
+        size_t nk = pixels->pixSamples(id);
+        if (nk == 0) {
+            continue;
+        }
 
         c = 0.0;
-        for (size_t k = 0; k < p.nSamples; k++) {
-            if (p.data[k].t != inf) {
+        for (size_t j = j0; j < j0 + nk; j++) {
+            if (t[j] != inf) {
                 // Normalise and invert to have white as the closest distance.
-                c += (dMax - p.data[k].t)/dt; 
+                c += (dMax - t[j])/dt; 
             }
         }
 
         // Average the distance through all the samples
-        c /= p.nSamples;
+        c /= nk;
 
         // Update the pixel content
         updateImageContent(image, u, v, c);
@@ -302,7 +355,10 @@ cv::Mat RayTracer::createLIDARMap() {
     // Check rendering status
     checkRenderStatus();
 
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
+
+    const double* t = pixels->t(); 
+    const double* r = pixels->radius();
 
     // Create two single channel floating point images
     cv::Mat lidar(cam->height(), cam->width(), CV_64F, cv::Scalar(0));
@@ -312,17 +368,18 @@ cv::Mat RayTracer::createLIDARMap() {
     double depth, elevation;
     int i;  
 
-    for (auto& p: *pixels) {
+    for (ui32_t id = 0; id < pixels->nPixels(); id++) {
 
         // Retrieve the pixel coordinates
-        cam->getPixelCoordinates(p.id, u, v); 
+        cam->getPixelCoordinates(id, u, v); 
 
         // Compute the average pixel depth 
+        size_t j0 = pixels->pixOffset(id);
         depth = 0.0; elevation = 0.0; i = 0;
-        for (size_t k = 0; k < p.nSamples; k++) {
-            if (p.data[k].t != inf) {
-                depth += p.data[k].t;           // Update the depth distance
-                elevation += p.data[k].s[0];    // Update the elevation values
+        for (size_t j = j0; j < j0 + pixels->pixSamples(id); j++) {
+            if (t[j] != inf) {
+                depth += t[j];          // Update the depth distance
+                elevation += r[j];      // Update the elevation values
                 i += 1;
             }
         }
@@ -442,7 +499,7 @@ void RayTracer::generateGCPs(const std::string& filename, uint16_t stride) {
     }
     
     // Retrieve the pixel data
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
 
     ui32_t id; 
 
@@ -456,7 +513,11 @@ void RayTracer::generateGCPs(const std::string& filename, uint16_t stride) {
             id = cam->getPixelId(u, v);
 
             // Retrieve data relative to the pixel center
-            data = (*pixels)[id].data[0]; 
+            if (pixels->pixSamples(id) == 0) {
+                continue;
+            }
+
+            data = pixels->getSample(id, 0); 
             if (data.t != inf) {
             
                 // Retrieve longitude and latitude in degrees
@@ -510,29 +571,32 @@ void RayTracer::exportRayTracedInfo(const std::string& filename) {
     file.write(reinterpret_cast<const char*>(&camPos), sizeof(camPos));
     file.write(reinterpret_cast<const char*>(&camDCM), sizeof(camDCM));
 
-    const std::vector<RenderedPixel>* pixels = renderer.getRenderedPixels();
+    const RenderBuffer* pixels = renderer.getRenderBuffer();
 
-    size_t nPix = pixels->size();
+    size_t nPix = pixels->nPixels();
+    size_t nSamples;
     double pixRes;
+    PixelData data;
     
     // Write the number of rendered pixels that are going to be written 
     file.write(reinterpret_cast<const char*>(&nPix), sizeof(nPix));
 
     // Write rendered pixels data
-    for (size_t k = 0; k < nPix; k++) {
+    for (ui32_t id = 0; id < nPix; id++) {
         
-        RenderedPixel p = (*pixels)[k];
-        pixRes = p.pixResolution();
+        pixRes = pixels->pixResolution(id);
+        nSamples = pixels->pixSamples(id);
 
         // Write the ID 
-        file.write(reinterpret_cast<const char*>(&p.id), sizeof(p.id));
+        file.write(reinterpret_cast<const char*>(&id), sizeof(id));
         // Write the resolution 
         file.write(reinterpret_cast<const char*>(&pixRes), sizeof(pixRes));
         // Write the number of samples
-        file.write(reinterpret_cast<const char*>(&p.nSamples), sizeof(p.nSamples));
+        file.write(reinterpret_cast<const char*>(&nSamples), sizeof(nSamples));
 
-        for (size_t j = 0; j < p.nSamples; j++) {
-            file.write(reinterpret_cast<const char*>(&p.data[j]), sizeof(p.data[j]));
+        for (size_t j = 0; j < nSamples; j++) {
+            data = pixels->getSample(id, j);
+            file.write(reinterpret_cast<const char*>(&data), sizeof(data));
         }
 
     }
@@ -582,8 +646,7 @@ void RayTracer::importRayTracedInfo(const std::string& filename) {
     size_t nPix; 
     file.read(reinterpret_cast<char*>(&nPix), sizeof(nPix)); 
 
-    std::vector<RenderedPixel> pixels; 
-    pixels.reserve(nPix); 
+    RenderBuffer pixels(cam->nPixels()); 
 
     ui32_t id;         
     double rayRes;
@@ -597,21 +660,22 @@ void RayTracer::importRayTracedInfo(const std::string& filename) {
         file.read(reinterpret_cast<char*>(&rayRes), sizeof(rayRes));
         file.read(reinterpret_cast<char*>(&nSamples), sizeof(nSamples));
 
+        if (id >= pixels.nPixels() || nSamples > MAX_PIX_SAMPLES) {
+            throw std::runtime_error("invalid ray-traced pixel data found.");
+        }
+
         // Retrieve the data of each sample
-        RenderedPixel pk(id, nSamples, rayRes);
+        pixels.allocatePixel(id, nSamples, rayRes);
 
         for (size_t j = 0; j < nSamples; j++) {
             file.read(reinterpret_cast<char*>(&data), sizeof(data));
-            pk.addPixelData(data); 
+            pixels.setSample(id, j, data); 
         }
 
-        // Append the rendered pixel
-        pixels.push_back(pk);
-
     }
 
     // Update the renderer status with this pixels
-    renderer.importRenderedData(pixels);
+    renderer.importRenderedData(std::move(pixels));
 
     // Close the file 
     file.close();
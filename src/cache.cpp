@@ -0,0 +1,118 @@
+#include "cache.h"
+#include "raster.h"
+
+
+RasterCache::RasterCache(size_t budget) : _budget(budget) {}
+
+void RasterCache::access(RasterContainer* c, size_t k, bool loaded) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    moveToFront(c, k);
+
+    if (loaded) {
+        misses++;
+        evict();
+    } else {
+        hits++;
+    }
+
+}
+
+void RasterCache::insert(RasterContainer* c, size_t k) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    moveToFront(c, k);
+    evict();
+
+}
+
+void RasterCache::erase(RasterContainer* c, size_t k) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto loc = locations.find(Key(c, k));
+    if (loc != locations.end()) {
+        remove(loc->second);
+    }
+
+}
+
+void RasterCache::erase(RasterContainer* c) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto it = entries.begin();
+    while (it != entries.end()) {
+        it = it->container == c ? remove(it) : std::next(it);
+    }
+
+}
+
+void RasterCache::enforce() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // The blocks read since the last access are accounted for once per frame
+    total = 0;
+    for (Entry& e : entries) {
+        e.memory = e.container->getRasterMemory(e.raster);
+        total += e.memory;
+    }
+
+    evict();
+
+}
+
+size_t RasterCache::usage() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return total;
+}
+
+void RasterCache::resetStatistics() {
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+void RasterCache::moveToFront(RasterContainer* c, size_t k) {
+
+    auto loc = locations.find(Key(c, k));
+    if (loc != locations.end()) {
+        entries.splice(entries.begin(), entries, loc->second);
+    } else {
+        entries.push_front(Entry{c, k, 0});
+        locations.emplace(Key(c, k), entries.begin());
+    }
+
+    Entry& e = entries.front();
+    size_t memory = c->getRasterMemory(k);
+
+    total = total - e.memory + memory;
+    e.memory = memory;
+
+}
+
+std::list<RasterCache::Entry>::iterator RasterCache::remove(std::list<Entry>::iterator it) {
+    total -= it->memory;
+    locations.erase(Key(it->container, it->raster));
+    return entries.erase(it);
+}
+
+void RasterCache::evict() {
+
+    /* The rasters are visited from the least recently used one. Pinned rasters are
+     * skipped, since they might be accessed by the rendering threads at any time. */
+    auto it = entries.end();
+    while (total > _budget && it != entries.begin()) {
+
+        it--;
+
+        if (it->container->evictRaster(it->raster)) {
+            it = remove(it);
+            evictions++;
+        }
+    }
+
+}
@@ -2,6 +2,7 @@
 #include "camera.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -43,7 +44,13 @@ Ray PinholeCamera::getRay(double u, double v, bool center) const {
     // completing the triad.
 
     vec3 direction = vec3(x, y, 1.0);
-    return Ray(_pos, _dcm*direction);
+
+    /* The ray differential is the pixel size on the image plane, which is at unit 
+     * distance from the camera, divided by the distance of the pixel from the camera. */
+    double dx = 2.0*scale[0]/(double)width(); 
+    double dy = 2.0*scale[1]/(double)height();
+
+    return Ray(_pos, _dcm*direction, std::min(dx, dy)/direction.norm());
 
 }
 
@@ -85,6 +92,9 @@ Ray RealCamera::getRay(double u, double v, bool center) const {
 
     double x, y;
 
+    // Pixel size along the direction vector units
+    double pix = std::min(pixSize[0], pixSize[1]);
+
     if (center) {
 
         // We shoot a ray as if it were a Pinhole camera
@@ -94,6 +104,9 @@ Ray RealCamera::getRay(double u, double v, bool center) const {
         origin = _pos;
         direction = vec3(x, y, 1.0);
 
+        // The image plane is at unit distance from the camera 
+        pix /= focalLength;
+
     } else {
         
         // We shoot a ray from a random point on the aperture disk to a random point 
@@ -118,7 +131,8 @@ Ray RealCamera::getRay(double u, double v, bool center) const {
         direction = pixSample - lensPoint;
     }
 
-    return Ray(origin, _dcm*direction);
+    // The ray differential is the pixel size seen from the ray origin
+    return Ray(origin, _dcm*direction, pix/direction.norm());
 
 }
 
@@ -2,8 +2,10 @@
 #include "dem.h"
 #include "utils.h"
 
-DEM::DEM(const std::vector<RasterDescriptor>& descriptors, ui32_t nThreads, bool displayLogs) : 
-    RasterManager(descriptors, nThreads, displayLogs) {
+DEM::DEM(
+    const std::vector<RasterDescriptor>& descriptors, ui32_t nThreads, bool displayLogs, 
+    const std::string& indexPath
+) : RasterManager(descriptors, nThreads, displayLogs, indexPath) {
 
     // Initialise min\max altitude values
     _minAltitude = inf; 
@@ -51,4 +53,34 @@ DEM::DEM(const std::vector<RasterDescriptor>& descriptors, ui32_t nThreads, bool
 }
 
 DEM::DEM(WorldOptions opts, ui32_t nThreads) : 
-    DEM(opts.demFiles, nThreads, opts.logLevel >= LogLevel::MINIMAL) {}
\ No newline at end of file
+    DEM(opts.demFiles, nThreads, opts.logLevel >= LogLevel::MINIMAL, opts.rasterIndex) {
+
+    if (!opts.cacheDirectory.empty()) {
+        setCacheDirectory(opts.cacheDirectory);
+    }
+
+    /* Cone-step maps are only required by the cone marching mode. They are built before 
+     * rendering, so that the rasters loaded afterwards only read their caches. */
+    if (opts.marchingMode == MarchingMode::CONE) {
+        enableConeMaps();
+        buildConeMaps();
+    }
+
+    // Sphere tracing steps only depend on the DEM data if its slopes are exact
+    if (opts.marchingMode == MarchingMode::LIPSCHITZ) {
+        enableBlockPreloading();
+    }
+
+    if (opts.tileCache) {
+        enableTileCache();
+    }
+
+    if (opts.latticeTolerance > 0.0) {
+        setProjectionLattice(opts.latticeTolerance);
+    }
+
+    if (opts.overviewReduction != OverviewReduction::NONE) {
+        setOverviewReduction(opts.overviewReduction);
+    }
+
+}
\ No newline at end of file
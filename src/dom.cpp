@@ -1,11 +1,27 @@
 
 #include "dom.h"
 
-DOM::DOM(const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs) : 
-    RasterManager(files, nThreads, displayLogs) {}
+DOM::DOM(
+    const std::vector<RasterDescriptor>& files, ui32_t nThreads, bool displayLogs, 
+    const std::string& indexPath
+) : RasterManager(files, nThreads, displayLogs, indexPath) {}
 
 DOM::DOM(WorldOptions opts, ui32_t nThreads) : 
-    DOM(opts.domFiles, nThreads, opts.logLevel >= LogLevel::MINIMAL) {}
+    DOM(opts.domFiles, nThreads, opts.logLevel >= LogLevel::MINIMAL, opts.rasterIndex) {
+
+    if (opts.tileCache) {
+        enableTileCache();
+    }
+
+    if (opts.latticeTolerance > 0.0) {
+        setProjectionLattice(opts.latticeTolerance);
+    }
+
+    if (opts.overviewReduction != OverviewReduction::NONE) {
+        setOverviewReduction(opts.overviewReduction);
+    }
+
+}
 
 double DOM::getColor(const point2& s, double res, ui32_t tid) {
     double c = getData(s, res, tid); 
@@ -13,6 +13,10 @@
     // Pre-compute the ID of the top pixel
     id0 = cam->getPixelId(p0);
 
+    // By default, the grid rays are not bounded
+    _minRadius = 0.0; 
+    _maxRadius = inf;
+
     // Initialize ray distance vector 
     rayDistances.reserve(width*height);
 
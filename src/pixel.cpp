@@ -2,6 +2,8 @@
 #include "pixel.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 
 
@@ -10,15 +12,16 @@
 ---------------------------------------------------------- */
 
 TaskedPixel::TaskedPixel(ui32_t id, double u, double v, double dt, size_t nSamples) : 
-    id(id), nSamples(nSamples), dt(dt), tMin(0.0), tMax(inf) {
+    id(id), nSamples(nSamples), dt(dt), tMin(0.0), tMax(inf), rMin(0.0), rMax(inf) {
 
-    this->u.reserve(nSamples);
-    this->v.reserve(nSamples);
+    if (nSamples > MAX_PIX_SAMPLES) {
+        throw std::invalid_argument("unsupported number of pixel samples.");
+    }
 
-    // Fill the vectors with the desired number of samples
+    // Fill the coordinates with the desired number of samples
     for (size_t j = 0; j < nSamples; j++)  {
-        this->u.push_back(u); 
-        this->v.push_back(v); 
+        this->u[j] = u; 
+        this->v[j] = v; 
     }
 
 }
@@ -60,9 +63,10 @@ void updateSSAACoordinates(TaskedPixel& tp) {
         v -= 0.375;
         u -= 0.375;
 
+        // The samples are placed on a regular 4x4 grid within the pixel
         size_t cnt = 0;
-        for (size_t i = 0; i < tp.nSamples / 2; i++) {
-            for (size_t j = 0; j < tp.nSamples / 2; j++) {
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
 
                 tp.u[cnt] = u + 0.25*j;
                 tp.v[cnt] = v + 0.25*i;
@@ -82,42 +86,124 @@ void updateSSAACoordinates(TaskedPixel& tp) {
                         RENDERED PIXEL
 ---------------------------------------------------------- */
 
-RenderedPixel::RenderedPixel(ui32_t id, size_t nSamples, double dt) : 
-    id(id), nSamples(nSamples), res(dt), tMin(inf), tMax(-inf) {
-    data.reserve(nSamples); 
-}
+RenderedPixel::RenderedPixel(const RenderBuffer* buffer, ui32_t id) : 
+    id(id), nSamples(buffer->pixSamples(id)), buffer(buffer) {}
 
+PixelData RenderedPixel::data(size_t k) const { return buffer->getSample(id, k); }
 
-void RenderedPixel::updateSamples(size_t newSamples) {
-    nSamples = newSamples;
-    data.reserve(nSamples);
-}
+double RenderedPixel::pixResolution() const { return buffer->pixResolution(id); }
+
+double RenderedPixel::pixDistance() const { return buffer->t()[buffer->pixOffset(id)]; }
 
-void RenderedPixel::addPixelData(const PixelData& d) {
+double RenderedPixel::pixMinDistance() const { return buffer->pixMinDistance(id); }
+
+double RenderedPixel::pixMaxDistance() const { return buffer->pixMaxDistance(id); }
+
+double RenderedPixel::pixMeanDistance() const {
+
+    const double* t = buffer->t() + buffer->pixOffset(id);
     
-    // Add the data
-    data.push_back(d); 
+    double tMean = 0.0;
+    for (size_t j = 0; j < nSamples; j++) {
+        if (t[j] != inf)
+            tMean += t[j]; 
+    }
+
+    tMean /= nSamples;
+    return tMean;
+
+}
 
-    // Update distance limits 
 
-    if (d.t < tMin)
-        tMin = d.t; 
+/* -------------------------------------------------------
+                        RENDER BUFFER
+---------------------------------------------------------- */
+
+RenderBuffer::RenderBuffer(ui32_t nPixels) { reset(nPixels); }
+
+void RenderBuffer::reset(ui32_t nPixels) {
+
+    _nPixels = nPixels; 
     
-    if (d.t > tMax)
-        tMax = d.t; 
+    // The first slots are reserved to the single-sample pixels
+    nUsed = nPixels; 
+
+    _offsets.resize(nPixels); 
+    for (ui32_t id = 0; id < nPixels; id++) {
+        _offsets[id] = id;
+    }
+
+    _counts.assign(nPixels, 0); 
+    _res.assign(nPixels, inf);
+
+    _t.assign(nPixels, inf); 
+    _radius.assign(nPixels, 0.0); 
+    _lon.assign(nPixels, 0.0); 
+    _lat.assign(nPixels, 0.0);
 
 }
 
+void RenderBuffer::reserveSamples(size_t n) {
 
-double RenderedPixel::pixMeanDistance() const {
-    double t; 
+    if (nUsed + n <= _t.size()) {
+        return; 
+    }
 
-    for (size_t j = 0; j < nSamples; j++) {
-        if (data[j].t != inf)
-            t += data[j].t; 
+    if (nUsed + n > std::numeric_limits<ui32_t>::max()) {
+        throw std::length_error("too many rendered pixel samples.");
+    }
+
+    _t.resize(nUsed + n, inf); 
+    _radius.resize(nUsed + n, 0.0); 
+    _lon.resize(nUsed + n, 0.0); 
+    _lat.resize(nUsed + n, 0.0);
+
+}
+
+void RenderBuffer::allocatePixel(ui32_t id, size_t n, double dt) {
+
+    if (n > MAX_PIX_SAMPLES) {
+        throw std::invalid_argument("unsupported number of pixel samples.");
+    }
+
+    // Single samples are written in the pixel slot, the others are appended
+    if (n == 1) {
+        _offsets[id] = id; 
+    } else {
+        reserveSamples(n);
+        _offsets[id] = nUsed; 
+        nUsed += n;
+    }
+
+    _counts[id] = n; 
+    _res[id] = dt; 
+
+    std::fill(_t.begin() + _offsets[id], _t.begin() + _offsets[id] + n, inf);
+
+}
+
+double RenderBuffer::pixMinDistance(ui32_t id) const {
+
+    const double* t = _t.data() + _offsets[id]; 
+    
+    double tMin = inf; 
+    for (size_t j = 0; j < _counts[id]; j++) {
+        tMin = t[j] < tMin ? t[j] : tMin;
+    }
+
+    return tMin;
+
+}
+
+double RenderBuffer::pixMaxDistance(ui32_t id) const {
+
+    const double* t = _t.data() + _offsets[id]; 
+    
+    double tMax = -inf; 
+    for (size_t j = 0; j < _counts[id]; j++) {
+        tMax = t[j] > tMax ? t[j] : tMax;
     }
 
-    t /= nSamples;
-    return t;
+    return tMax;
 
 }
\ No newline at end of file
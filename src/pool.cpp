@@ -1,17 +1,233 @@
-
 #include "pool.h" 
 
 ThreadWorker::ThreadWorker(ui32_t id) : _id(id) {}
 ui32_t ThreadWorker::id() const { return _id; }
 
 
+/* Chase-Lev work-stealing deque. The atomic operations that order the bottom and top 
+ * indices are sequentially consistent, rather than relying on standalone fences. */
+WorkStealingDeque::WorkStealingDeque(size_t capacity) {
+
+    // Round the capacity to the next power of two 
+    size_t n = 1; 
+    while (n < capacity) { n <<= 1; }
+
+    buffers.emplace_back(std::make_unique<Buffer>(n)); 
+    buffer.store(buffers.back().get(), std::memory_order_relaxed);
+
+}
+
+void WorkStealingDeque::push(PoolTask* task) {
+
+    std::int64_t b = bottom.load(std::memory_order_relaxed); 
+    std::int64_t t = top.load(std::memory_order_acquire); 
+    Buffer* a = buffer.load(std::memory_order_relaxed); 
+
+    // Grow the buffer when full. The previous one is retained because thieves that 
+    // have already loaded it may still be reading its slots.
+    if (b - t > (std::int64_t)a->mask) {
+        
+        buffers.emplace_back(std::make_unique<Buffer>(2*(a->mask + 1))); 
+        Buffer* g = buffers.back().get(); 
+        
+        for (std::int64_t k = t; k < b; k++) {
+            g->slots[k & g->mask].store(
+                a->slots[k & a->mask].load(std::memory_order_relaxed), std::memory_order_relaxed
+            );
+        }
+
+        buffer.store(g, std::memory_order_release); 
+        a = g; 
+    }
+
+    a->slots[b & a->mask].store(task, std::memory_order_release); 
+    bottom.store(b + 1, std::memory_order_release);
+
+}
+
+PoolTask* WorkStealingDeque::pop() {
+
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1; 
+    Buffer* a = buffer.load(std::memory_order_relaxed);
+
+    bottom.store(b, std::memory_order_seq_cst); 
+    std::int64_t t = top.load(std::memory_order_seq_cst); 
+
+    if (t > b) {
+        // The deque is empty 
+        bottom.store(b + 1, std::memory_order_relaxed); 
+        return nullptr;
+    }
+
+    PoolTask* task = a->slots[b & a->mask].load(std::memory_order_relaxed); 
+    if (t == b) {
+        // Last task, race against the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return task;
+
+}
+
+PoolTask* WorkStealingDeque::steal() {
+
+    std::int64_t t = top.load(std::memory_order_seq_cst); 
+    std::int64_t b = bottom.load(std::memory_order_seq_cst); 
+
+    if (t >= b) {
+        return nullptr; 
+    }
+
+    Buffer* a = buffer.load(std::memory_order_acquire); 
+    PoolTask* task = a->slots[t & a->mask].load(std::memory_order_acquire);
+
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    return task;
+
+}
+
+
+/* Bounded multi-producer multi-consumer queue (Vyukov). The sequence number of each slot 
+ * tells whether it is free for the producer of the given position (seq == pos) or filled 
+ * for its consumer (seq == pos + 1). */
+TaskQueue::TaskQueue(size_t capacity) {
+
+    // Round the capacity to the next power of two 
+    size_t n = 1; 
+    while (n < capacity) { n <<= 1; }
+
+    mask = n - 1; 
+    slots.reset(new Slot[n]);
+    for (size_t k = 0; k < n; k++) {
+        slots[k].seq.store(k, std::memory_order_relaxed);
+        slots[k].task = nullptr;
+    }
+
+}
+
+bool TaskQueue::tryPush(PoolTask* task) {
+
+    size_t pos = tail.load(std::memory_order_relaxed); 
+    Slot* slot; 
+
+    while (true) {
+        slot = &slots[pos & mask]; 
+        size_t seq = slot->seq.load(std::memory_order_acquire); 
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The ring is full
+            return false; 
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->task = task; 
+    slot->seq.store(pos + 1, std::memory_order_release); 
+    return true;
+
+}
+
+PoolTask* TaskQueue::tryPop() {
+
+    size_t pos = head.load(std::memory_order_relaxed); 
+    Slot* slot; 
+
+    while (true) {
+        slot = &slots[pos & mask]; 
+        size_t seq = slot->seq.load(std::memory_order_acquire); 
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The ring is empty, or its first task is not yet written
+            return nullptr; 
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    PoolTask* task = slot->task; 
+    slot->seq.store(pos + mask + 1, std::memory_order_release); 
+    return task;
+
+}
+
+void TaskQueue::push(PoolTask* task) {
+
+    // Once the ring has overflowed, the tasks are queued after the overflowing ones
+    if (!overflowing.load(std::memory_order_acquire) && tryPush(task)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(overflowMutex); 
+    overflow.push(task); 
+    overflowing.store(true, std::memory_order_release);
+
+}
+
+PoolTask* TaskQueue::pop() {
+
+    // The tasks in the ring are always older than the overflowing ones
+    PoolTask* task = tryPop(); 
+    if (task || !overflowing.load(std::memory_order_acquire)) {
+        return task;
+    }
+
+    std::unique_lock<std::mutex> lock(overflowMutex); 
+    if (!overflow.empty()) {
+        task = overflow.front(); 
+        overflow.pop();
+    }
+
+    if (overflow.empty()) {
+        overflowing.store(false, std::memory_order_release);
+    }
+
+    return task;
+
+}
+
+
+// Pool and worker index of the calling thread, used to push the tasks queued by a 
+// worker on its own deque.
+static thread_local ThreadPool* currentPool = nullptr; 
+static thread_local size_t currentWorker = 0;
+
 // Constructor. This does not start the pool, but only creates an instance of this 
 // class with an assigned number of workers. The `start` function is added to 
 // allow defining a set of jobs before actually starting them.
-ThreadPool::ThreadPool(size_t nThreads) : _nThreads(nThreads) {}
+ThreadPool::ThreadPool(size_t nThreads) : _nThreads(nThreads) {
+    for (size_t k = 0; k < _nThreads; k++) {
+        deques.emplace_back(std::make_unique<WorkStealingDeque>());
+    }
+}
 
-// Destructor to stop the thread pool
-ThreadPool::~ThreadPool() { stopPool(); }
+// Destructor to stop the thread pool and release the tasks that were never started
+ThreadPool::~ThreadPool() { 
+    
+    stopPool(); 
+
+    while (PoolTask* task = tasks.pop()) {
+        delete task;
+    }
+
+}
 
 // Start the Pool by creating all the working threads
 void ThreadPool::startPool() {
@@ -21,7 +237,7 @@ void ThreadPool::startPool() {
     }
 
     {
-        std::unique_lock<std::mutex> lock(queueMutex); 
+        std::unique_lock<std::mutex> lock(idleMutex); 
         started = true; 
         stop = false;
     }
@@ -39,7 +255,7 @@ void ThreadPool::startPool() {
 // Stop the Pool. This will wait completion of all active tasks and then stop.
 void ThreadPool::stopPool() {
     {
-        std::unique_lock<std::mutex> lock(queueMutex); 
+        std::unique_lock<std::mutex> lock(idleMutex); 
         stop = true; 
         started = false;
     }
@@ -59,7 +275,7 @@ void ThreadPool::stopPool() {
 bool ThreadPool::isRunning() { 
     bool run; 
     {
-        std::unique_lock<std::mutex> lock(queueMutex); 
+        std::unique_lock<std::mutex> lock(idleMutex); 
         run = started;
     }
     return run;
@@ -77,45 +293,103 @@ void ThreadPool::waitCompletion() {
 }
 
 // Enqueue a task to be executed by the thread pool
-void ThreadPool::addTask(std::function<void(const ThreadWorker&)> task) {
-    {
-        std::unique_lock<std::mutex> lock(queueMutex); 
-        tasks.emplace(std::move(task)); 
-        pendingTasks++;
+void ThreadPool::pushTask(PoolTask* task) {
+
+    // The counters are increased before the task becomes visible, so that it cannot 
+    // be completed before being accounted for.
+    pendingTasks++;
+    queuedTasks++;
+
+    if (currentPool == this) {
+        deques[currentWorker]->push(task);
+    } else {
+        tasks.push(task);
+    }
+
+    // Wake up an idle worker, if any. The idle mutex is locked so that the 
+    // notification cannot be lost between the predicate check and the wait.
+    if (nIdle > 0) {
+        { std::unique_lock<std::mutex> lock(idleMutex); }
+        task_cv.notify_one();
     }
 
-    task_cv.notify_one();
 } 
 
+PoolTask* ThreadPool::findTask(size_t id, ui32_t& seed) {
+
+    // Tasks queued by this worker are executed first (LIFO)
+    PoolTask* task = deques[id]->pop(); 
+    if (task) {
+        return task; 
+    }
+
+    /* Then the common queue, one task at a time so that its tasks are started in the 
+     * order they were queued. The tasks they spawn are instead spread through stealing. */
+    if ((task = tasks.pop())) {
+        return task;
+    }
+
+    // Steal from the other workers, starting from a random one (xorshift)
+    seed ^= seed << 13; 
+    seed ^= seed >> 17; 
+    seed ^= seed << 5;
+
+    for (size_t k = 0; k < _nThreads; k++) {
+        size_t victim = (seed + k) % _nThreads; 
+        if (victim != id && (task = deques[victim]->steal())) {
+            return task;
+        }
+    }
+
+    return nullptr;
+
+}
+
 void ThreadPool::workerLoop(ThreadWorker wk) {
+
+    currentPool = this; 
+    currentWorker = wk.id();
+
+    ui32_t seed = 2654435769u*(wk.id() + 1);
+
     // The while loop keeps iterating to keep the thread alive. Only when the 
-    // thread-pool is effectively stopped and the task list is empty the function 
+    // thread-pool is effectively stopped and no task is queued the function 
     // is closed.
     while (true) {
-        std::function<void(const ThreadWorker&)> task; 
-        {
-            // Lock the queue to allow data to be shared safely
-            std::unique_lock<std::mutex> lock(queueMutex); 
+
+        PoolTask* task = findTask(wk.id(), seed); 
+
+        if (!task) {
+
+            std::unique_lock<std::mutex> lock(idleMutex); 
+
             // Wait until there is a task to execute or the pool is stopped
-            task_cv.wait(lock, [this] { return (!tasks.empty() || stop); });
+            nIdle++;
+            task_cv.wait(lock, [this] { return (queuedTasks > 0 || stop); });
+            nIdle--;
 
             // If the pool has been stopped and there are no tasks, exit 
-            if (stop && tasks.empty()) {
+            if (stop && queuedTasks == 0) {
+                currentPool = nullptr;
                 return; 
             }
 
-            // Get the next available task from the queue 
-            task = std::move(tasks.front()); 
-            tasks.pop(); 
-
+            // A queued task might still be in the process of being pushed or stolen
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
         }
 
+        queuedTasks--;
+
         // Execute the task
-        task(wk); 
+        task->run(wk); 
+        delete task;
 
         // Update the number of pending tasks
         if (--pendingTasks == 0) {
-            wait_cv.notify_one();
+            std::unique_lock<std::mutex> lock(waitMutex);
+            wait_cv.notify_all();
         }
 
     }
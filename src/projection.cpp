@@ -0,0 +1,183 @@
+
+#include "projection.h"
+#include "utils.h"
+
+#include "ogr_spatialref.h"
+
+#include <cmath>
+#include <cstring>
+
+
+// Wrap an angle, in radians, within [-PI, PI]
+inline double wrapAngle(double a) {
+    return a - 2.0*PI*std::floor((a + PI)/(2.0*PI));
+}
+
+inline bool isProjection(const char* name, const char* proj) {
+    return std::strcmp(name, proj) == 0;
+}
+
+MapProjection::MapProjection() :
+    _type(ProjectionType::NONE), R(0.0), lon0(0.0), lat0(0.0), falseEasting(0.0),
+    falseNorthing(0.0), sign(1.0), scale(0.0), sinLat0(0.0), cosLat0(1.0), 
+    forwardKernel(identity), inverseKernel(identity) {}
+
+MapProjection::MapProjection(const OGRSpatialReference* crs) : MapProjection() {
+
+    if (crs == nullptr || !crs->IsProjected()) {
+        return;
+    }
+
+    // Only spherical bodies are supported
+    double a = crs->GetSemiMajor();
+    if (std::fabs(a - crs->GetSemiMinor()) > 1e-9*a) {
+        return;
+    }
+
+    const char* name = crs->GetAttrValue("PROJECTION");
+    if (name == nullptr) {
+        return;
+    }
+
+    // The normalised parameters are expressed in degrees and meters
+    double toMeters = crs->GetLinearUnits();
+
+    R = a/toMeters;
+    lon0 = deg2rad(crs->GetNormProjParm(SRS_PP_CENTRAL_MERIDIAN, 0.0));
+    lat0 = deg2rad(crs->GetNormProjParm(SRS_PP_LATITUDE_OF_ORIGIN, 0.0));
+
+    falseEasting  = crs->GetNormProjParm(SRS_PP_FALSE_EASTING, 0.0)/toMeters;
+    falseNorthing = crs->GetNormProjParm(SRS_PP_FALSE_NORTHING, 0.0)/toMeters;
+
+    if (isProjection(name, SRS_PT_EQUIRECTANGULAR) ||
+        isProjection(name, "Equidistant_Cylindrical") ||
+        isProjection(name, "Plate_Carree")) {
+
+        // Simple cylindrical projections are equirectangular ones on the equator
+        double latTs = deg2rad(crs->GetNormProjParm(SRS_PP_STANDARD_PARALLEL_1, 0.0));
+
+        _type = ProjectionType::EQUIRECTANGULAR;
+        scale = R*cos(latTs);
+
+        forwardKernel = forwardEquirectangular;
+        inverseKernel = inverseEquirectangular;
+
+    }
+    else if (isProjection(name, SRS_PT_POLAR_STEREOGRAPHIC) ||
+        (isProjection(name, SRS_PT_STEREOGRAPHIC) &&
+         std::fabs(std::fabs(lat0) - 0.5*PI) < 1e-10)) {
+
+        /* The latitude of origin of the polar variant is the latitude of true scale. The
+         * scale factor only applies when such latitude is the pole. */
+        double k0 = crs->GetNormProjParm(SRS_PP_SCALE_FACTOR, 1.0);
+        double latTs = std::fabs(lat0);
+
+        _type = ProjectionType::POLAR_STEREOGRAPHIC;
+        sign = lat0 < 0.0 ? -1.0 : 1.0;
+
+        forwardKernel = forwardPolarStereographic;
+        inverseKernel = inversePolarStereographic;
+
+        if (std::fabs(latTs - 0.5*PI) < 1e-10) {
+            scale = 2.0*R*k0;
+        } else {
+            scale = R*cos(latTs)/tan(0.25*PI - 0.5*latTs);
+        }
+
+    }
+    else if (isProjection(name, SRS_PT_ORTHOGRAPHIC)) {
+
+        _type = ProjectionType::ORTHOGRAPHIC;
+        scale = R;
+
+        forwardKernel = forwardOrthographic;
+        inverseKernel = inverseOrthographic;
+
+        sinLat0 = sin(lat0);
+        cosLat0 = cos(lat0);
+
+    }
+
+}
+
+void MapProjection::identity(const MapProjection&, size_t, double*, double*) {}
+
+void MapProjection::forwardEquirectangular(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+        double dLon = wrapAngle(deg2rad(x[k]) - p.lon0);
+        x[k] = p.falseEasting + p.scale*dLon;
+        y[k] = p.falseNorthing + p.R*(deg2rad(y[k]) - p.lat0);
+    }
+}
+
+void MapProjection::inverseEquirectangular(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+        x[k] = rad2deg(wrapAngle(p.lon0 + (x[k] - p.falseEasting)/p.scale));
+        y[k] = rad2deg(p.lat0 + (y[k] - p.falseNorthing)/p.R);
+    }
+}
+
+void MapProjection::forwardPolarStereographic(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+        double dLon = deg2rad(x[k]) - p.lon0;
+        double rho = p.scale*tan(0.25*PI - 0.5*p.sign*deg2rad(y[k]));
+        x[k] = p.falseEasting + rho*sin(dLon);
+        y[k] = p.falseNorthing - p.sign*rho*cos(dLon);
+    }
+}
+
+void MapProjection::inversePolarStereographic(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+        double dx = x[k] - p.falseEasting;
+        double dy = y[k] - p.falseNorthing;
+        double rho = sqrt(dx*dx + dy*dy);
+        x[k] = rad2deg(wrapAngle(p.lon0 + atan2(dx, -p.sign*dy)));
+        y[k] = rad2deg(p.sign*(0.5*PI - 2.0*atan(rho/p.scale)));
+    }
+}
+
+void MapProjection::forwardOrthographic(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+        double dLon = deg2rad(x[k]) - p.lon0;
+        double lat = deg2rad(y[k]);
+        double cosLat = cos(lat);
+        x[k] = p.falseEasting + p.scale*cosLat*sin(dLon);
+        y[k] = p.falseNorthing + p.scale*(p.cosLat0*sin(lat) - p.sinLat0*cosLat*cos(dLon));
+    }
+}
+
+void MapProjection::inverseOrthographic(
+    const MapProjection& p, size_t n, double* x, double* y
+) {
+    for (size_t k = 0; k < n; k++) {
+
+        double dx = x[k] - p.falseEasting;
+        double dy = y[k] - p.falseNorthing;
+        double rho = sqrt(dx*dx + dy*dy);
+
+        if (rho == 0.0) {
+            x[k] = rad2deg(p.lon0);
+            y[k] = rad2deg(p.lat0);
+            continue;
+        }
+
+        // Points beyond the limb are moved on it
+        double sinC = std::fmin(rho/p.scale, 1.0);
+        double cosC = sqrt(1.0 - sinC*sinC);
+
+        x[k] = rad2deg(wrapAngle(
+            p.lon0 + atan2(dx*sinC, rho*cosC*p.cosLat0 - dy*sinC*p.sinLat0)
+        ));
+        y[k] = rad2deg(asin(cosC*p.sinLat0 + dy*sinC*p.cosLat0/rho));
+    }
+}
@@ -1,13 +1,29 @@
 
 #include "raster.h"
 #include "crsutils.h"
+#include "pool.h"
 #include "utils.h"
 
 #include <algorithm>
 #include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Initialize a flag that is used to register GDAL raster readers 
 std::once_flag gdalRegister; 
@@ -47,8 +63,8 @@ RasterBand::RasterBand(const RasterDescriptor& d, std::shared_ptr<GDALDataset> p
     _offset = d.offset; 
     _scale  = d.scale;
 
-    // Compute the band minimum and maximum parameters 
-    // Currently uses an APPROXIMATE computation
+    /* Compute the band minimum and maximum parameters. The values stored in the band 
+     * metadata are used when available, although they might be approximate. */
     int bMin, bMax; 
 
     double minMax[2];
@@ -57,7 +73,8 @@ RasterBand::RasterBand(const RasterDescriptor& d, std::shared_ptr<GDALDataset> p
     minMax[1] = pBand->GetMaximum(&bMax); 
 
     // If the information was not available compute it
-    if (!(bMin && bMax)) {
+    bool exact = !(bMin && bMax);
+    if (exact) {
         pBand->ComputeRasterMinMax(FALSE, minMax);
     }
 
@@ -74,6 +91,7 @@ RasterBand::RasterBand(const RasterDescriptor& d, std::shared_ptr<GDALDataset> p
         pBand->SetNoDataValue(minMax[0]); 
         // Recompute settings 
         pBand->ComputeRasterMinMax(FALSE, minMax); 
+        exact = true;
     }
 
     _vMin = minMax[0]; 
@@ -82,400 +100,3754 @@ RasterBand::RasterBand(const RasterDescriptor& d, std::shared_ptr<GDALDataset> p
     // Retrieve the value indicating no data
     _noDataVal = pBand->GetNoDataValue(); 
 
-}
-
-void RasterBand::loadData() {
+    _dataType = pBand->GetRasterDataType();
+    initLayout();
 
-    nLoadedElements = _width*_height;
+    /* The quantized values are offset by the band minimum and they must span less than 
+     * 16 bits, thus the exact range is required to select such storage. */
+    if (_storage == RasterStorage::QUANT16 && !exact) {
 
-    // Create a shared pointer
-    data = std::shared_ptr<float>(
-        new float[nLoadedElements], std::default_delete<float[]>()
-    );
+        pBand->ComputeRasterMinMax(FALSE, minMax);
 
-    // Load the data into the
-    CPLErr err = pBand->RasterIO(
-        GF_Read, 0, 0, _width, _height, data.get(), _width, _height, GDT_Float32, 0, 0
-    );
+        _vMin = minMax[0]; 
+        _vMax = minMax[1];
 
-    if (err != CE_None) {
-        unloadData();
-        throw std::runtime_error("failed to retrieve raster band data");
-    } 
+        initLayout();
+    }
 
-    return; 
 }
 
-void RasterBand::unloadData() {
-    
-    /* Frees the internal GDAL cache*/
-    pBand->FlushCache();
+RasterBand::RasterBand(const RasterDescriptor& d, const RasterBandMetadata& m) {
 
-    nLoadedElements = 0; 
-    data.reset();
-    
-}
+    _xBlock = m.xBlock; 
+    _yBlock = m.yBlock; 
 
-double RasterBand::getData(ui32_t i) const {
+    _width  = m.width; 
+    _height = m.height; 
 
-    if (i < nLoadedElements) {
-        return _scale*(double)data.get()[i] + _offset;
-    } else {
-        throw std::range_error("raster band data does not have enough elements");
-    }
-}
+    _offset = d.offset; 
+    _scale  = d.scale;
 
-double RasterBand::getData(ui32_t u, ui32_t v) const {
-    return getData(v*_width + u);
-}
+    _vMin = m.vMin; 
+    _vMax = m.vMax; 
 
+    _noDataVal = m.noData;
+    _dataType = (GDALDataType)m.type;
 
-/* -------------------------------------------------------
-                    DATASET CONTAINER 
----------------------------------------------------------- */
+    initLayout();
 
-RasterFile::RasterFile(const RasterDescriptor& desc, size_t nThreads) : _nThreads(nThreads)
-{
-    // Retrieve the raster name
-    std::string file = desc.filename;
+}
 
-    // Generate filepath object
-    filepath = std::filesystem::path(file); 
+RasterBandMetadata RasterBand::metadata() const {
 
-    // Retrieve filename 
-    filename = filepath.filename().string(); 
+    RasterBandMetadata m; 
 
-    pDataset = std::shared_ptr<GDALDataset>(
-        (GDALDataset *) GDALOpen(file.c_str(), GA_ReadOnly), GDALClose
-    );
+    m.xBlock = _xBlock; 
+    m.yBlock = _yBlock;
+    m.width  = _width; 
+    m.height = _height; 
+    m.type   = (ui32_t)_dataType; 
 
-    // Check whether it is a valid Dataset pointer
-    if (pDataset == NULL) {
-        throw std::runtime_error("failed to open the dataset. Invalid pointer detected.");
-    }
+    m.vMin = _vMin; 
+    m.vMax = _vMax; 
+    m.noData = _noDataVal;
 
-    // Retrieve dataset parameters. 
-    _width  = (ui32_t)pDataset->GetRasterXSize(); 
-    _height = (ui32_t)pDataset->GetRasterYSize(); 
-    _rasterCount  = (size_t)pDataset->GetRasterCount(); 
+    return m;
 
-    // Retrieve the Affine transformation of the projection
-    double adf[6]; 
+}
 
-    if (pDataset->GetGeoTransform(adf) == CE_None) {
-        transform = Affine(adf); 
-    } else {
-        transform = Affine(); 
+void RasterBand::initLayout() {
+
+    /* Integer bands are stored with their native type, as long as the no data value, 
+     * which marks the pixels beyond the band limits, is also representable. Otherwise, 
+     * or if the type is wider, they are quantized to 16 bits if their declared range 
+     * fits. Values outside the declared range are saturated. */
+    auto fits = [](double x, double lo, double hi) {
+        return x >= lo && x <= hi && x == std::floor(x);
+    };
+
+    GDALDataType type = _dataType;
+    if (type == GDT_Byte && fits(_noDataVal, 0, 255)) {
+        _storage = RasterStorage::UINT8; 
+    } else if (type == GDT_Int16 && fits(_noDataVal, -32768, 32767)) {
+        _storage = RasterStorage::INT16;
+    } else if (type == GDT_UInt16 && fits(_noDataVal, 0, 65535)) {
+        _storage = RasterStorage::UINT16;
+    } else if ((type == GDT_Byte || type == GDT_Int16 || type == GDT_UInt16 || 
+                type == GDT_Int32 || type == GDT_UInt32) && 
+               fits(_vMin, -inf, inf) && _vMax - _vMin < RASTER_QUANT_NODATA) {
+        _storage = RasterStorage::QUANT16;
+        storageOffset = _vMin;
     }
 
-    iTransform = inverse(transform);
+    /* The data is loaded in blocks whose sides are powers of two, so that the first 
+     * pyramid levels can be stored within each block. Each side is the smallest power 
+     * covering the file block, up to 1024 pixels, thus file blocks whose sides are 
+     * powers of two are read only once, whereas larger or irregular ones might be read 
+     * by more than one block. Files stored in strips are split in narrower blocks along 
+     * the strip direction. */
+    auto blockBits = [](ui32_t n) {
+        ui32_t b = 0; 
+        while ((1u << b) < RASTER_BLOCK_SIZE || ((1u << b) < n && b < 10)) {
+            b++;
+        }
+        return b;
+    };
 
-    // Compute the coordinates of the bottom-right pixel
-    point2 p = transform*point2(_width, _height);
+    blockBitsX = blockBits(_xBlock); 
+    blockBitsY = blockBits(_yBlock);
 
-    // Compute the map projection coordinates limits 
-    _left = transform[2];
-    _top  = transform[5];
+    blockWidth  = 1u << blockBitsX; 
+    blockHeight = 1u << blockBitsY;
 
-    _right  = p[0];
-    _bottom = p[1];
+    nBlocksX = (_width + blockWidth - 1)/blockWidth; 
+    nBlocksY = (_height + blockHeight - 1)/blockHeight;
 
-    // Retrieve the raster highest resolution from the Affine transform if not specified
-    _resolution = desc.res > 0 ? desc.res : MAX(fabs(transform[0]), fabs(transform[4]));
+}
 
-    // Update the raster geographical bounds 
-    for (uint8_t k = 0; k < 2; k++) {
-        lon_bounds[k] = desc.lon_bounds[k]; 
-        lat_bounds[k] = desc.lat_bounds[k]; 
+RasterBlockTable::~RasterBlockTable() {
+
+    // Mapped blocks are released together with the mapping
+    if (mapping) {
+        return;
     }
 
-    // Update the raster's reference system projection
-    updateReferenceSystem();
+    for (std::atomic<const float*>& b : blocks) {
+        release(b.load());
+    }
 
-    // Setup the map projection to geographic transformations.
-    setupTransformations(); 
+}
 
-    // Retrieve all raster bands
-    bands.reserve((size_t)_rasterCount); 
-    for (size_t k = 0; k < _rasterCount; k++) {
-        bands.push_back(RasterBand(desc, pDataset, (int)k+1));
-    }
+float* RasterBlockTable::allocate(size_t n) {
+    return reinterpret_cast<float*>(new std::byte[n*sizeof(float)]);
+}
 
+void RasterBlockTable::release(const float* p) {
+    delete[] reinterpret_cast<const std::byte*>(p);
 }
 
-// Raster limits 
+void RasterBand::loadData() {
 
-void RasterFile::getLongitudeBounds(double* bounds) const {
-    bounds[0] = lon_bounds[0]; 
-    bounds[1] = lon_bounds[1];
+    if (!pBand) {
+        throw std::runtime_error("the raster band is not attached to its dataset.");
+    }
+
+    // All the blocks are initially missing
+    table = std::make_shared<RasterBlockTable>((size_t)nBlocksX*nBlocksY);
+
+    // Setup the maximum-value pyramid used to skip empty space during ray-marching
+    initPyramid();
+
+    // Setup the maximum slopes used to bound the sphere tracing steps
+    initSlopeMap();
+
+    initOverviews();
+
+    return; 
 }
 
-void RasterFile::getLatitudeBounds(double* bounds) const {
-    bounds[0] = lat_bounds[0]; 
-    bounds[1] = lat_bounds[1];
+void RasterBand::setOverviewReduction(OverviewReduction mode) {
+    overviewMode = mode;
 }
 
-bool RasterFile::isWithinGeographicBounds(const point2& p) const {
+void RasterBand::initOverviews() {
 
-    return ((lon_bounds[0] <= p[0] && p[0] <= lon_bounds[1]) && 
-            (lat_bounds[0] <= p[1] && p[1] <= lat_bounds[1]));
-            
-}
+    overviewWidth.assign(1, _width); 
+    overviewHeight.assign(1, _height); 
+    overviewBlocksX.assign(1, nBlocksX);
+    overviewBands.assign(1, nullptr);
+    nOverviews = 0;
 
+    if (overviewMode == OverviewReduction::NONE) {
+        return;
+    }
 
-// Raster Bands Interfaces
+    for (ui32_t k = 1; k <= RASTER_MAX_OVERVIEWS; k++) {
 
-void RasterFile::loadBands() {
-    for (size_t k = 0; k < _rasterCount; k++) {
-        loadBand(k); 
+        if (overviewWidth[k-1] == 1 && overviewHeight[k-1] == 1) {
+            break;
+        }
+
+        ui32_t w = (overviewWidth[k-1] + 1)/2; 
+        ui32_t h = (overviewHeight[k-1] + 1)/2;
+
+        ui32_t nbx = (w + blockWidth - 1)/blockWidth;
+        ui32_t nby = (h + blockHeight - 1)/blockHeight;
+
+        overviewWidth.push_back(w); 
+        overviewHeight.push_back(h); 
+        overviewBlocksX.push_back(nbx);
+
+        /* GDAL overviews are computed with the resampling chosen by their creator, which 
+         * is usually an average, thus they are only used for the mean reduction. */
+        GDALRasterBand* pOverview = nullptr;
+        if (overviewMode == OverviewReduction::MEAN) {
+            for (int i = 0; i < pBand->GetOverviewCount(); i++) {
+                GDALRasterBand* pb = pBand->GetOverview(i);
+                if (pb && (ui32_t)pb->GetXSize() == w && (ui32_t)pb->GetYSize() == h) {
+                    pOverview = pb;
+                    break;
+                }
+            }
+        }
+
+        overviewBands.push_back(pOverview);
+        table->overviews.push_back(std::make_unique<RasterBlockTable>((size_t)nbx*nby));
+        nOverviews = k;
     }
+
 }
 
-void RasterFile::unloadBands() {
-    for (size_t k = 0; k < _rasterCount; k++) {
-        unloadBand(k);
+void RasterBand::loadBlocks() {
+    for (ui32_t bv = 0; bv < nBlocksY; bv++) {
+        for (ui32_t bu = 0; bu < nBlocksX; bu++) {
+            getBlock(bu, bv);
+        }
     }
 }
 
+void RasterBand::loadBlocks(ui32_t u0, ui32_t v0, ui32_t u1, ui32_t v1) {
 
-// Transformation Functions
-point2 RasterFile::sph2map(const point2& s, ui32_t threadid) const {
+    u1 = MIN(u1, _width - 1);
+    v1 = MIN(v1, _height - 1);
+
+    for (ui32_t bv = v0 >> blockBitsY; bv <= (v1 >> blockBitsY); bv++) {
+        for (ui32_t bu = u0 >> blockBitsX; bu <= (u1 >> blockBitsX); bu++) {
+            getBlock(bu, bv);
+        }
+    }
 
-    int flags[1]; 
-    point2 m(s); 
-    
-    if(!s2mT[threadid]->Transform(1, &m.e[0], &m.e[1], nullptr, flags))
-        std::clog << "Transformation failed." << std::endl; 
-    
-    return m;
 }
 
-point2 RasterFile::map2sph(const point2& m, ui32_t threadid) const {
+void RasterBand::unloadData() {
+    
+    /* Frees the internal GDAL cache*/
+    {
+        std::lock_guard<std::mutex> lock(*ioMutex);
+        pBand->FlushCache();
+    }
 
-    int flags[1]; 
-    point2 s(m);
+    table.reset();
 
-    if(!m2sT[threadid]->Transform(1, &s.e[0], &s.e[1], nullptr, flags))
-        std::clog << "Transformation failed." << std::endl; 
-    
-    return s;
+    pyramidWidth.clear();
+    pyramidHeight.clear();
+    levelOffset.clear();
+    nLevels = 0; 
+    nBlockLevels = 0;
 
-}
+    cones.clear();
 
-point2 RasterFile::sph2pix(const point2& s, ui32_t threadid) const {
+    overviewWidth.clear();
+    overviewHeight.clear();
+    overviewBlocksX.clear();
+    overviewBands.clear();
+    nOverviews = 0;
     
-    // Retriev the pixel coordinates
-    point2 pix = map2pix(sph2map(s, threadid)); 
+}
 
-    // Ensure the pixel is within the bounds of the image 
-    if (pix[0] < 0) {
-        pix[0] = 0; 
-    } else if (pix[0] >= _width) {
-        pix[0] = _width - 1;
+size_t RasterBand::memoryUsage() const {
+
+    if (!table) {
+        return 0;
     }
 
-    if (pix[1] < 0) {
-        pix[1] = 0; 
-    } else if (pix[1] >= _height) {
-        pix[1] = _height - 1;
+    size_t n = 0;
+
+    // Blocks stored within a tile cache mapping are owned by the page cache
+    if (!table->mapping) {
+        n += table->nLoaded.load()*levelOffset.back()*sizeof(float);
     }
 
-    return pix;
+    for (size_t k = 0; k < table->overviews.size(); k++) {
+        n += table->overviews[k]->nLoaded.load()*blockWidth*blockHeight*sizeof(float);
+    }
+
+    for (size_t k = 0; k < table->pyramid.size(); k++) {
+        n += table->pyramid[k].size()*sizeof(float);
+    }
+
+    n += (cones.size() + table->tileSlopes.size() + table->slopes.size())*sizeof(float);
+    return n;
 
 }
 
-point2 RasterFile::pix2sph(const point2& p, ui32_t threadid) const {
-    return map2sph(pix2map(p), threadid);
+double RasterBand::getData(ui32_t i) const {
+    return getData(i % _width, i / _width);
 }
 
+double RasterBand::getData(ui32_t u, ui32_t v) const {
 
-// Private functions 
+    if (!table || u >= _width || v >= _height) {
+        throw std::range_error("raster band data does not have enough elements");
+    }
 
-void RasterFile::updateReferenceSystem() { 
+    return _scale*(double)getValue(u, v) + _offset;
 
-    // Read the map projection information from the associated .PRJ file
-    std::string projFile = filepath.string().substr(0, filepath.string().size() - 3) + "prj";
+}
 
-    // Update the reference system only if an associated .PRJ file exists in the folder
-    if (fileExists(projFile)) {
+double RasterBand::getOverviewData(const point2& pix, ui32_t level) const {
 
-        // Read the .PRJ file content 
-        std::string wkt = readFileContent(projFile);
-        
-        // Update the dataset reference system
-        OGRSpatialReference mCRS(wkt.c_str());
-        pDataset->SetSpatialRef(&mCRS);
+    if (!table) {
+        throw std::range_error("raster band data does not have enough elements");
     }
 
-}
+    level = MIN(level, nOverviews);
+    ui32_t w = overviewWidth[level], h = overviewHeight[level];
 
-void RasterFile::setupTransformations() {
+    /* Each overview pixel is placed at the centre of the band pixels it reduces, whereas 
+     * the band pixels are placed at their integer coordinates. */
+    double f = (double)(1u << level);
+    double x = (pix[0] - 0.5*(f - 1.0))/f; 
+    double y = (pix[1] - 0.5*(f - 1.0))/f;
 
-    // Reserve enough space for all our threads
-    s2mT.reserve(_nThreads); 
-    m2sT.reserve(_nThreads);
+    x = MIN(MAX(x, 0.0), w - 1.0); 
+    y = MIN(MAX(y, 0.0), h - 1.0);
 
-    // Retrieve the map spatial reference system 
-    const OGRSpatialReference mCRS = *pDataset->GetSpatialRef(); 
+    ui32_t u = (ui32_t)x, v = (ui32_t)y; 
+    double a = x - u, b = y - v;
 
-    // Generate a Moon's spherical reference system (with longitude first)
-    OGRSpatialReference sCRS = MoonGeographicCRS();
+    ui32_t u1 = MIN(u + 1, w - 1), v1 = MIN(v + 1, h - 1);
 
-    // Compute the transformation between a geographic and projected map and its inverse.
-    for (size_t k = 0; k < _nThreads; k++) 
-    {
-        s2mT.push_back(
-            std::shared_ptr<OGRCoordinateTransformation>(
-                OGRCreateCoordinateTransformation(&sCRS, &mCRS)
-            )
-        ); 
+    // Bilinearly interpolate the pixels with data
+    float val[4] = {
+        getOverviewValue(level, u, v), getOverviewValue(level, u1, v), 
+        getOverviewValue(level, u, v1), getOverviewValue(level, u1, v1)
+    };
 
-        m2sT.push_back(
-            std::shared_ptr<OGRCoordinateTransformation>(
-                OGRCreateCoordinateTransformation(&mCRS, &sCRS)
-            )
-        );
+    double wk[4] = {(1.0 - a)*(1.0 - b), a*(1.0 - b), (1.0 - a)*b, a*b};
+
+    double n = 0.0, d = 0.0;
+    for (size_t k = 0; k < 4; k++) {
+        if (val[k] != (float)_noDataVal && !std::isnan(val[k])) {
+            n += wk[k]*val[k]; 
+            d += wk[k];
+        }
     }
 
-}
+    // Locations without any pixel with data are undefined, as in the band interpolation
+    if (d <= 0.0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
 
+    return _scale*n/d + _offset;
 
-/* -------------------------------------------------------
-                    RASTER CONTAINER
----------------------------------------------------------- */
+}
 
-// Constructors 
+const float* RasterBand::getBlock(ui32_t bu, ui32_t bv) const {
 
-RasterContainer::RasterContainer(double res, size_t nThreads) : 
-    _resolution(res), nThreads(nThreads) {}
+    // Fast path: the block has already been loaded
+    size_t b = (size_t)bv*nBlocksX + bu;
+    const float* pData = table->blocks[b].load(std::memory_order_acquire); 
 
-void RasterContainer::appendRaster(RasterDescriptor desc) {
+    return pData ? pData : loadBlock(b);
 
-    // Append the raster to the set of rasters
-    rasters.push_back(RasterFile(desc, nThreads)); 
+}
 
-    rastersUsed.push_back(0); 
-    rastersFlag.push_back(0); 
+const float* RasterBand::loadBlock(size_t b) const {
 
-}
+    std::lock_guard<std::mutex> lock(table->mutex);
 
-void RasterContainer::loadRasters() {
-    for (size_t k = 0; k < rasters.size(); k++) {
-        rasters[k].loadBand(0);
+    // Another thread might have loaded the block while waiting for the lock
+    const float* pBlock = table->blocks[b].load(std::memory_order_relaxed);
+    if (pBlock) {
+        return pBlock;
     }
-}
 
-void RasterContainer::unloadRasters() {
-    for (size_t k = 0; k < rasters.size(); k++) {
-        rasters[k].unloadBand(0);
-    }
-}
+    ui32_t x0 = (b % nBlocksX)*blockWidth; 
+    ui32_t y0 = (b / nBlocksX)*blockHeight;
 
-double RasterContainer::getData(const point2& s, bool interp, ui32_t tid) {
+    ui32_t w = MIN(blockWidth, _width - x0); 
+    ui32_t h = MIN(blockHeight, _height - y0);
 
-    point2 pix; 
+    // The block data is followed by its pyramid levels
+    float* pData = RasterBlockTable::allocate(levelOffset.back());
 
-    for (size_t k = 0; k < rasters.size(); k++) {
-            
-        if (rasters[k].isWithinGeographicBounds(s)) {
-            
-            /* In the worst case scenario, this lock is acquired just once per 
-             * image per used raster, so we shouldn't have many performance drawbacks. */
-            if (rastersUsed[k] == 0) {
-                
-                std::unique_lock<std::mutex> lock(rasterUpdateMutex);
+    if (readBlock(pData, x0, y0, w, h) != CE_None) {
+        RasterBlockTable::release(pData);
+        throw std::runtime_error("failed to retrieve raster band data");
+    } 
 
-                // If the rasters band is not loaded, load it! 
-                if (!rasters[k].isBandLoaded(0)) {
-                    rasters[k].loadBand(0);
-                }
+    buildBlockPyramid(pData);
 
-                // Update the number of times the raster has been used 
-                rastersUsed[k]++; 
-            }
+    table->blocks[b].store(pData, std::memory_order_release); 
+    table->nLoaded++;
 
-            // Retrieve the pixel data value
-            pix = rasters[k].sph2pix(s, tid); 
-            return interp ? interpolateRaster(pix, k) : 
-                            rasters[k].getBandData(pix[0], pix[1], 0);         
-        }
+    /* The structures shared by the whole band are refined after the block is published. 
+     * Their entries switch from the conservative initial values to the exact ones, thus 
+     * concurrent readers always retrieve valid bounds. */
+    updatePyramid(x0, y0, x0 + w, y0 + h);
+    updateSlopeMap(x0, y0, x0 + w, y0 + h);
 
-    }
+    return pData;
 
-    return -inf; 
 }
 
-void RasterContainer::cleanupRasters(ui32_t threshold) {
+CPLErr RasterBand::readBlock(
+    float* pData, ui32_t x0, ui32_t y0, ui32_t w, ui32_t h
+) const {
 
-    for (size_t k = 0; k < rasters.size(); k++) 
-    {
-        if (rastersUsed[k] == 0) {
-            if (++rastersFlag[k] >= threshold && rasters[k].isBandLoaded(0)) {
-                rasters[k].unloadBand(0);
-                rastersFlag[k] = 0; 
-            }
-        } else {
-            rastersFlag[k] = 0; 
-            rastersUsed[k] = 0;
-        }
-    }
-}
+    size_t n = (size_t)blockWidth*blockHeight; 
 
-double RasterContainer::interpolateRaster(const point2& pix, size_t rid) const {
+    // Pixels beyond the band limits are marked as no data
+    auto read = [&](auto* pBlock, GDALDataType type) {
+        using T = std::remove_pointer_t<decltype(pBlock)>;
+        std::fill(pBlock, pBlock + n, (T)_noDataVal);
 
-    int u = static_cast<int>(pix[0]); 
-    int v = static_cast<int>(pix[1]); 
+        std::lock_guard<std::mutex> lock(*ioMutex);
+        return pBand->RasterIO(
+            GF_Read, x0, y0, w, h, pBlock, w, h, type, sizeof(T), 
+            (GSpacing)blockWidth*sizeof(T)
+        );
+    };
 
-    // These are the upper-left (dr) and bottom-right (dl) points
-    point2 dl(u, v); 
-    point2 dr = dl + 1;
+    switch (_storage) {
 
-    dl = pix - dl; 
-    dr = dr - pix; 
-    
-    // Retrieve no data value
-    double noDataVal = rasters[rid].getBandNoDataValue(0); 
+        case RasterStorage::UINT8: 
+            return read(reinterpret_cast<ui8_t*>(pData), GDT_Byte);
 
-    // Retrieve raster width and height 
-    double s = sqrt(2), sk; 
-    double h, n = 0.0, d = 0.0; 
+        case RasterStorage::INT16: 
+            return read(reinterpret_cast<int16_t*>(pData), GDT_Int16);
 
-    bool hu = (u+1) < rasters[rid].width(); 
-    bool hv = (v+1) < rasters[rid].height(); 
+        case RasterStorage::UINT16: 
+            return read(reinterpret_cast<ui16_t*>(pData), GDT_UInt16);
 
-    for (size_t j = 0; j < 4; j++) {
+        case RasterStorage::QUANT16: {
 
-        switch (j) {
-            case 0:
-                sk = dl.norm();
-                h = rasters[rid].getBandData(u, v, 0); 
-                break;
+            // Wider values are read in double precision, where they are exact
+            std::vector<double> buffer((size_t)w*h);
+            CPLErr err;
+            {
+                std::lock_guard<std::mutex> lock(*ioMutex);
+                err = pBand->RasterIO(
+                    GF_Read, x0, y0, w, h, buffer.data(), w, h, GDT_Float64, 0, 0
+                );
+            }
 
-            case 1: 
-                sk = sqrt(dr[0]*dr[0] + dl[1]*dl[1]);
-                h = hu ? rasters[rid].getBandData(u+1, v, 0) : noDataVal; 
-                break;
+            ui16_t* pBlock = reinterpret_cast<ui16_t*>(pData); 
+            std::fill(pBlock, pBlock + n, (ui16_t)RASTER_QUANT_NODATA);
 
-            case 2: 
-                sk = sqrt(dl[0]*dl[0] + dr[1]*dr[1]); 
-                h = hv ? rasters[rid].getBandData(u, v+1, 0) : noDataVal; 
-                break;
+            double vk; 
+            for (ui32_t j = 0; j < h; j++) {
+                for (ui32_t i = 0; i < w; i++) {
 
-            default: 
-                sk = dr.norm(); 
-                h = (hu && hv) ? rasters[rid].getBandData(u+1, v+1, 0) : noDataVal; 
-                break;
+                    vk = buffer[(size_t)j*w + i]; 
+                    if (vk == _noDataVal || std::isnan(vk)) {
+                        continue;
+                    }
+
+                    vk = MIN(MAX(vk - storageOffset, 0.0), RASTER_QUANT_NODATA - 1.0);
+                    pBlock[((size_t)j << blockBitsX) + i] = (ui16_t)vk;
+
+                }
+            }
+
+            return err;
+        }
+
+        default: 
+            return read(pData, GDT_Float32);
+
+    }
+
+}
+
+inline float RasterBand::decodeValue(const float* pData, size_t i) const {
+
+    switch (_storage) {
+
+        case RasterStorage::UINT8: 
+            return reinterpret_cast<const ui8_t*>(pData)[i];
+
+        case RasterStorage::INT16: 
+            return reinterpret_cast<const int16_t*>(pData)[i];
+
+        case RasterStorage::UINT16: 
+            return reinterpret_cast<const ui16_t*>(pData)[i];
+
+        case RasterStorage::QUANT16: {
+            ui16_t c = reinterpret_cast<const ui16_t*>(pData)[i];
+            return c == RASTER_QUANT_NODATA ? (float)_noDataVal : (float)(c + storageOffset);
+        }
+
+        default: 
+            return pData[i];
+
+    }
+
+}
+
+float RasterBand::getValue(ui32_t u, ui32_t v) const {
+
+    const float* pData = getBlock(u >> blockBitsX, v >> blockBitsY);
+    return decodeValue(
+        pData, ((size_t)(v & (blockHeight - 1)) << blockBitsX) + (u & (blockWidth - 1))
+    );
+
+}
+
+inline ui32_t RasterBand::getCell(ui32_t u, ui32_t v, float* val) const {
+
+    const float noData = (float)_noDataVal;
+
+    ui32_t lu = u & (blockWidth - 1); 
+    ui32_t lv = v & (blockHeight - 1);
+
+    /* Cells within a single block are read with one lookup. The block pixels beyond the 
+     * band limits are no data ones, thus they need no check. */
+    if (lu + 1 < blockWidth && lv + 1 < blockHeight) {
+
+        const float* pData = getBlock(u >> blockBitsX, v >> blockBitsY);
+        size_t i = ((size_t)lv << blockBitsX) + lu;
+
+        val[0] = decodeValue(pData, i); 
+        val[1] = decodeValue(pData, i + 1); 
+        val[2] = decodeValue(pData, i + blockWidth); 
+        val[3] = decodeValue(pData, i + blockWidth + 1);
+
+    } else {
+
+        bool hu = u + 1 < _width, hv = v + 1 < _height;
+
+        val[0] = getValue(u, v); 
+        val[1] = hu ? getValue(u + 1, v) : noData; 
+        val[2] = hv ? getValue(u, v + 1) : noData; 
+        val[3] = hu && hv ? getValue(u + 1, v + 1) : noData;
+
+    }
+
+    return (ui32_t)(val[0] != noData) | (ui32_t)(val[1] != noData) << 1 | 
+           (ui32_t)(val[2] != noData) << 2 | (ui32_t)(val[3] != noData) << 3;
+
+}
+
+double RasterBand::interpolate(const point2& pix) const {
+    double h; 
+    interpolate(1, &pix.e[0], &pix.e[1], &h);
+    return h;
+}
+
+void RasterBand::interpolate(size_t n, const double* x, const double* y, double* h) const {
+
+    ui32_t u[MAX_RASTER_BATCH], v[MAX_RASTER_BATCH]; 
+    double w[4][MAX_RASTER_BATCH];
+
+    float val[4];
+    double hk, dk;
+    ui32_t mask; 
+
+    for (size_t k = 0; k < n; k += MAX_RASTER_BATCH) {
+
+        size_t m = MIN(n - k, MAX_RASTER_BATCH);
+
+        // This loop has no branches, so that the compiler can vectorise it
+        for (size_t j = 0; j < m; j++) {
+
+            u[j] = (ui32_t)x[k+j]; 
+            v[j] = (ui32_t)y[k+j];
+
+            double a = x[k+j] - u[j], b = y[k+j] - v[j];
+
+            w[0][j] = (1.0 - a)*(1.0 - b); 
+            w[1][j] = a*(1.0 - b); 
+            w[2][j] = (1.0 - a)*b; 
+            w[3][j] = a*b;
+
+        }
+
+        for (size_t j = 0; j < m; j++) {
+
+            mask = getCell(u[j], v[j], val);
+
+            if (mask == 0xF) {
+                hk = w[0][j]*val[0] + w[1][j]*val[1] + w[2][j]*val[2] + w[3][j]*val[3];
+            } else {
+
+                // The weights of the pixels with data are normalised
+                hk = 0.0; 
+                dk = 0.0;
+                for (ui32_t i = 0; i < 4; i++) {
+                    if (mask & (1u << i)) {
+                        hk += w[i][j]*val[i]; 
+                        dk += w[i][j];
+                    }
+                }
+
+                hk /= dk;
+
+            }
+
+            h[k+j] = _scale*hk + _offset;
+
+        }
+    }
+
+}
+
+float RasterBand::getOverviewValue(ui32_t level, ui32_t u, ui32_t v) const {
+
+    if (level == 0) {
+        return getValue(u, v);
+    }
+
+    size_t b = (size_t)(v >> blockBitsY)*overviewBlocksX[level] + (u >> blockBitsX);
+    const float* pData = table->overviews[level-1]->blocks[b].load(std::memory_order_acquire);
+    if (!pData) {
+        pData = loadOverviewBlock(level, b);
+    }
+
+    return pData[((size_t)(v & (blockHeight - 1)) << blockBitsX) + (u & (blockWidth - 1))];
+
+}
+
+const float* RasterBand::loadOverviewBlock(ui32_t level, size_t b) const {
+
+    /* The finer levels are accessed with this lock held, which is safe since the locks 
+     * are always acquired from the coarsest level to the band. */
+    RasterBlockTable& t = *table->overviews[level-1];
+    std::lock_guard<std::mutex> lock(t.mutex);
+
+    const float* pBlock = t.blocks[b].load(std::memory_order_relaxed);
+    if (pBlock) {
+        return pBlock;
+    }
+
+    ui32_t x0 = (b % overviewBlocksX[level])*blockWidth; 
+    ui32_t y0 = (b / overviewBlocksX[level])*blockHeight;
+
+    ui32_t w = MIN(blockWidth, overviewWidth[level] - x0); 
+    ui32_t h = MIN(blockHeight, overviewHeight[level] - y0);
+
+    size_t n = (size_t)blockWidth*blockHeight; 
+    float* pData = RasterBlockTable::allocate(n);
+    std::fill(pData, pData + n, (float)_noDataVal);
+
+    if (overviewBands[level]) {
+
+        /* The overviews belong to the band dataset, thus their reads are serialised with 
+         * those of the band blocks. */
+        CPLErr err;
+        {
+            std::lock_guard<std::mutex> lock(*ioMutex);
+            err = overviewBands[level]->RasterIO(
+                GF_Read, x0, y0, w, h, pData, w, h, GDT_Float32, sizeof(float), 
+                (GSpacing)blockWidth*sizeof(float)
+            );
+        }
+
+        if (err != CE_None) {
+            RasterBlockTable::release(pData);
+            throw std::runtime_error("failed to retrieve raster band overview data");
+        }
+
+    } else {
+
+        // Each pixel reduces the pixels with data of the 2x2 tile below it
+        ui32_t wf = overviewWidth[level-1], hf = overviewHeight[level-1];
+        float noData = (float)_noDataVal;
+
+        for (ui32_t j = 0; j < h; j++) {
+            for (ui32_t i = 0; i < w; i++) {
+
+                ui32_t u0 = 2*(x0 + i), v0 = 2*(y0 + j);
+                double acc = 0.0; 
+                ui32_t cnt = 0;
+
+                for (ui32_t v = v0; v < MIN(v0 + 2, hf); v++) {
+                    for (ui32_t u = u0; u < MIN(u0 + 2, wf); u++) {
+
+                        float x = getOverviewValue(level - 1, u, v);
+                        if (x == noData || std::isnan(x)) {
+                            continue;
+                        }
+
+                        if (cnt == 0) {
+                            acc = x;
+                        } else if (overviewMode == OverviewReduction::MIN) {
+                            acc = MIN(acc, x);
+                        } else if (overviewMode == OverviewReduction::MAX) {
+                            acc = MAX(acc, x);
+                        } else {
+                            acc += x;
+                        }
+
+                        cnt++;
+                    }
+                }
+
+                if (cnt > 0) {
+                    if (overviewMode == OverviewReduction::MEAN) {
+                        acc /= cnt;
+                    }
+                    pData[(size_t)j*blockWidth + i] = (float)acc;
+                }
+            }
+        }
+    }
+
+    t.blocks[b].store(pData, std::memory_order_release); 
+    t.nLoaded++;
+
+    return pData;
+
+}
+
+float RasterBand::getLevelValue(size_t k, ui32_t i, ui32_t j) const {
+
+    if (k >= nBlockLevels) {
+        return table->pyramid[k - nBlockLevels][j*pyramidWidth[k] + i].load(
+            std::memory_order_relaxed
+        );
+    }
+
+    // Retrieve the block containing the tile and the tile position within its level
+    ui32_t bx = blockBitsX - (k+1); 
+    ui32_t by = blockBitsY - (k+1);
+
+    const float* pData = getBlock(i >> bx, j >> by);
+    return pData[
+        levelOffset[k] + ((size_t)(j & ((1u << by) - 1)) << bx) + (i & ((1u << bx) - 1))
+    ];
+
+}
+
+bool RasterBand::peekValue(int k, ui32_t i, ui32_t j, float& val) const {
+
+    if (k >= (int)nBlockLevels) {
+        val = table->pyramid[k - nBlockLevels][j*pyramidWidth[k] + i].load(
+            std::memory_order_relaxed
+        );
+        return true;
+    }
+
+    // Retrieve the block containing the tile and the tile position within its level
+    ui32_t bx = blockBitsX - (k+1); 
+    ui32_t by = blockBitsY - (k+1);
+
+    const float* pData = table->blocks[(size_t)(j >> by)*nBlocksX + (i >> bx)].load(
+        std::memory_order_acquire
+    );
+
+    if (!pData) {
+        return false;
+    }
+
+    size_t offset = ((size_t)(j & ((1u << by) - 1)) << bx) + (i & ((1u << bx) - 1));
+    val = k >= 0 ? pData[levelOffset[k] + offset] : decodeValue(pData, offset);
+    return true;
+
+}
+
+double RasterBand::getTileMax(ui32_t u, ui32_t v, size_t k) const {
+    // Retrieve the tile indexes at the desired level
+    return getLevelValue(k, u >> (k+1), v >> (k+1));
+}
+
+double RasterBand::getSafeDistance(const point2& pix, double h, double pixSize) const {
+
+    double d = 0.0, dk, hMax; 
+    ui32_t x0, x1, y0, y1;
+
+    ui32_t u = static_cast<ui32_t>(pix[0]); 
+    ui32_t v = static_cast<ui32_t>(pix[1]);
+
+    // The first levels are all stored within the block containing the pixel 
+    const float* pBlock = getBlock(u >> blockBitsX, v >> blockBitsY); 
+    ui32_t lu = u & (blockWidth - 1); 
+    ui32_t lv = v & (blockHeight - 1);
+
+    for (size_t k = 0; k < nLevels; k++) {
+
+        /* Since the tile maximum can only increase with the level, once the vertical 
+         * clearance drops below the current distance the larger tiles can't improve it. */
+        if (k < nBlockLevels) {
+            hMax = pBlock[
+                levelOffset[k] + ((size_t)(lv >> (k+1)) << (blockBitsX - (k+1))) + 
+                (lu >> (k+1))
+            ];
+        } else {
+            hMax = table->pyramid[k - nBlockLevels][
+                (v >> (k+1))*pyramidWidth[k] + (u >> (k+1))
+            ].load(std::memory_order_relaxed);
+        }
+
+        if (h - hMax <= d) {
+            break;
+        }
+
+        /* Compute the first and last pixels of the tile. The last ones are decreased by 
+         * one so that interpolated samples never require pixels outside the tile. */
+        x0 = (u >> (k+1)) << (k+1); 
+        y0 = (v >> (k+1)) << (k+1);
+
+        x1 = MIN(x0 + (2 << k), _width) - 1; 
+        y1 = MIN(y0 + (2 << k), _height) - 1;
+
+        // Compute the distance, in pixels, from the closest tile edge.
+        dk = MIN(MIN(pix[0] - x0, x1 - pix[0]), MIN(pix[1] - y0, y1 - pix[1]));
+
+        /* The ray is safe as long as it remains above the tile maximum and its 
+         * footprint does not leave the tile. */
+        dk = MIN(h - hMax, dk*pixSize); 
+        d  = MAX(d, dk);
+
+    }
+
+    return d;
+
+}
+
+double RasterBand::getPyramidMaximum() const {
+
+    float val;
+    if (!table || nLevels == 0 || !peekValue((int)nLevels - 1, 0, 0, val)) {
+        return MAX(_scale*_vMin + _offset, _scale*_vMax + _offset);
+    }
+
+    return val;
+
+}
+
+TileCacheHeader RasterBand::getTileCacheHeader(const TileCacheHeader& header) const {
+
+    TileCacheHeader h = header; 
+
+    h.width  = _width; 
+    h.height = _height; 
+
+    h.blockWidth  = blockWidth; 
+    h.blockHeight = blockHeight; 
+    h.storage = (ui32_t)_storage;
+
+    h.noData = _noDataVal; 
+    h.vMin = _vMin; 
+    h.vMax = _vMax;
+
+    h.scale  = _scale; 
+    h.offset = _offset;
+
+    return h;
+
+}
+
+size_t RasterBand::getTileCacheStride() const {
+    size_t n = levelOffset.back()*sizeof(float); 
+    return (n + TILE_CACHE_ALIGNMENT - 1)/TILE_CACHE_ALIGNMENT*TILE_CACHE_ALIGNMENT;
+}
+
+size_t RasterBand::getTileCacheSize() const {
+
+    // Header and blocks
+    size_t n = TILE_CACHE_ALIGNMENT + (size_t)nBlocksX*nBlocksY*getTileCacheStride(); 
+
+    // Band-wide pyramid levels and slope tiles
+    for (size_t k = nBlockLevels; k < nLevels; k++) {
+        n += (size_t)pyramidWidth[k]*pyramidHeight[k]*sizeof(float);
+    }
+
+    return n + 2*(size_t)slopesWidth*slopesHeight*sizeof(float);
+
+}
+
+bool RasterBand::mapTileCache(
+    const std::filesystem::path& path, const TileCacheHeader& header
+) {
+
+    unloadData(); 
+
+    // Point each block to its location within the file
+    size_t nBlocks = (size_t)nBlocksX*nBlocksY; 
+    table = std::make_shared<RasterBlockTable>(nBlocks); 
+
+    // The band layout is required to validate the file size
+    initPyramid(); 
+    initSlopeMap();
+
+    size_t size = getTileCacheSize();
+
+    int fd = open(path.c_str(), O_RDONLY); 
+    if (fd < 0) {
+        unloadData();
+        return false;
+    }
+
+    struct stat st; 
+    void* pMap = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+        pMap = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0); 
+    }
+
+    // The mapping remains valid after the file is closed
+    close(fd); 
+
+    if (pMap == MAP_FAILED) {
+        unloadData();
+        return false;
+    }
+
+    std::shared_ptr<void> mapping(pMap, [size](void* p) { munmap(p, size); });
+
+    const char* pData = static_cast<const char*>(pMap);
+
+    TileCacheHeader h = getTileCacheHeader(header);
+    if (std::memcmp(pData, &h, sizeof(h)) != 0) {
+        unloadData();
+        return false;
+    }
+
+    size_t stride = getTileCacheStride(); 
+    table->mapping = mapping;
+
+    pData += TILE_CACHE_ALIGNMENT;
+    for (size_t b = 0; b < nBlocks; b++) {
+        table->blocks[b].store(reinterpret_cast<const float*>(pData));
+        pData += stride;
+    }
+
+    table->nLoaded = nBlocks;
+
+    // The overview levels are not cached, they are reduced from the mapped blocks
+    initOverviews();
+
+    // The band-wide structures are small, thus they are copied in memory
+    auto copy = [&pData](std::vector<std::atomic<float>>& dst) {
+        const float* src = reinterpret_cast<const float*>(pData);
+        for (size_t i = 0; i < dst.size(); i++) {
+            dst[i].store(src[i], std::memory_order_relaxed);
+        }
+        pData += dst.size()*sizeof(float);
+    };
+
+    for (std::vector<std::atomic<float>>& level : table->pyramid) {
+        copy(level);
+    }
+
+    copy(table->tileSlopes);
+    copy(table->slopes);
+
+    return true;
+
+}
+
+bool RasterBand::writeTileCache(
+    const std::filesystem::path& path, const TileCacheHeader& header
+) {
+
+    if (!isLoaded()) {
+        loadData();
+    }
+
+    /* Multiple processes might be writing the same cache, thus each of them writes its 
+     * own temporary file, which then atomically replaces the cache. */
+    std::filesystem::path tmpPath(path); 
+    tmpPath += ".tmp" + std::to_string(getpid());
+
+    std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    TileCacheHeader h = getTileCacheHeader(header);
+    std::vector<char> padding(TILE_CACHE_ALIGNMENT, 0); 
+
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h)); 
+    file.write(padding.data(), TILE_CACHE_ALIGNMENT - sizeof(h));
+
+    size_t n = levelOffset.back()*sizeof(float); 
+    size_t stride = getTileCacheStride();
+
+    /* A block is needed by the band-wide structures until the first band-wide pyramid 
+     * level and the slope tiles covering its pixels, or adjacent to them, are exact. */
+    auto isNeeded = [this](size_t b) {
+
+        ui32_t x0 = (b % nBlocksX)*blockWidth, y0 = (b / nBlocksX)*blockHeight;
+        ui32_t x1 = MIN(x0 + blockWidth, _width), y1 = MIN(y0 + blockHeight, _height);
+
+        if (nLevels > nBlockLevels) {
+            size_t k = nBlockLevels;
+            for (ui32_t j = y0 >> (k+1); j <= (y1 - 1) >> (k+1); j++) {
+                for (ui32_t i = x0 >> (k+1); i <= (x1 - 1) >> (k+1); i++) {
+                    if (!table->pyramidReady[0][(size_t)j*pyramidWidth[k] + i]) {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        ui32_t i0 = (x0 > 0 ? x0 - 1 : 0)/SLOPE_TILE_SIZE, i1 = (x1 - 1)/SLOPE_TILE_SIZE;
+        ui32_t j0 = (y0 > 0 ? y0 - 1 : 0)/SLOPE_TILE_SIZE, j1 = (y1 - 1)/SLOPE_TILE_SIZE;
+
+        for (ui32_t tj = j0; tj <= j1; tj++) {
+            for (ui32_t ti = i0; ti <= i1; ti++) {
+                if (!table->tileSlopesReady[(size_t)tj*slopesWidth + ti]) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+
+    };
+
+    /* The blocks are written in file order as they are read, and those read by this call 
+     * are released once the band-wide structures no longer need them, thus only a few 
+     * block rows are resident at any time, whatever the band size. */
+    std::vector<size_t> retained;
+    bool mapped = table->mapping != nullptr;
+
+    for (ui32_t bv = 0; bv < nBlocksY; bv++) {
+        for (ui32_t bu = 0; bu < nBlocksX; bu++) {
+
+            size_t b = (size_t)bv*nBlocksX + bu;
+            bool resident = table->blocks[b].load() != nullptr;
+
+            file.write(reinterpret_cast<const char*>(getBlock(bu, bv)), n); 
+            file.write(padding.data(), stride - n);
+
+            if (!resident && !mapped) {
+                retained.push_back(b);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(table->mutex);
+
+        size_t m = 0;
+        for (size_t b : retained) {
+            if (isNeeded(b)) {
+                retained[m++] = b;
+            } else {
+                RasterBlockTable::release(table->blocks[b].exchange(nullptr));
+                table->nLoaded--;
+            }
+        }
+
+        retained.resize(m);
+    }
+
+    // Every block has been read once, thus the band-wide structures are now exact
+    bool exact = retained.empty();
+    for (const std::vector<bool>& levelReady : table->pyramidReady) {
+        exact &= std::find(levelReady.begin(), levelReady.end(), false) == levelReady.end();
+    }
+
+    exact &= std::find(
+        table->tileSlopesReady.begin(), table->tileSlopesReady.end(), false
+    ) == table->tileSlopesReady.end();
+
+    auto write = [&file](const std::vector<std::atomic<float>>& src) {
+        std::vector<float> buffer(src.size());
+        for (size_t i = 0; i < src.size(); i++) {
+            buffer[i] = src[i].load(std::memory_order_relaxed);
+        }
+        file.write(
+            reinterpret_cast<const char*>(buffer.data()), buffer.size()*sizeof(float)
+        );
+    };
+
+    for (const std::vector<std::atomic<float>>& level : table->pyramid) {
+        write(level);
+    }
+
+    write(table->tileSlopes);
+    write(table->slopes);
+    file.close();
+
+    std::error_code ec;
+    if (file && exact) {
+        std::filesystem::rename(tmpPath, path, ec);
+    }
+
+    if (!file || !exact || ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+
+    return true;
+
+}
+
+void RasterBand::initPyramid() {
+
+    table->pyramid.clear(); 
+    table->pyramidReady.clear();
+    pyramidWidth.clear();
+    pyramidHeight.clear();
+    levelOffset.clear();
+
+    // Compute the size of each level
+    ui32_t w = _width, h = _height;
+    while (w > 1 || h > 1) {
+
+        w = (w + 1)/2; 
+        h = (h + 1)/2; 
+
+        pyramidWidth.push_back(w);
+        pyramidHeight.push_back(h);
+
+    }
+
+    nLevels = pyramidWidth.size();
+
+    /* The levels whose tiles fit within a block are stored after the block data, whose 
+     * size depends on the band storage. The offsets are in floats, and the last one is 
+     * the total size of a block. */
+    size_t nBytes = sizeof(float);
+    switch (_storage) {
+        case RasterStorage::UINT8: nBytes = 1; break;
+        case RasterStorage::INT16: 
+        case RasterStorage::UINT16: 
+        case RasterStorage::QUANT16: nBytes = 2; break;
+        default: break;
+    }
+
+    levelOffset.push_back(((size_t)blockWidth*blockHeight*nBytes + 3)/sizeof(float));
+
+    nBlockLevels = 0;
+    size_t n;
+
+    while (nBlockLevels < nLevels && 
+           (2u << nBlockLevels) <= MIN(blockWidth, blockHeight)) {
+        n = (size_t)(blockWidth >> (nBlockLevels+1))*(blockHeight >> (nBlockLevels+1));
+        levelOffset.push_back(levelOffset.back() + n);
+        nBlockLevels++;
+    }
+
+    /* The remaining levels initially store the band maximum, which is a valid bound for 
+     * any tile until its blocks are loaded. */
+    float vMax = (float)MAX(_scale*_vMin + _offset, _scale*_vMax + _offset);
+    for (size_t k = nBlockLevels; k < nLevels; k++) {
+
+        n = (size_t)pyramidWidth[k]*pyramidHeight[k];
+
+        table->pyramid.emplace_back(n);
+        for (std::atomic<float>& vk : table->pyramid.back()) {
+            vk.store(vMax, std::memory_order_relaxed);
+        }
+
+        table->pyramidReady.emplace_back(n, false);
+    }
+
+}
+
+void RasterBand::buildBlockPyramid(float* pData) const {
+
+    const float minVal = -std::numeric_limits<float>::infinity();
+
+    float vk; 
+    const float* src = pData; 
+    ui32_t w = blockWidth;
+
+    for (size_t k = 0; k < nBlockLevels; k++) {
+
+        float* level = pData + levelOffset[k]; 
+
+        ui32_t wk = blockWidth >> (k+1); 
+        ui32_t hk = blockHeight >> (k+1); 
+
+        std::fill(level, level + (size_t)wk*hk, minVal);
+
+        for (ui32_t j = 0; j < 2*hk; j++) {
+            for (ui32_t i = 0; i < 2*wk; i++) {
+
+                vk = k > 0 ? src[(size_t)j*w + i] : decodeValue(pData, (size_t)j*w + i); 
+
+                if (k == 0) {
+                    /* The first level is built from the raw band data, excluding the no 
+                     * data pixels and converting the values in physical units. */
+                    if (vk == _noDataVal || std::isnan(vk)) {
+                        continue; 
+                    }
+
+                    vk = _scale*vk + _offset;
+                }
+
+                float& lk = level[(size_t)(j/2)*wk + i/2];
+                lk = vk > lk ? vk : lk;
+
+            }
+        }
+
+        src = level; 
+        w = wk;
+
+    }
+
+}
+
+void RasterBand::updatePyramid(ui32_t x0, ui32_t y0, ui32_t x1, ui32_t y1) const {
+
+    const float minVal = -std::numeric_limits<float>::infinity();
+
+    float vk, vc; 
+    ui32_t w, h;
+    bool ready;
+
+    for (size_t k = nBlockLevels; k < nLevels; k++) {
+
+        // Size of the children level
+        w = k > 0 ? pyramidWidth[k-1] : _width; 
+        h = k > 0 ? pyramidHeight[k-1] : _height;
+
+        std::vector<std::atomic<float>>& level = table->pyramid[k - nBlockLevels]; 
+        std::vector<bool>& levelReady = table->pyramidReady[k - nBlockLevels];
+
+        /* Each tile containing the updated pixels is built from its children once they 
+         * are all exact, i.e., once all the blocks below the tile are loaded. */
+        for (ui32_t j = y0 >> (k+1); j <= (y1 - 1) >> (k+1); j++) {
+            for (ui32_t i = x0 >> (k+1); i <= (x1 - 1) >> (k+1); i++) {
+
+                size_t t = (size_t)j*pyramidWidth[k] + i;
+                if (levelReady[t]) {
+                    continue;
+                }
+
+                vk = minVal;
+                ready = true;
+
+                for (ui32_t jj = 2*j; jj < MIN(2*j + 2, h) && ready; jj++) {
+                    for (ui32_t ii = 2*i; ii < MIN(2*i + 2, w) && ready; ii++) {
+
+                        if (k > nBlockLevels) {
+                            ready = table->pyramidReady[k - nBlockLevels - 1][
+                                (size_t)jj*w + ii
+                            ];
+                        }
+
+                        if (!ready || !peekValue((int)k - 1, ii, jj, vc)) {
+                            ready = false;
+                            continue;
+                        }
+
+                        if (k == 0) {
+                            if (vc == _noDataVal || std::isnan(vc)) {
+                                continue;
+                            }
+                            vc = _scale*vc + _offset;
+                        }
+
+                        vk = vc > vk ? vc : vk;
+                    }
+                }
+
+                if (ready) {
+                    level[t].store(vk, std::memory_order_relaxed);
+                    levelReady[t] = true;
+                }
+            }
+        }
+    }
+
+}
+
+void RasterBand::initSlopeMap() {
+
+    const float maxVal = std::numeric_limits<float>::infinity();
+
+    slopesWidth  = (_width + SLOPE_TILE_SIZE - 1)/SLOPE_TILE_SIZE; 
+    slopesHeight = (_height + SLOPE_TILE_SIZE - 1)/SLOPE_TILE_SIZE;
+
+    // The slopes of the tiles are unbounded until their blocks are loaded
+    size_t nTiles = (size_t)slopesWidth*slopesHeight;
+
+    table->tileSlopes = std::vector<std::atomic<float>>(nTiles);
+    table->slopes = std::vector<std::atomic<float>>(nTiles);
+
+    for (size_t i = 0; i < nTiles; i++) {
+        table->tileSlopes[i].store(maxVal, std::memory_order_relaxed);
+        table->slopes[i].store(maxVal, std::memory_order_relaxed);
+    }
+
+    table->tileSlopesReady.assign(nTiles, false);
+
+}
+
+void RasterBand::updateSlopeMap(ui32_t x0, ui32_t y0, ui32_t x1, ui32_t y1) const {
+
+    const float maxVal = std::numeric_limits<float>::infinity();
+
+    auto isValid = [this](float vk) { return vk != _noDataVal && !std::isnan(vk); };
+
+    // Check whether all the blocks covering the pixels within [xa, xb) x [ya, yb) are loaded
+    auto isLoaded = [this](ui32_t xa, ui32_t ya, ui32_t xb, ui32_t yb) {
+        for (ui32_t bv = ya >> blockBitsY; bv <= (yb - 1) >> blockBitsY; bv++) {
+            for (ui32_t bu = xa >> blockBitsX; bu <= (xb - 1) >> blockBitsX; bu++) {
+                size_t b = (size_t)bv*nBlocksX + bu;
+                if (!table->blocks[b].load(std::memory_order_relaxed)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    /* The tiles are affected by the updated pixels if they contain them or if their 
+     * last column or row is adjacent to them. */
+    ui32_t i0 = (x0 > 0 ? x0 - 1 : 0)/SLOPE_TILE_SIZE, i1 = (x1 - 1)/SLOPE_TILE_SIZE;
+    ui32_t j0 = (y0 > 0 ? y0 - 1 : 0)/SLOPE_TILE_SIZE, j1 = (y1 - 1)/SLOPE_TILE_SIZE;
+
+    float v0, v1, dx, dy; 
+    ui32_t ue, ve;
+    bool valid;
+
+    for (ui32_t tj = j0; tj <= j1; tj++) {
+        for (ui32_t ti = i0; ti <= i1; ti++) {
+
+            size_t t = (size_t)tj*slopesWidth + ti;
+            if (table->tileSlopesReady[t]) {
+                continue;
+            }
+
+            ue = MIN((ti + 1)*SLOPE_TILE_SIZE, _width); 
+            ve = MIN((tj + 1)*SLOPE_TILE_SIZE, _height);
+
+            /* The tile is only computed once the tile pixels, together with the column 
+             * on its right and the row below it, are all loaded. */
+            if (!isLoaded(ti*SLOPE_TILE_SIZE, tj*SLOPE_TILE_SIZE, MIN(ue + 1, _width), ve) ||
+                !isLoaded(ti*SLOPE_TILE_SIZE, tj*SLOPE_TILE_SIZE, ue, MIN(ve + 1, _height))) {
+                continue;
+            }
+
+            /* Within each cell, the derivatives of the bilinear surface are bounded by 
+             * the largest differences along the cell edges, thus the maximum differences 
+             * between adjacent pixels are retrieved for each tile. */
+            dx = 0.0f; 
+            dy = 0.0f; 
+
+            for (ui32_t j = tj*SLOPE_TILE_SIZE; j < ve; j++) {
+                for (ui32_t i = ti*SLOPE_TILE_SIZE; i < ue; i++) {
+
+                    valid = peekValue(-1, i, j, v0) && isValid(v0);
+
+                    if (i + 1 < _width && dx < maxVal) {
+                        if (valid && peekValue(-1, i + 1, j, v1) && isValid(v1)) {
+                            dx = MAX(dx, fabs(v1 - v0));
+                        } else {
+                            dx = maxVal;
+                        }
+                    }
+
+                    if (j + 1 < _height && dy < maxVal) {
+                        if (valid && peekValue(-1, i, j + 1, v1) && isValid(v1)) {
+                            dy = MAX(dy, fabs(v1 - v0));
+                        } else {
+                            dy = maxVal;
+                        }
+                    }
+                }
+            }
+
+            table->tileSlopes[t].store(
+                fabs(_scale)*sqrt(dx*dx + dy*dy), std::memory_order_relaxed
+            );
+            table->tileSlopesReady[t] = true;
+        }
+    }
+
+    /* The footprint of a ray can leave its tile during a step, thus each tile stores the 
+     * maximum slope among itself and its neighbours, once all of them are exact. */
+    float gk; 
+    bool ready;
+    for (ui32_t j = (j0 > 0 ? j0 - 1 : 0); j < MIN(j1 + 2, slopesHeight); j++) {
+        for (ui32_t i = (i0 > 0 ? i0 - 1 : 0); i < MIN(i1 + 2, slopesWidth); i++) {
+
+            gk = 0.0f; 
+            ready = true;
+            for (ui32_t jj = (j > 0 ? j - 1 : 0); jj < MIN(j + 2, slopesHeight); jj++) {
+                for (ui32_t ii = (i > 0 ? i - 1 : 0); ii < MIN(i + 2, slopesWidth); ii++) {
+                    size_t t = (size_t)jj*slopesWidth + ii;
+                    ready = ready && table->tileSlopesReady[t];
+                    gk = MAX(gk, table->tileSlopes[t].load(std::memory_order_relaxed)); 
+                }
+            }
+
+            if (ready) {
+                table->slopes[(size_t)j*slopesWidth + i].store(gk, std::memory_order_relaxed);
+            }
+        }
+    }
+
+}
+
+double RasterBand::getTileSlope(ui32_t u, ui32_t v) const {
+    return table->slopes[(v/SLOPE_TILE_SIZE)*slopesWidth + u/SLOPE_TILE_SIZE].load(
+        std::memory_order_relaxed
+    );
+}
+
+double RasterBand::getSlopeDistance(
+    const point2& pix, double h, double a, double b, double pixSize
+) const {
+
+    if (!table || table->slopes.empty()) {
+        return 0.0;
+    }
+
+    ui32_t u = static_cast<ui32_t>(pix[0]); 
+    ui32_t v = static_cast<ui32_t>(pix[1]);
+
+    double g = getTileSlope(u, v); 
+    if (std::isinf(g)) {
+        return 0.0;
+    }
+
+    // The sample might be interpolated, thus the height is measured from the cell top
+    h -= getCellMaximum(u, v); 
+    if (h <= 0.0) {
+        return 0.0;
+    }
+
+    /* The slope bound holds as long as the footprint does not leave the neighbours of its 
+     * tile, i.e., for one tile beyond the closest edge of the current one. */
+    ui32_t x0 = (u/SLOPE_TILE_SIZE)*SLOPE_TILE_SIZE; 
+    ui32_t y0 = (v/SLOPE_TILE_SIZE)*SLOPE_TILE_SIZE; 
+
+    double dk = MIN(
+        MIN(pix[0] - x0, x0 + SLOPE_TILE_SIZE - pix[0]), 
+        MIN(pix[1] - y0, y0 + SLOPE_TILE_SIZE - pix[1])
+    );
+
+    dk = (dk + SLOPE_TILE_SIZE)*pixSize;
+
+    /* The vertical clearance decreases, at most, with the descent rate of the ray plus 
+     * the surface rise along its horizontal motion. Rays moving upwards are 
+     * conservatively treated as horizontal ones. */
+    double rate = MAX(b, 0.0) + g*a/pixSize; 
+    double d = rate > 0.0 ? h/rate : inf;
+
+    return a > 0.0 ? MIN(d, dk/a) : d;
+
+}
+
+double RasterBand::getCellMaximum(ui32_t u, ui32_t v) const {
+
+    double hMax = -inf, hk; 
+    for (ui32_t j = v; j < MIN(v + 2, _height); j++) {
+        for (ui32_t i = u; i < MIN(u + 2, _width); i++) {
+            hk = getValue(i, j);
+            if (hk != _noDataVal && !std::isnan(hk)) {
+                hMax = MAX(hMax, _scale*hk + _offset);
+            }
+        }
+    }
+
+    return hMax;
+
+}
+
+void RasterBand::buildConeMap(double maxRatio) {
+
+    // The cones depend on the whole band data
+    loadBlocks();
+
+    cones = std::vector<float>((size_t)_width*_height, 0.0f);
+    for (ui32_t v = 0; v < _height; v++) {
+        for (ui32_t u = 0; u < _width; u++) {
+            cones[(size_t)v*_width + u] = computeConeRatio(u, v, maxRatio);
+        }
+    }
+
+}
+
+void RasterBand::setConeMap(std::vector<float> map) {
+
+    if (map.size() != (size_t)_width*_height) {
+        throw std::runtime_error("cone-step map size does not match the band size");
+    }
+
+    cones = std::move(map);
+
+}
+
+double RasterBand::getConeDistance(
+    const point2& pix, double h, double a, double b, double pixSize
+) const {
+
+    ui32_t u = static_cast<ui32_t>(pix[0]); 
+    ui32_t v = static_cast<ui32_t>(pix[1]);
+
+    double c = cones[(size_t)v*_width + u];
+    if (c <= 0.0) {
+        return 0.0; 
+    }
+
+    // The ray height is measured from the cone apex, i.e., the highest cell corner
+    h -= getCellMaximum(u, v); 
+    if (h <= 0.0) {
+        return 0.0;
+    }
+
+    /* The ray leaves the cone when its horizontal displacement, scaled by the cone 
+     * ratio, exceeds its residual height above the apex, which lies one pixel behind 
+     * the cell. Rays moving upwards are conservatively treated as horizontal ones. */
+    c *= pixSize;
+    return MAX(c*h - pixSize, 0.0)/(a + c*MAX(b, 0.0));
+
+}
+
+SegmentHit RasterBand::intersectSegment(
+    const point2& p0, const point2& p1, const point3& h, double& x
+) const {
+
+    // Coefficients of the segment height as a quadratic function of its fraction
+    double a0 = h[0]; 
+    double a1 = 4*h[1] - 3*h[0] - h[2];
+    double a2 = 2*h[0] + 2*h[2] - 4*h[1];
+
+    point2 dp = p1 - p0;
+
+    // Setup the traversal of the cells crossed by the segment footprint
+    int i = static_cast<int>(floor(p0[0])); 
+    int j = static_cast<int>(floor(p0[1]));
+
+    int si = dp[0] >= 0 ? 1 : -1; 
+    int sj = dp[1] >= 0 ? 1 : -1;
+
+    // Segment fractions at which the next cell boundaries are crossed
+    double xu = dp[0] != 0 ? ((si > 0 ? i + 1 : i) - p0[0])/dp[0] : inf;
+    double xv = dp[1] != 0 ? ((sj > 0 ? j + 1 : j) - p0[1])/dp[1] : inf; 
+
+    double du = dp[0] != 0 ? si/dp[0] : inf; 
+    double dv = dp[1] != 0 ? sj/dp[1] : inf;
+
+    double xa = 0.0, xb, hc[4], ha, hb, hab; 
+    double u0, v0, c0, c1, c2, d, q, r, r1, r2;
+    float hk; 
+
+    while (true) {
+
+        /* Retrieve the cell corners, which must all be valid. The last row and column 
+         * are extended beyond the band limits. */
+        if (i < 0 || j < 0 || i >= (int)_width || j >= (int)_height) {
+            return SegmentHit::UNKNOWN;
+        }
+
+        for (int k = 0; k < 4; k++) {
+            hk = getValue(MIN(i + k%2, (int)_width - 1), MIN(j + k/2, (int)_height - 1));
+            if (hk == _noDataVal || std::isnan(hk)) {
+                return SegmentHit::UNKNOWN; 
+            }
+
+            hc[k] = _scale*hk + _offset;
+        }
+
+        xb = MIN(MIN(xu, xv), 1.0);
+
+        /* Along the segment, the bilinear patch is a quadratic function of the segment 
+         * fraction, thus the difference between the segment and surface heights is a 
+         * quadratic polynomial whose coefficients are computed below. */
+        u0 = p0[0] - i; 
+        v0 = p0[1] - j; 
+
+        ha  = hc[1] - hc[0];
+        hb  = hc[2] - hc[0];
+        hab = hc[0] - hc[1] - hc[2] + hc[3];
+
+        c0 = a0 - (hc[0] + ha*u0 + hb*v0 + hab*u0*v0); 
+        c1 = a1 - (ha*dp[0] + hb*dp[1] + hab*(u0*dp[1] + v0*dp[0])); 
+        c2 = a2 - hab*dp[0]*dp[1];
+
+        // The segment enters the cell below the surface
+        if (c0 + xa*(c1 + xa*c2) <= 0.0) {
+            x = xa; 
+            return SegmentHit::HIT;
+        }
+
+        // Retrieve the smallest root within the cell, if any
+        r = inf;
+        if (fabs(c2) <= 1e-12*(fabs(c1) + fabs(c0))) {
+            if (c1 != 0.0) {
+                r = -c0/c1;
+            }
+        } else if ((d = c1*c1 - 4*c2*c0) >= 0.0) {
+            // Numerically stable computation of the two roots
+            q  = -0.5*(c1 + (c1 >= 0 ? sqrt(d) : -sqrt(d)));
+            r1 = q/c2; 
+            r2 = q != 0.0 ? c0/q : inf;
+
+            if (r1 > r2) {
+                std::swap(r1, r2);
+            }
+
+            r = r1 > xa ? r1 : r2;
+        }
+
+        if (r > xa && r <= xb) {
+            x = r; 
+            return SegmentHit::HIT;
+        }
+
+        if (xb >= 1.0) {
+            return SegmentHit::NONE;
+        }
+
+        // Move to the next cell
+        if (xu < xv) {
+            i += si; 
+            xu += du;
+        } else {
+            j += sj; 
+            xv += dv;
+        }
+
+        xa = xb;
+
+    }
+
+}
+
+float RasterBand::computeConeRatio(ui32_t u, ui32_t v, double maxRatio) const {
+
+    /* The cone bounds the rays anywhere above the cell with corner on the pixel, thus 
+     * its apex lies on the highest corner of such cell. */
+    double h0 = getCellMaximum(u, v); 
+    if (std::isinf(h0)) {
+        return 0.0f;
+    }
+
+    /* The pyramid is traversed from its top level, discarding all the tiles whose 
+     * maximum value can't narrow the widest cone found so far. The level index is 
+     * shifted by one so that level 0 represents the band pixels. */
+    struct Tile { ui32_t i, j, k; double r; };
+
+    std::vector<Tile> stack; 
+    stack.push_back({0, 0, static_cast<ui32_t>(nLevels), 0.0});
+
+    double r = maxRatio, dx, dy, rk;
+    Tile children[4]; 
+    size_t nChildren;
+
+    ui32_t n, x0, y0, x1, y1, w, h;
+    double hk;
+
+    while (!stack.empty()) {
+
+        Tile t = stack.back(); 
+        stack.pop_back();
+
+        // The cone might have been narrowed since the tile was queued
+        if (t.r >= r || t.k == 0) {
+            continue;
+        }
+
+        // Retrieve the size of the children level
+        n = 1 << (t.k - 1); 
+        w = t.k > 1 ? pyramidWidth[t.k - 2] : _width;
+        h = t.k > 1 ? pyramidHeight[t.k - 2] : _height;
+
+        nChildren = 0;
+        for (ui32_t j = 2*t.j; j < MIN(2*t.j + 2, h); j++) {
+            for (ui32_t i = 2*t.i; i < MIN(2*t.i + 2, w); i++) {
+
+                if (t.k > 1) {
+                    hk = getLevelValue(t.k - 2, i, j);
+                } else {
+                    hk = getValue(i, j); 
+                    if (hk == _noDataVal || std::isnan(hk)) {
+                        continue;
+                    }
+
+                    hk = _scale*hk + _offset;
+                }
+
+                if (hk <= h0) {
+                    continue;
+                }
+
+                /* A pixel only raises the bilinear surface within the 4 cells sharing it, 
+                 * thus the gap between the tile pixels and the cell [u, u+1] x [v, v+1]
+                 * is shrunk by one pixel on each side. */
+                x0 = i*n; x1 = MIN(x0 + n, _width) - 1; 
+                y0 = j*n; y1 = MIN(y0 + n, _height) - 1;
+
+                dx = u + 2 < x0 ? x0 - u - 2 : (u > x1 + 1 ? u - x1 - 1 : 0.0); 
+                dy = v + 2 < y0 ? y0 - v - 2 : (v > y1 + 1 ? v - y1 - 1 : 0.0);
+
+                /* Lower bound of the cone ratio within the tile. The apex is moved one 
+                 * pixel back, so that the cone still has a width where the gap is zero. */
+                rk = (sqrt(dx*dx + dy*dy) + 1.0)/(hk - h0);
+                if (rk >= r) {
+                    continue; 
+                }
+
+                if (t.k > 1) {
+                    children[nChildren++] = {i, j, t.k - 1, rk};
+                } else {
+                    r = rk;
+                }
+            }
+        }
+
+        /* Queue the children so that those closer to the cone apex are processed first, 
+         * quickly narrowing the cone and allowing to discard more tiles. */
+        std::sort(children, children + nChildren, [](const Tile& a, const Tile& b) {
+            return a.r > b.r; 
+        });
+
+        for (size_t k = 0; k < nChildren; k++) {
+            stack.push_back(children[k]);
+        }
+
+    }
+
+    return r;
+
+}
+
+
+/* -------------------------------------------------------
+                    DATASET CONTAINER 
+---------------------------------------------------------- */
+
+RasterFile::RasterFile(const RasterDescriptor& desc, size_t nThreads) : _nThreads(nThreads)
+{
+    // Retrieve the raster name
+    std::string file = desc.filename;
+
+    // Generate filepath object
+    filepath = std::filesystem::path(file); 
+
+    // Retrieve filename 
+    filename = filepath.filename().string(); 
+
+    pDataset = std::shared_ptr<GDALDataset>(
+        (GDALDataset *) GDALOpen(file.c_str(), GA_ReadOnly), GDALClose
+    );
+
+    // Check whether it is a valid Dataset pointer
+    if (pDataset == NULL) {
+        throw std::runtime_error("failed to open the dataset. Invalid pointer detected.");
+    }
+
+    // Retrieve dataset parameters. 
+    _width  = (ui32_t)pDataset->GetRasterXSize(); 
+    _height = (ui32_t)pDataset->GetRasterYSize(); 
+    _rasterCount  = (size_t)pDataset->GetRasterCount(); 
+
+    // Retrieve the Affine transformation of the projection
+    double adf[6]; 
+
+    if (pDataset->GetGeoTransform(adf) == CE_None) {
+        transform = Affine(adf); 
+    } else {
+        transform = Affine(); 
+    }
+
+    // Update the raster's reference system projection
+    updateReferenceSystem();
+    mapCRS = *pDataset->GetSpatialRef();
+
+    // Retrieve all raster bands
+    bands.reserve((size_t)_rasterCount); 
+    for (size_t k = 0; k < _rasterCount; k++) {
+        bands.push_back(RasterBand(desc, pDataset, (int)k+1));
+        bands.back().attach(pDataset->GetRasterBand((int)k+1), ioMutex);
+    }
+
+    initialize(desc);
+
+}
+
+RasterFile::RasterFile(
+    const RasterDescriptor& desc, const RasterMetadata& m, size_t nThreads
+) : _nThreads(nThreads) {
+
+    filepath = std::filesystem::path(desc.filename); 
+    filename = filepath.filename().string(); 
+
+    _width  = m.width; 
+    _height = m.height; 
+    _rasterCount = m.bands.size();
+
+    transform = Affine(
+        m.transform[0], m.transform[1], m.transform[2], 
+        m.transform[3], m.transform[4], m.transform[5]
+    );
+
+    // Datasets return their reference system with the longitude (or easting) first
+    mapCRS.importFromWkt(m.wkt.c_str()); 
+    mapCRS.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+    bands.reserve(_rasterCount); 
+    for (size_t k = 0; k < _rasterCount; k++) {
+        bands.push_back(RasterBand(desc, m.bands[k]));
+    }
+
+    initialize(desc);
+
+}
+
+void RasterFile::initialize(const RasterDescriptor& desc) {
+
+    iTransform = inverse(transform);
+
+    // Compute the coordinates of the bottom-right pixel
+    point2 p = transform*point2(_width, _height);
+
+    // Compute the map projection coordinates limits 
+    _left = transform[2];
+    _top  = transform[5];
+
+    _right  = p[0];
+    _bottom = p[1];
+
+    // Retrieve the raster highest resolution from the Affine transform if not specified
+    _resolution = desc.res > 0 ? desc.res : MAX(fabs(transform[0]), fabs(transform[4]));
+
+    // Update the raster geographical bounds 
+    for (uint8_t k = 0; k < 2; k++) {
+        lon_bounds[k] = desc.lon_bounds[k]; 
+        lat_bounds[k] = desc.lat_bounds[k]; 
+    }
+
+    // Setup the map projection to geographic transformations.
+    setupTransformations(); 
+
+    // Retrieve the reference body radius and estimate the minimum pixel ground size
+    _radius = crs()->GetSemiMajor();
+    computeMinPixelSize();
+
+    /* The map coordinates of geographic rasters are in degrees, whereas those of the 
+     * projected ones are in linear units. */
+    double pixSize = MAX(fabs(transform[0]), fabs(transform[4]));
+    if (crs()->IsGeographic()) {
+        _angularRes = deg2rad(pixSize);
+    } else {
+        _angularRes = pixSize*crs()->GetLinearUnits()/_radius;
+    }
+
+    /* Bound the surface of the first band. The geographic limits are enlarged by one 
+     * pixel as a safety margin. */
+    if (_rasterCount > 0) {
+        volume = SphericalVolume(
+            lon_bounds, lat_bounds, _radius + bands[0].min(), _radius + bands[0].max(), 
+            _angularRes
+        );
+    }
+
+}
+
+RasterMetadata RasterFile::metadata() const {
+
+    RasterMetadata m; 
+
+    m.width  = _width; 
+    m.height = _height; 
+
+    for (size_t k = 0; k < 6; k++) {
+        m.transform[k] = transform[k];
+    }
+
+    char* wkt = nullptr; 
+    const char* options[] = {"FORMAT=WKT2_2018", nullptr};
+    if (mapCRS.exportToWkt(&wkt, options) == OGRERR_NONE && wkt) {
+        m.wkt = wkt;
+    }
+
+    CPLFree(wkt);
+
+    for (const RasterBand& band : bands) {
+        m.bands.push_back(band.metadata());
+    }
+
+    return m;
+
+}
+
+void RasterFile::open() {
+
+    if (pDataset) {
+        return;
+    }
+
+    pDataset = std::shared_ptr<GDALDataset>(
+        (GDALDataset *) GDALOpen(filepath.c_str(), GA_ReadOnly), GDALClose
+    );
+
+    if (pDataset == NULL) {
+        throw std::runtime_error("failed to open the dataset. Invalid pointer detected.");
+    }
+
+    if ((size_t)pDataset->GetRasterCount() != _rasterCount || 
+        (ui32_t)pDataset->GetRasterXSize() != _width || 
+        (ui32_t)pDataset->GetRasterYSize() != _height) {
+        pDataset.reset();
+        throw std::runtime_error("the dataset does not match the raster metadata.");
+    }
+
+    /* The band statistics and the reference system are already known, thus the bands 
+     * are only attached to the dataset. */
+    for (size_t k = 0; k < _rasterCount; k++) {
+        bands[k].attach(pDataset->GetRasterBand((int)k+1), ioMutex);
+    }
+
+}
+
+// Raster limits 
+
+void RasterFile::getLongitudeBounds(double* bounds) const {
+    bounds[0] = lon_bounds[0]; 
+    bounds[1] = lon_bounds[1];
+}
+
+void RasterFile::getLatitudeBounds(double* bounds) const {
+    bounds[0] = lat_bounds[0]; 
+    bounds[1] = lat_bounds[1];
+}
+
+bool RasterFile::isWithinGeographicBounds(const point2& p) const {
+
+    return ((lon_bounds[0] <= p[0] && p[0] <= lon_bounds[1]) && 
+            (lat_bounds[0] <= p[1] && p[1] <= lat_bounds[1]));
+            
+}
+
+
+double RasterFile::distanceToGeographicBounds(const point2& p, double dMax) const {
+
+    // Compute the distance from the latitude limits, in degrees
+    double d = MIN(p[1] - lat_bounds[0], lat_bounds[1] - p[1]);
+    d = MIN(d, rad2deg(dMax/_radius));
+
+    /* The distance along the parallels shrinks towards the poles, thus it is bounded 
+     * with the largest absolute latitude of the points within d from p. */
+    if (lon_bounds[1] - lon_bounds[0] < 360.0) {
+        double cosLat = cos(deg2rad(MIN(fabs(p[1]) + d, 90.0)));
+        d = MIN(d, cosLat*MIN(p[0] - lon_bounds[0], lon_bounds[1] - p[0]));
+    }
+
+    return _radius*deg2rad(MAX(d, 0.0)); 
+
+}
+
+double RasterFile::distanceFromGeographicBounds(const point2& p) const {
+
+    // Compute the latitude and longitude gaps, in degrees
+    double dLat = MAX(MAX(lat_bounds[0] - p[1], p[1] - lat_bounds[1]), 0.0);
+    double dLon = 0.0; 
+
+    if (lon_bounds[1] - lon_bounds[0] < 360.0) {
+        dLon = inf;
+        for (double lon : {p[0] - 360.0, p[0], p[0] + 360.0}) {
+            dLon = MIN(dLon, MAX(MAX(lon_bounds[0] - lon, lon - lon_bounds[1]), 0.0));
+        }
+    }
+
+    /* A path shorter than dLon can't reach latitudes beyond |lat| + dLon, thus its 
+     * length is at least the longitude gap scaled by the cosine of such latitude. */
+    double cosLat = cos(deg2rad(MIN(fabs(p[1]) + dLon, 90.0)));
+    return _radius*deg2rad(MAX(dLat, cosLat*dLon));
+
+}
+
+double RasterFile::getSafeDistance(
+    const point2& pix, const point2& s, double h, ui32_t level
+) const {
+
+    // Compute the safe distance within the first raster band
+    double d = bands[0].getSafeDistance(pix, h, _minPixelSize);
+
+    /* The overview surface at each point depends on the band pixels within 2^(level+1) 
+     * pixels from it, thus the footprint must keep such distance from the tile edges. */
+    if (level > 0) {
+        d = MAX(d - (2u << level)*_minPixelSize, 0.0);
+    }
+
+    /* Outside the raster limits the data is retrieved from other rasters, thus the 
+     * footprint must not leave them. */
+    return MIN(d, distanceToGeographicBounds(s, d));
+
+}
+
+double RasterFile::getCellDistance(const point2& pix, const point2& dpix) const {
+
+    /* Compute the distance at which the ray crosses the next column and row boundaries of 
+     * the cell containing the pixel. Cells span from each integer pixel coordinate to the 
+     * following one. */
+    double d = inf, dpixMax = 0.0;
+    for (size_t i = 0; i < 2; i++) {
+        if (dpix[i] != 0.0) {
+            double b = floor(pix[i]) + (dpix[i] > 0.0 ? 1.0 : 0.0);
+            d = MIN(d, (b - pix[i])/dpix[i]); 
+            dpixMax = MAX(dpixMax, fabs(dpix[i]));
+        }
+    }
+
+    if (std::isinf(d)) {
+        return 0.25*_minPixelSize;
+    }
+
+    // Cross the boundary by a small margin to enter the next cell
+    return d + DDA_CELL_MARGIN/dpixMax;
+
+}
+
+double RasterFile::getCellMaximum(const point2& pix) const {
+
+    if (!bands[0].isLoaded()) {
+        throw std::range_error("raster band data does not have enough elements");
+    }
+
+    // The cells without any data are unknown rather than empty
+    return bands[0].getCellMaximum(static_cast<ui32_t>(pix[0]), static_cast<ui32_t>(pix[1]));
+
+}
+
+double RasterFile::getConeDistance(
+    const point2& pix, const point2& s, double h, double a, double b
+) const {
+
+    // Compute the safe distance within the cone of the first raster band
+    double d = bands[0].getConeDistance(pix, h, a, b, _minPixelSize);
+    return MIN(d, distanceToGeographicBounds(s, d));
+
+}
+
+double RasterFile::getSlopeDistance(
+    const point2& pix, const point2& s, double h, double a, double b
+) const {
+
+    // Compute the safe distance from the slopes of the first raster band
+    double d = bands[0].getSlopeDistance(pix, h, a, b, _minPixelSize);
+    return MIN(d, distanceToGeographicBounds(s, d));
+
+}
+
+SegmentHit RasterFile::intersectSegment(
+    const point2& s0, const point2& sm, const point2& s1, const point3& h, 
+    double& x, ui32_t tid
+) const {
+
+    // The whole segment must be within the raster limits
+    if (!isWithinGeographicBounds(s0) || !isWithinGeographicBounds(s1)) {
+        return SegmentHit::UNKNOWN; 
+    }
+
+    point2 p0 = sph2pix(s0, tid); 
+    point2 p1 = sph2pix(s1, tid);
+
+    /* The segment footprint is linearly interpolated in pixel space. If its middle point 
+     * is too far from such line, we can't rely on the solution. */
+    point2 e = sph2pix(sm, tid) - 0.5*(p0 + p1); 
+    if (e.norm2() > 0.0625) {
+        return SegmentHit::UNKNOWN;
+    }
+
+    return bands[0].intersectSegment(p0, p1, h, x);
+
+}
+
+// Raster Bands Interfaces
+
+std::filesystem::path RasterFile::getCachePath(size_t i, const std::string& ext) const {
+
+    std::string name = "b" + std::to_string(i) + ext;
+
+    // By default, the cache file is stored next to the raster file
+    if (cacheDir.empty()) {
+        std::filesystem::path path(filepath);
+        return path.replace_extension(name);
+    }
+
+    /* Rasters with the same name might be stored in different directories, thus the 
+     * cache name is tagged with a hash of the full raster path. */
+    std::error_code ec; 
+    std::filesystem::path source = std::filesystem::absolute(filepath, ec);
+    size_t tag = std::hash<std::string>{}(ec ? filepath.string() : source.string());
+
+    std::ostringstream ss; 
+    ss << filepath.stem().string() << "." << std::hex << tag << "." << name;
+
+    std::filesystem::create_directories(cacheDir, ec);
+    return cacheDir / ss.str();
+
+}
+
+bool RasterFile::getConeMapHeader(ConeMapHeader& header) const {
+
+    /* The cache header stores the raster file size and modification time to detect 
+     * whether the raster has been updated after the map was computed. */
+    header = ConeMapHeader{}; 
+    std::memcpy(header.tag, "ACMP", 4);
+    header.version = 2;
+    header.width  = _width;
+    header.height = _height;
+
+    // Cone ratios are limited to avoid searching the whole raster on flat regions
+    header.ratio  = MAX_CONE_RATIO/_minPixelSize; 
+
+    std::error_code ec; 
+    header.size  = std::filesystem::file_size(filepath, ec); 
+    if (!ec) {
+        header.mtime = std::filesystem::last_write_time(filepath, ec).time_since_epoch().count();
+    }
+
+    return !ec;
+
+}
+
+bool RasterFile::hasConeMapCache(size_t i) const {
+
+    ConeMapHeader header, fHeader{};
+    if (!getConeMapHeader(header)) {
+        return false;
+    }
+
+    std::ifstream file(getCachePath(i, ".cone"), std::ios::in | std::ios::binary);
+    return file && file.read(reinterpret_cast<char*>(&fHeader), sizeof(fHeader)) && 
+           std::memcmp(&fHeader, &header, sizeof(header)) == 0;
+
+}
+
+void RasterFile::loadConeMap(size_t i) {
+
+    ConeMapHeader header; 
+    bool useCache = getConeMapHeader(header); 
+    std::filesystem::path cachePath = getCachePath(i, ".cone");
+
+    if (useCache) {
+
+        std::ifstream file(cachePath, std::ios::in | std::ios::binary);
+        ConeMapHeader fHeader{};
+
+        if (file && file.read(reinterpret_cast<char*>(&fHeader), sizeof(fHeader)) && 
+            std::memcmp(&fHeader, &header, sizeof(header)) == 0) {
+
+            std::vector<float> map((size_t)_width*_height);
+            if (file.read(reinterpret_cast<char*>(map.data()), map.size()*sizeof(float))) {
+                bands[i].setConeMap(std::move(map));
+                return;
+            }
+        }
+    }
+
+    // Compute the cone map from the band data
+    bands[i].buildConeMap(header.ratio);
+
+    if (useCache) {
+
+        const std::vector<float>& map = bands[i].getConeMap(); 
+
+        // As for the tile cache, concurrent processes never see a partially written file
+        std::filesystem::path tmpPath(cachePath); 
+        tmpPath += ".tmp" + std::to_string(getpid());
+
+        std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(map.data()), map.size()*sizeof(float));
+        file.close();
+
+        std::error_code ec;
+        if (file) {
+            std::filesystem::rename(tmpPath, cachePath, ec);
+        }
+
+        if (!file || ec) {
+            std::filesystem::remove(tmpPath, ec);
+            std::clog << "Failed to write cone-step map cache " << cachePath << std::endl;
+        }
+    }
+
+}
+
+void RasterFile::loadTileCache(size_t i) {
+
+    open();
+
+    std::filesystem::path cachePath = getCachePath(i, ".tiles");
+
+    /* The cache header stores the raster file size and modification time to detect 
+     * whether the raster has been updated after the cache was written. */
+    TileCacheHeader header{}; 
+    std::memcpy(header.tag, "ATLC", 4);
+    header.version = 2;
+
+    for (size_t k = 0; k < 6; k++) {
+        header.transform[k] = transform[k];
+    }
+
+    std::error_code ec; 
+    header.size  = std::filesystem::file_size(filepath, ec); 
+    if (!ec) {
+        header.mtime = std::filesystem::last_write_time(filepath, ec).time_since_epoch().count();
+    }
+
+    if (ec) {
+        loadBand(i); 
+        return;
+    }
+
+    if (bands[i].mapTileCache(cachePath, header)) {
+        return;
+    }
+
+    // Convert the band into the cache format and serve it from the new file
+    if (bands[i].writeTileCache(cachePath, header) && 
+        bands[i].mapTileCache(cachePath, header)) {
+        return;
+    }
+
+    std::clog << "Failed to use tile cache " << cachePath << std::endl;
+    loadBand(i);
+
+}
+
+void RasterFile::loadBands() {
+    for (size_t k = 0; k < _rasterCount; k++) {
+        loadBand(k); 
+    }
+}
+
+void RasterFile::unloadBands() {
+    for (size_t k = 0; k < _rasterCount; k++) {
+        unloadBand(k);
+    }
+}
+
+void RasterFile::prefetchBand(
+    size_t i, const double* lonBounds, const double* latBounds, ui32_t tid
+) {
+
+    // Clip the region to the raster limits
+    double lon[2] = {MAX(lonBounds[0], lon_bounds[0]), MIN(lonBounds[1], lon_bounds[1])};
+    double lat[2] = {MAX(latBounds[0], lat_bounds[0]), MIN(latBounds[1], lat_bounds[1])};
+
+    if (lon[0] > lon[1] || lat[0] > lat[1]) {
+        return;
+    }
+
+    /* The map projection is continuous, thus the pixel footprint of the region is 
+     * enclosed by the one of its border, which is sampled along each of its sides. */
+    const size_t n = 4*PREFETCH_EDGE_SAMPLES;
+    double x[n], y[n];
+
+    for (size_t k = 0; k < PREFETCH_EDGE_SAMPLES; k++) {
+
+        double a = static_cast<double>(k)/PREFETCH_EDGE_SAMPLES;
+        double dLon = a*(lon[1] - lon[0]);
+        double dLat = a*(lat[1] - lat[0]);
+
+        x[4*k]   = lon[0] + dLon; y[4*k]   = lat[0];
+        x[4*k+1] = lon[1];        y[4*k+1] = lat[0] + dLat;
+        x[4*k+2] = lon[1] - dLon; y[4*k+2] = lat[1];
+        x[4*k+3] = lon[0];        y[4*k+3] = lat[1] - dLat;
+    }
+
+    sph2pix(n, x, y, tid);
+
+    double uMin = inf, uMax = -inf, vMin = inf, vMax = -inf;
+    for (size_t k = 0; k < n; k++) {
+        uMin = MIN(uMin, x[k]); uMax = MAX(uMax, x[k]);
+        vMin = MIN(vMin, y[k]); vMax = MAX(vMax, y[k]);
+    }
+
+    // The neighbouring pixels are also read by the interpolations
+    uMin = MAX(floor(uMin) - 1.0, 0.0); uMax = MIN(ceil(uMax) + 1.0, _width - 1.0);
+    vMin = MAX(floor(vMin) - 1.0, 0.0); vMax = MIN(ceil(vMax) + 1.0, _height - 1.0);
+
+    if (!(uMin <= uMax && vMin <= vMax)) {
+        return;
+    }
+
+    bands[i].loadBlocks(uMin, vMin, uMax, vMax);
+
+}
+
+void RasterFile::setOverviewReduction(OverviewReduction mode) {
+    for (size_t k = 0; k < bands.size(); k++) {
+        bands[k].setOverviewReduction(mode);
+    }
+}
+
+size_t RasterFile::memoryUsage() const {
+
+    size_t n = 0;
+    for (size_t k = 0; k < bands.size(); k++) {
+        n += bands[k].memoryUsage();
+    }
+
+    return n;
+
+}
+
+
+// Transformation Functions
+point2 RasterFile::sph2map(const point2& s, ui32_t threadid) const {
+
+    if (projection.isValid()) {
+        return projection.forward(s);
+    }
+
+    int flags[1]; 
+    point2 m(s); 
+    
+    if(!s2mT[threadid]->Transform(1, &m.e[0], &m.e[1], nullptr, flags))
+        std::clog << "Transformation failed." << std::endl; 
+    
+    return m;
+}
+
+point2 RasterFile::map2sph(const point2& m, ui32_t threadid) const {
+
+    if (projection.isValid()) {
+        return projection.inverse(m);
+    }
+
+    int flags[1]; 
+    point2 s(m);
+
+    if(!m2sT[threadid]->Transform(1, &s.e[0], &s.e[1], nullptr, flags))
+        std::clog << "Transformation failed." << std::endl; 
+    
+    return s;
+
+}
+
+point2 RasterFile::sph2pix(const point2& s, ui32_t threadid) const {
+    
+    // Retrieve the pixel coordinates
+    point2 pix;
+    if (!interpolatePixel(s, pix, threadid)) {
+        pix = map2pix(sph2map(s, threadid)); 
+    }
+
+    // Ensure the pixel is within the bounds of the image 
+    clampPixel(pix);
+    return pix;
+
+}
+
+void RasterFile::sph2pix(size_t n, double* x, double* y, ui32_t threadid) const {
+
+    if (lattice == nullptr) {
+
+        // Project all the points at once
+        if (!projectPixels(n, x, y, threadid)) {
+            std::clog << "Transformation failed." << std::endl; 
+        }
+
+        point2 pix;
+        for (size_t k = 0; k < n; k++) {
+            pix = point2(x[k], y[k]); 
+            clampPixel(pix);
+
+            x[k] = pix[0]; 
+            y[k] = pix[1];
+        }
+
+        return;
+    }
+
+    /* The points that can't be interpolated are gathered and projected together, in 
+     * chunks that fit on the stack. */
+    double xm[MAX_RASTER_BATCH], ym[MAX_RASTER_BATCH];
+    size_t idx[MAX_RASTER_BATCH];
+
+    point2 pix;
+    for (size_t j0 = 0; j0 < n; j0 += MAX_RASTER_BATCH) {
+
+        size_t m = 0;
+        for (size_t j = j0; j < MIN(n, j0 + MAX_RASTER_BATCH); j++) {
+            if (interpolatePixel(point2(x[j], y[j]), pix, threadid)) {
+                x[j] = pix[0]; 
+                y[j] = pix[1];
+            } else {
+                idx[m] = j; 
+                xm[m] = x[j]; 
+                ym[m] = y[j];
+                m++;
+            }
+        }
+
+        if (m > 0 && !projectPixels(m, xm, ym, threadid)) {
+            std::clog << "Transformation failed." << std::endl; 
+        }
+
+        for (size_t i = 0; i < m; i++) {
+            pix = point2(xm[i], ym[i]); 
+            clampPixel(pix);
+
+            x[idx[i]] = pix[0];
+            y[idx[i]] = pix[1];
+        }
+    }
+
+}
+
+void RasterFile::setProjectionLattice(double tol) {
+
+    // Degenerate rasters and native projections are always evaluated exactly
+    if (tol > 0.0 && !projection.isValid() && 
+        lon_bounds[1] > lon_bounds[0] && lat_bounds[1] > lat_bounds[0]) {
+        lattice = std::make_shared<ProjectionLattice>(tol);
+    } else {
+        lattice.reset();
+    }
+
+}
+
+bool RasterFile::projectPixels(size_t n, double* x, double* y, ui32_t threadid) const {
+
+    if (projection.isValid()) {
+        projection.forward(n, x, y);
+    } else if (!s2mT[threadid]->Transform(n, x, y, nullptr, nullptr)) {
+        return false;
+    }
+
+    point2 pix;
+    for (size_t k = 0; k < n; k++) {
+        pix = map2pix(point2(x[k], y[k])); 
+        x[k] = pix[0]; 
+        y[k] = pix[1];
+    }
+
+    return true;
+
+}
+
+bool RasterFile::interpolatePixel(const point2& s, point2& pix, ui32_t threadid) const {
+
+    if (lattice == nullptr) {
+        return false;
+    }
+
+    const ui32_t nR = PROJECTION_LATTICE_REGIONS;
+
+    // Retrieve the region coordinates, the comparisons also discard NaN coordinates
+    double u = nR*(s[0] - lon_bounds[0])/(lon_bounds[1] - lon_bounds[0]); 
+    double v = nR*(s[1] - lat_bounds[0])/(lat_bounds[1] - lat_bounds[0]);
+
+    if (!(u >= 0.0 && u <= nR && v >= 0.0 && v <= nR)) {
+        return false;
+    }
+
+    ui32_t i = MIN((ui32_t)u, nR - 1);
+    ui32_t j = MIN((ui32_t)v, nR - 1);
+
+    ProjectionLattice::Region& r = lattice->regions[j*nR + i];
+
+    /* The region is built by the first thread that queries it, whereas the other ones 
+     * project their points exactly until it is ready. */
+    LatticeRegionState state = r.state.load(std::memory_order_acquire);
+    if (state == LatticeRegionState::EMPTY) {
+        if (r.state.compare_exchange_strong(state, LatticeRegionState::BUILDING)) {
+            buildLatticeRegion(r, i, j, threadid); 
+        }
+        state = r.state.load(std::memory_order_acquire);
+    }
+
+    if (state != LatticeRegionState::READY) {
+        return false;
+    }
+
+    // Bilinearly interpolate the nodes of the lattice cell
+    double a = (u - i)*r.size; 
+    double b = (v - j)*r.size; 
+
+    ui32_t cu = MIN((ui32_t)a, r.size - 1);
+    ui32_t cv = MIN((ui32_t)b, r.size - 1);
+
+    a -= cu; 
+    b -= cv;
+
+    const double* n0 = &r.nodes[2*(cv*(r.size + 1) + cu)]; 
+    const double* n1 = n0 + 2*(r.size + 1);
+
+    for (ui32_t k = 0; k < 2; k++) {
+        pix[k] = (1.0 - b)*((1.0 - a)*n0[k] + a*n0[k+2]) + b*((1.0 - a)*n1[k] + a*n1[k+2]);
+    }
+
+    clampPixel(pix);
+    return true;
+
+}
+
+void RasterFile::buildLatticeRegion(
+    ProjectionLattice::Region& r, ui32_t i, ui32_t j, ui32_t threadid
+) const {
+
+    const double nR = PROJECTION_LATTICE_REGIONS;
+
+    double dLon = (lon_bounds[1] - lon_bounds[0])/nR; 
+    double dLat = (lat_bounds[1] - lat_bounds[0])/nR;
+
+    double lon0 = lon_bounds[0] + i*dLon; 
+    double lat0 = lat_bounds[0] + j*dLat;
+
+    /* The nodes of each level are checked against the exact projection of the nodes of 
+     * the next one, which include the centres and the edge midpoints of all the cells. */
+    std::vector<double> nodes, fine; 
+    LatticeRegionState state = LatticeRegionState::EXACT; 
+
+    for (ui32_t level = 0; level <= PROJECTION_LATTICE_MAX_LEVEL + 1; level++) {
+
+        ui32_t n = 1u << level; 
+        size_t nNodes = (size_t)(n + 1)*(n + 1);
+
+        std::vector<double> x(nNodes), y(nNodes);
+        for (ui32_t q = 0; q <= n; q++) {
+            for (ui32_t p = 0; p <= n; p++) {
+                x[q*(n + 1) + p] = lon0 + dLon*p/n; 
+                y[q*(n + 1) + p] = lat0 + dLat*q/n;
+            }
+        }
+
+        if (!projectPixels(nNodes, x.data(), y.data(), threadid)) {
+            break;
+        }
+
+        fine.resize(2*nNodes);
+        bool valid = true;
+        for (size_t k = 0; k < nNodes; k++) {
+            valid &= std::isfinite(x[k]) && std::isfinite(y[k]);
+            fine[2*k] = x[k]; 
+            fine[2*k + 1] = y[k];
+        }
+
+        if (!valid) {
+            break;
+        }
+
+        if (level > 0) {
+
+            // Maximum interpolation error of the coarse lattice on the fine nodes
+            ui32_t nc = n/2; 
+            double err = 0.0;
+
+            for (ui32_t q = 0; q <= n; q++) {
+                for (ui32_t p = 0; p <= n; p++) {
+
+                    if (p % 2 == 0 && q % 2 == 0) {
+                        continue;
+                    }
+
+                    ui32_t p0 = p/2, q0 = q/2; 
+                    ui32_t p1 = MIN(p0 + p % 2, nc), q1 = MIN(q0 + q % 2, nc);
+
+                    const double* f = &fine[2*(q*(n + 1) + p)];
+                    for (ui32_t k = 0; k < 2; k++) {
+                        double c = 0.25*(
+                            nodes[2*(q0*(nc + 1) + p0) + k] + nodes[2*(q0*(nc + 1) + p1) + k] + 
+                            nodes[2*(q1*(nc + 1) + p0) + k] + nodes[2*(q1*(nc + 1) + p1) + k]
+                        );
+                        err = MAX(err, fabs(c - f[k]));
+                    }
+                }
+            }
+
+            if (err <= lattice->tolerance) {
+                r.size = nc;
+                r.nodes.swap(nodes);
+                state = LatticeRegionState::READY;
+                break;
+            }
+        }
+
+        nodes.swap(fine);
+
+    }
+
+    r.state.store(state, std::memory_order_release);
+
+}
+
+point2 RasterFile::pix2sph(const point2& p, ui32_t threadid) const {
+    return map2sph(pix2map(p), threadid);
+}
+
+void RasterFile::clampPixel(point2& pix) const {
+
+    if (pix[0] < 0) {
+        pix[0] = 0; 
+    } else if (pix[0] >= _width) {
+        pix[0] = _width - 1;
+    }
+
+    if (pix[1] < 0) {
+        pix[1] = 0; 
+    } else if (pix[1] >= _height) {
+        pix[1] = _height - 1;
+    }
+
+}
+
+
+// Private functions 
+
+void RasterFile::updateReferenceSystem() { 
+
+    // Read the map projection information from the associated .PRJ file
+    std::string projFile = filepath.string().substr(0, filepath.string().size() - 3) + "prj";
+
+    // Update the reference system only if an associated .PRJ file exists in the folder
+    if (fileExists(projFile)) {
+
+        // Read the .PRJ file content 
+        std::string wkt = readFileContent(projFile);
+        
+        // Update the dataset reference system
+        OGRSpatialReference mCRS(wkt.c_str());
+        pDataset->SetSpatialRef(&mCRS);
+    }
+
+}
+
+void RasterFile::setupTransformations() {
+
+    // Reserve enough space for all our threads
+    s2mT.reserve(_nThreads); 
+    m2sT.reserve(_nThreads);
+
+    // Retrieve the map spatial reference system 
+    const OGRSpatialReference& mCRS = mapCRS; 
+
+    // Generate a Moon's spherical reference system (with longitude first)
+    OGRSpatialReference sCRS = MoonGeographicCRS();
+
+    // Compute the transformation between a geographic and projected map and its inverse.
+    for (size_t k = 0; k < _nThreads; k++) 
+    {
+        s2mT.push_back(
+            std::shared_ptr<OGRCoordinateTransformation>(
+                OGRCreateCoordinateTransformation(&sCRS, &mCRS)
+            )
+        ); 
+
+        m2sT.push_back(
+            std::shared_ptr<OGRCoordinateTransformation>(
+                OGRCreateCoordinateTransformation(&mCRS, &sCRS)
+            )
+        );
+    }
+
+    /* The native projection replaces the OGR transformations whenever the reference 
+     * system is supported. Its agreement with PROJ is verified by the test suite. */
+    projection = MapProjection(&mCRS);
+
+}
+
+
+
+void RasterFile::computeMinPixelSize() {
+
+    // Number of sampling points along each raster dimension
+    const ui32_t n = 5; 
+
+    point2 p, s0, s1; 
+    double d; 
+
+    _minPixelSize = inf; 
+
+    for (ui32_t j = 0; j < n; j++) {
+        for (ui32_t k = 0; k < n; k++) {
+
+            // Retrieve the sampling pixel and its geographic coordinates
+            p = point2(k*(_width - 1.0)/(n - 1), j*(_height - 1.0)/(n - 1));
+            s0 = deg2rad(pix2sph(p)); 
+            
+            // Compute the ground distance towards the adjacent pixels
+            for (ui32_t i = 0; i < 2; i++) {
+
+                s1 = deg2rad(pix2sph(p + point2(i == 0 ? 1 : 0, i == 1 ? 1 : 0))); 
+
+                d = sin(s0[1])*sin(s1[1]) + cos(s0[1])*cos(s1[1])*cos(s1[0] - s0[0]);
+                d = _radius*acos(MIN(d, 1.0)); 
+
+                _minPixelSize = MIN(_minPixelSize, d);
+            }
+        }
+    }
+
+    /* Halve the value to account for the distortions between the sampling points and 
+     * for the differences between the ground and the ray footprint distances. */
+    _minPixelSize *= 0.5;
+
+}
+
+
+bool getRasterStamp(const std::filesystem::path& path, RasterMetadata& m) {
+
+    std::error_code ec; 
+    m.size = std::filesystem::file_size(path, ec); 
+    if (ec) {
+        return false;
+    }
+
+    m.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    if (ec) {
+        return false;
+    }
+
+    // The projection file overrides the reference system of the dataset
+    std::string prjFile = path.string().substr(0, path.string().size() - 3) + "prj";
+    m.prjMtime = 0; 
+
+    if (fileExists(prjFile)) {
+        m.prjMtime = std::filesystem::last_write_time(prjFile, ec).time_since_epoch().count();
+    }
+
+    return !ec;
+
+}
+
+std::map<std::string, RasterMetadata> readRasterIndex(const std::filesystem::path& path) {
+
+    std::map<std::string, RasterMetadata> index; 
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        return index;
+    }
+
+    auto get = [&file](auto& v) { 
+        file.read(reinterpret_cast<char*>(&v), sizeof(v)); 
+    };
+
+    auto getString = [&file, &get](std::string& str) {
+        ui64_t n = 0; 
+        get(n);
+        if (file && n < (1u << 24)) {
+            str.resize(n); 
+            file.read(str.data(), n);
+        } else {
+            file.setstate(std::ios::failbit);
+        }
+    };
+
+    char tag[4]; 
+    ui32_t version = 0; 
+    ui64_t nEntries = 0;
+
+    file.read(tag, 4);
+    get(version); 
+    get(nEntries);
+
+    if (!file || std::memcmp(tag, "ATLI", 4) != 0 || version != 1) {
+        return index;
+    }
+
+    std::string key; 
+    ui64_t nBands;
+
+    for (ui64_t k = 0; k < nEntries && file; k++) {
+
+        RasterMetadata m; 
+        getString(key); 
+        get(m.size); 
+        get(m.mtime); 
+        get(m.prjMtime);
+        get(m.width); 
+        get(m.height); 
+        get(m.transform);
+        getString(m.wkt);
+        get(nBands);
+
+        for (ui64_t j = 0; j < nBands && file; j++) {
+            RasterBandMetadata b; 
+            get(b.xBlock); 
+            get(b.yBlock); 
+            get(b.width); 
+            get(b.height);
+            get(b.type); 
+            get(b.vMin); 
+            get(b.vMax); 
+            get(b.noData);
+            m.bands.push_back(b);
+        }
+
+        if (file) {
+            index[key] = std::move(m);
+        }
+    }
+
+    // A truncated index is discarded, since it was not written by this function
+    if (!file) {
+        index.clear();
+    }
+
+    return index;
+
+}
+
+bool writeRasterIndex(
+    const std::filesystem::path& path, const std::map<std::string, RasterMetadata>& index
+) {
+
+    /* Multiple processes might be writing the same index, thus each of them writes its 
+     * own temporary file, which then atomically replaces the index. */
+    std::filesystem::path tmpPath(path); 
+    tmpPath += ".tmp" + std::to_string(getpid());
+
+    std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    auto put = [&file](const auto& v) { 
+        file.write(reinterpret_cast<const char*>(&v), sizeof(v)); 
+    };
+
+    auto putString = [&file, &put](const std::string& str) {
+        put((ui64_t)str.size()); 
+        file.write(str.data(), str.size());
+    };
+
+    file.write("ATLI", 4);
+    put((ui32_t)1); 
+    put((ui64_t)index.size());
+
+    for (const auto& [key, m] : index) {
+
+        putString(key); 
+        put(m.size); 
+        put(m.mtime); 
+        put(m.prjMtime);
+        put(m.width); 
+        put(m.height); 
+        put(m.transform);
+        putString(m.wkt);
+        put((ui64_t)m.bands.size());
+
+        for (const RasterBandMetadata& b : m.bands) {
+            put(b.xBlock); 
+            put(b.yBlock); 
+            put(b.width); 
+            put(b.height);
+            put(b.type); 
+            put(b.vMin); 
+            put(b.vMax); 
+            put(b.noData);
+        }
+    }
+
+    file.close();
+
+    std::error_code ec;
+    if (file) {
+        std::filesystem::rename(tmpPath, path, ec);
+    }
+
+    if (!file || ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+
+    return true;
+
+}
+
+
+/* -------------------------------------------------------
+                    RASTER CONTAINER
+---------------------------------------------------------- */
+
+// Constructors 
+
+RasterContainer::RasterContainer(double res, size_t nThreads) : 
+    _resolution(res), nThreads(nThreads), lastRaster(nThreads) {}
+
+RasterContainer::~RasterContainer() {
+    if (cache) {
+        cache->erase(this);
+    }
+}
+
+void RasterContainer::setCache(RasterCache* c) {
+
+    if (cache) {
+        cache->erase(this);
+    }
+
+    cache = c;
+
+}
+
+void RasterContainer::setProjectionLattice(double tol) {
+
+    latticeTolerance = tol; 
+    for (size_t k = 0; k < rasters.size(); k++) {
+        rasters[k].setProjectionLattice(tol);
+    }
+
+}
+
+void RasterContainer::setCacheDirectory(const std::string& dir) {
+
+    cacheDir = dir; 
+    for (size_t k = 0; k < rasters.size(); k++) {
+        rasters[k].setCacheDirectory(dir);
+    }
+
+}
+
+void RasterContainer::buildConeMaps() {
+
+    // The rasters whose cache is up to date are skipped without reading their data
+    std::vector<size_t> missing;
+    for (size_t k = 0; k < rasters.size(); k++) {
+        if (!rasters[k].hasConeMapCache(0)) {
+            missing.push_back(k);
+        }
+    }
+
+    std::vector<std::exception_ptr> errors(missing.size());
+
+    auto buildMap = [this, &missing, &errors](size_t j) {
+
+        size_t k = missing[j];
+        RasterStatus& st = *status[k];
+
+        try {
+
+            std::unique_lock<std::mutex> lock(st.mutex);
+            bool loaded = st.state.load(std::memory_order_relaxed) == RasterLoadState::READY;
+
+            // The band data is only kept if the raster was already loaded
+            if (!loaded) {
+                rasters[k].loadBand(0);
+            }
+
+            if (!rasters[k].isConeMapLoaded(0)) {
+                rasters[k].loadConeMap(0);
+            }
+
+            if (!loaded) {
+                rasters[k].unloadBand(0);
+            }
+
+        } catch (...) {
+            errors[j] = std::current_exception();
+        }
+
+    };
+
+    // Each raster map is built by a single worker
+    size_t nWorkers = MIN(MAX(nThreads, (size_t)1), missing.size());
+    if (nWorkers > 1) {
+
+        ThreadPool pool(nWorkers); 
+        for (size_t j = 0; j < missing.size(); j++) {
+            pool.addTask([&buildMap, j](const ThreadWorker&) { buildMap(j); });
+        }
+
+        pool.startPool(); 
+        pool.waitCompletion();
+        pool.stopPool();
+
+    } else {
+        for (size_t j = 0; j < missing.size(); j++) {
+            buildMap(j);
+        }
+    }
+
+    for (size_t j = 0; j < missing.size(); j++) {
+        if (errors[j]) {
+            std::rethrow_exception(errors[j]);
+        }
+    }
+
+}
+
+void RasterContainer::setOverviewReduction(OverviewReduction mode) {
+
+    overviewMode = mode; 
+    for (size_t k = 0; k < rasters.size(); k++) {
+        rasters[k].setOverviewReduction(mode);
+    }
+
+}
+
+void RasterContainer::appendRaster(RasterDescriptor desc) {
+    appendRaster(RasterFile(desc, nThreads));
+}
+
+void RasterContainer::appendRaster(RasterFile&& file) {
+
+    // Append the raster to the set of rasters
+    rasters.push_back(std::move(file)); 
+    if (latticeTolerance > 0.0) {
+        rasters.back().setProjectionLattice(latticeTolerance);
+    }
+
+    rasters.back().setOverviewReduction(overviewMode);
+    rasters.back().setCacheDirectory(cacheDir);
+
+    status.push_back(std::make_unique<RasterStatus>());
+
+}
+
+void RasterContainer::loadRaster(size_t i) {
+    std::unique_lock<std::mutex> lock(status[i]->mutex);
+    openRaster(i);
+}
+
+void RasterContainer::unloadRaster(size_t i) {
+
+    {
+        std::unique_lock<std::mutex> lock(status[i]->mutex);
+        closeRaster(i);
+    }
+
+    if (cache) {
+        cache->erase(this, i);
+    }
+
+}
+
+bool RasterContainer::openRaster(size_t i) {
+
+    RasterStatus& st = *status[i];
+    if (st.state.load(std::memory_order_relaxed) == RasterLoadState::READY) {
+        return false;
+    }
+
+    st.state.store(RasterLoadState::LOADING, std::memory_order_relaxed);
+
+    try {
+
+        if (useTileCache) {
+            rasters[i].loadTileCache(0);
+        } else {
+            rasters[i].loadBand(0);
+        }
+
+        // Load the cone-step map, which requires the band data
+        if (useConeMaps) {
+            rasters[i].loadConeMap(0); 
+        }
+
+        if (preloadBlocks) {
+            rasters[i].loadBandBlocks(0);
+        }
+
+    } catch (...) {
+        st.state.store(RasterLoadState::UNLOADED, std::memory_order_relaxed);
+        throw;
+    }
+
+    st.state.store(RasterLoadState::READY, std::memory_order_release);
+    return true;
+
+}
+
+void RasterContainer::closeRaster(size_t i) {
+
+    /* The band data can't be released while a prefetch is reading its blocks, thus the 
+     * unloading is deferred to the completion of the last one. */
+    RasterStatus& st = *status[i];
+    if (st.nPrefetching > 0) {
+        st.unloadPending = true;
+        return;
+    }
+
+    if (st.state.load(std::memory_order_relaxed) != RasterLoadState::UNLOADED) {
+        rasters[i].unloadBand(0);
+        st.state.store(RasterLoadState::UNLOADED, std::memory_order_relaxed);
+    }
+
+    // Explicitly unloaded rasters are no longer held for the next frame
+    if (st.prefetched) {
+        st.pins.fetch_sub(1, std::memory_order_acq_rel);
+        st.prefetched = false;
+    }
+
+    st.unusedFrames = 0;
+
+}
+
+bool RasterContainer::evictRaster(size_t i) {
+
+    /* The cache lock is held by the caller, thus rasters being loaded or prefetched are 
+     * skipped rather than waited for. */
+    RasterStatus& st = *status[i];
+    std::unique_lock<std::mutex> lock(st.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+
+    /* Pinned rasters may still be accessed by the queries in flight or be prefetched for 
+     * the next frame. A pin can only be taken from zero with the raster mutex locked, 
+     * thus none can be added meanwhile. */
+    if (st.pins.load(std::memory_order_acquire) > 0) {
+        return false;
+    }
+
+    closeRaster(i);
+    return true;
+
+}
+
+bool RasterContainer::prefetch(const GeoRegion& region, ui32_t tid) {
+
+    bool covered[2] = {false, false};
+    double lon[2], lat[2];
+
+    forEachRaster(region, [&](ui32_t k) {
+
+        /* Only the band opening is done within the lock, the blocks are read afterwards. 
+         * The raster is pinned until the cleanup preceding the frame it is loaded for, 
+         * so that neither the cleanup nor the cache can unload it before its use. */
+        RasterStatus& st = *status[k];
+        {
+            std::unique_lock<std::mutex> lock(st.mutex);
+
+            openRaster(k);
+            if (!st.prefetched) {
+                st.pins.fetch_add(1, std::memory_order_acq_rel);
+            }
+
+            // A new request supersedes any unloading deferred by a previous prefetch
+            st.unloadPending = false;
+            st.unusedFrames = 0;
+            st.prefetched = true;
+            st.nPrefetching++;
+        }
+
+        if (cache) {
+            cache->insert(this, k);
+        }
+
+        rasters[k].getLongitudeBounds(lon);
+        rasters[k].getLatitudeBounds(lat);
+
+        for (size_t r = 0; r < region.n; r++) {
+
+            const double* lonBounds = region.lon[r];
+            if (lon[1] < lonBounds[0] || lonBounds[1] < lon[0]) {
+                continue;
+            }
+
+            rasters[k].prefetchBand(0, lonBounds, region.lat, tid);
+
+            covered[r] |= (lon[0] <= lonBounds[0] && lonBounds[1] <= lon[1] && 
+                           lat[0] <= region.lat[0] && region.lat[1] <= lat[1]);
+        }
+
+        // Complete the unloading requested while the blocks were being read
+        bool unloaded = false;
+        {
+            std::unique_lock<std::mutex> lock(st.mutex);
+            if (--st.nPrefetching == 0 && st.unloadPending) {
+                st.unloadPending = false;
+                closeRaster(k);
+                unloaded = true;
+            }
+        }
+
+        if (unloaded && cache) {
+            cache->erase(this, k);
+        }
+
+    });
+
+    return region.n > 0 && covered[0] && (region.n == 1 || covered[1]);
+
+}
+
+void RasterContainer::loadRasters() {
+    for (size_t k = 0; k < rasters.size(); k++) {
+        loadRaster(k);
+    }
+}
+
+void RasterContainer::unloadRasters() {
+
+    for (size_t k = 0; k < rasters.size(); k++) {
+        std::unique_lock<std::mutex> lock(status[k]->mutex);
+        closeRaster(k);
+    }
+
+    if (cache) {
+        cache->erase(this);
+    }
+
+}
+
+double RasterContainer::getData(const point2& s, bool interp, ui32_t tid) {
+    RasterSample smp;
+    return getData(s, interp, smp, tid);
+}
+
+double RasterContainer::getData(
+    const point2& s, bool interp, RasterSample& smp, ui32_t tid
+) {
+
+    // Retrieve the raster containing the desired point
+    smp.raster = findRaster(s, tid); 
+    if (smp.raster == rasters.size()) {
+        return -inf; 
+    }
+
+    // Retrieve the pixel data value
+    smp.pix = rasters[smp.raster].sph2pix(s, tid); 
+    smp.s = s;
+
+    if (smp.level > 0) {
+        return rasters[smp.raster].getOverviewData(smp.pix, smp.level);
+    }
+
+    return interp ? rasters[smp.raster].interpolateBand(smp.pix, 0) : 
+        rasters[smp.raster].getBandData(smp.pix[0], smp.pix[1], 0);
+
+}
+
+void RasterContainer::getData(
+    size_t n, const point2* s, bool interp, const bool* mask, double* h, 
+    RasterSample* smp, ui32_t tid
+) {
+
+    // Split large batches so that the working arrays can be stored on the stack
+    if (n > MAX_RASTER_BATCH) {
+        for (size_t j = 0; j < n; j += MAX_RASTER_BATCH) {
+            getData(
+                MIN(n - j, MAX_RASTER_BATCH), s + j, interp, mask + j, h + j, smp + j, tid
+            );
+        }
+        return;
+    }
+
+    double x[MAX_RASTER_BATCH], y[MAX_RASTER_BATCH]; 
+    size_t idx[MAX_RASTER_BATCH];
+
+    // Reset the raster of all the requested points
+    size_t nLeft = 0; 
+    for (size_t j = 0; j < n; j++) {
+        if (mask[j]) {
+            smp[j].raster = rasters.size(); 
+            nLeft++;
+        }
+    }
+
+    /* Each point is assigned to the first raster that contains it, as in the single 
+     * point query. Then, all the points of the same raster are projected together. */
+    size_t rid[MAX_RASTER_BATCH];
+    for (size_t j = 0; j < n; j++) {
+        if (mask[j]) {
+            rid[j] = locateRaster(s[j], tid);
+            if (rid[j] == rasters.size()) {
+                nLeft--;
+            }
+        }
+    }
+
+    for (size_t j0 = 0; j0 < n && nLeft > 0; j0++) {
+
+        if (!mask[j0] || rid[j0] == rasters.size() || smp[j0].raster != rasters.size()) {
+            continue;
+        }
+
+        size_t k = rid[j0];
+        size_t m = 0; 
+        for (size_t j = j0; j < n; j++) {
+            if (mask[j] && rid[j] == k) {
+                smp[j].raster = k; 
+                idx[m] = j; 
+                x[m] = s[j][0]; 
+                y[m] = s[j][1]; 
+                m++;
+            }
+        }
+
+        acquireRaster(k, tid); 
+        rasters[k].sph2pix(m, x, y, tid); 
+
+        // The points sampling the band are compacted and interpolated together
+        size_t mb = 0;
+        for (size_t i = 0; i < m; i++) {
+
+            RasterSample& smp_i = smp[idx[i]];
+            smp_i.pix = point2(x[i], y[i]); 
+            smp_i.s = s[idx[i]];
+
+            if (smp_i.level > 0) {
+                h[idx[i]] = rasters[k].getOverviewData(smp_i.pix, smp_i.level);
+            } else if (interp) {
+                x[mb] = x[i]; 
+                y[mb] = y[i]; 
+                idx[mb++] = idx[i];
+            } else {
+                h[idx[i]] = rasters[k].getBandData(smp_i.pix[0], smp_i.pix[1], 0);
+            }
+        }
+
+        double hb[MAX_RASTER_BATCH];
+        rasters[k].interpolateBand(mb, x, y, hb, 0);
+
+        for (size_t i = 0; i < mb; i++) {
+            h[idx[i]] = hb[i];
+        }
+
+        nLeft -= m;
+
+    }
+
+}
+
+double RasterContainer::getSafeDistance(const RasterSample& smp, double h) const {
+
+    if (smp.raster >= rasters.size()) {
+        return 0.0; 
+    }
+
+    return rasters[smp.raster].getSafeDistance(smp.pix, smp.s, h, smp.level);
+
+}
+
+double RasterContainer::boundSafeDistance(
+    const point2& s, double h, double dMax, ui32_t tid
+) {
+
+    if (rasters.empty() || dMax <= 0.0) {
+        return MAX(dMax, 0.0);
+    }
+
+    // Only the rasters within dMax from the point can be reached
+    double radius = rasters[0].crs()->GetSemiMajor();
+    vec3 axis = sph2car(point3(1.0, deg2rad(s[0]), deg2rad(s[1])));
+
+    double d = dMax;
+    forEachRaster(getCapRegion(axis, MIN(dMax/radius, PI)), [&](ui32_t k) {
+
+        /* The ray is safe while it is above the raster maximum or while its footprint 
+         * is outside the raster limits. */
+        const RasterBand* band = rasters[k].getRasterBand(0);
+        double dk = MAX(h - band->max(), rasters[k].distanceFromGeographicBounds(s));
+
+        /* Within the raster, its pyramid bounds the surface more tightly. The raster is 
+         * pinned as for a data query, and the overview footprints are accounted for 
+         * since the level the raster would be sampled at is unknown. */
+        if (dk < d && rasters[k].isWithinGeographicBounds(s)) {
+            acquireRaster(k, tid);
+            dk = MAX(dk, rasters[k].getSafeDistance(
+                rasters[k].sph2pix(s, tid), s, h, band->nOverviewLevels()
+            ));
+        }
+
+        d = MIN(d, MAX(dk, 0.0));
+
+    });
+
+    return d;
+
+}
+
+double RasterContainer::getConeDistance(
+    const RasterSample& smp, double h, double a, double b
+) const {
+
+    // The cones only bound the band surface, not its overviews
+    if (smp.raster >= rasters.size() || smp.level > 0 || 
+        !rasters[smp.raster].isConeMapLoaded(0)) {
+        return 0.0; 
+    }
+
+    return rasters[smp.raster].getConeDistance(smp.pix, smp.s, h, a, b);
+
+}
+
+double RasterContainer::getSlopeDistance(
+    const RasterSample& smp, double h, double a, double b
+) const {
+
+    // The slopes only bound the band surface, not its overviews
+    if (smp.raster >= rasters.size() || smp.level > 0) {
+        return 0.0; 
+    }
+
+    return rasters[smp.raster].getSlopeDistance(smp.pix, smp.s, h, a, b);
+
+}
+
+SegmentHit RasterContainer::intersectSegment(
+    const RasterSample& smp, const point2& s0, const point2& sm, const point2& s1, 
+    const point3& h, double& x, ui32_t tid
+) const {
+
+    if (smp.raster >= rasters.size()) {
+        return SegmentHit::UNKNOWN; 
+    }
+
+    return rasters[smp.raster].intersectSegment(s0, sm, s1, h, x, tid);
+
+}
+
+size_t RasterContainer::findRaster(const point2& s, ui32_t tid) {
+
+    size_t k = locateRaster(s, tid);
+    if (k < rasters.size()) {
+        acquireRaster(k, tid);
+    }
+
+    return k;
+
+}
+
+size_t RasterContainer::locateRaster(const point2& s, ui32_t tid) {
+
+    /* Consecutive samples usually fall in the same raster, which is the right one if no 
+     * raster with a lower index overlapping it contains the point. */
+    size_t k = lastRaster[tid].raster;
+    if (k < rasters.size() && rasters[k].isWithinGeographicBounds(s)) {
+
+        bool found = true; 
+        for (ui32_t j : rasterPriors[k]) {
+            if (rasters[j].isWithinGeographicBounds(s)) {
+                found = false; 
+                break;
+            }
+        }
+
+        if (found) {
+            return k;
+        }
+    }
+
+    // The comparisons also discard NaN coordinates
+    if (!(s[0] >= indexLon && s[0] <= indexLon + indexWidth*indexStepLon && 
+          s[1] >= indexLat && s[1] <= indexLat + indexHeight*indexStepLat)) {
+        return rasters.size();
+    }
+
+    size_t c = (size_t)getIndexRow(s[1])*indexWidth + getIndexColumn(s[0]);
+    for (ui32_t i = indexOffsets[c]; i < indexOffsets[c+1]; i++) {
+        k = indexRasters[i];
+        if (rasters[k].isWithinGeographicBounds(s)) {
+            if (lastRaster[tid].raster != k) {
+                lastRaster[tid].raster = k;
+            }
+            return k;
+        }
+    }
+
+    return rasters.size(); 
+
+}
+
+void RasterContainer::buildIndex() {
+
+    size_t n = rasters.size();
+
+    double lon[2], lat[2];
+    double lonMin = inf, lonMax = -inf, latMin = inf, latMax = -inf; 
+    double width = 0.0, height = 0.0;
+
+    for (size_t k = 0; k < n; k++) {
+        rasters[k].getLongitudeBounds(lon);
+        rasters[k].getLatitudeBounds(lat);
+
+        lonMin = MIN(lonMin, lon[0]); lonMax = MAX(lonMax, lon[1]);
+        latMin = MIN(latMin, lat[0]); latMax = MAX(latMax, lat[1]);
+
+        width += lon[1] - lon[0];
+        height += lat[1] - lat[0];
+    }
+
+    /* The cells are sized as the average raster, so that each of them is overlapped by 
+     * a few rasters, unless the maximum number of cells is reached. */
+    double nx = width > 0.0 ? n*(lonMax - lonMin)/width : 1.0;
+    double ny = height > 0.0 ? n*(latMax - latMin)/height : 1.0;
+
+    double scale = sqrt(RASTER_INDEX_MAX_CELLS/MAX(nx*ny, 1.0));
+    if (scale < 1.0) {
+        nx *= scale; 
+        ny *= scale;
+    }
+
+    indexWidth  = MAX(static_cast<ui32_t>(ceil(nx)), 1);
+    indexHeight = MAX(static_cast<ui32_t>(ceil(ny)), 1);
+
+    indexLon = lonMin; 
+    indexLat = latMin;
+
+    indexStepLon = lonMax > lonMin ? (lonMax - lonMin)/indexWidth : 1.0;
+    indexStepLat = latMax > latMin ? (latMax - latMin)/indexHeight : 1.0;
+
+    /* Since the cell coordinates are monotonic, a raster containing a point always 
+     * overlaps the cell of such point. */
+    std::vector<std::vector<ui32_t>> cells((size_t)indexWidth*indexHeight);
+    for (size_t k = 0; k < n; k++) {
+
+        rasters[k].getLongitudeBounds(lon);
+        rasters[k].getLatitudeBounds(lat);
+
+        for (ui32_t v = getIndexRow(lat[0]); v <= getIndexRow(lat[1]); v++) {
+            for (ui32_t u = getIndexColumn(lon[0]); u <= getIndexColumn(lon[1]); u++) {
+                cells[(size_t)v*indexWidth + u].push_back(k);
+            }
+        }
+    }
+
+    indexOffsets.assign(cells.size() + 1, 0);
+    indexRasters.clear();
+
+    indexMinRadius = inf; 
+    indexMaxRadius = -inf;
+    indexMargin = 0.0;
+
+    for (size_t k = 0; k < n; k++) {
+        const SphericalVolume& vol = rasters[k].getBoundingVolume();
+        indexMinRadius = MIN(indexMinRadius, vol.minRadius()); 
+        indexMaxRadius = MAX(indexMaxRadius, vol.maxRadius());
+        indexMargin = MAX(indexMargin, rasters[k].getAngularResolution());
+    }
+
+    for (size_t c = 0; c < cells.size(); c++) {
+        indexRasters.insert(indexRasters.end(), cells[c].begin(), cells[c].end());
+        indexOffsets[c+1] = indexRasters.size();
+    }
+
+    /* Overlapping rasters always share a cell, thus the rasters taking precedence over 
+     * each raster are only searched among those of its cells, which are sorted by 
+     * increasing index. */
+    double lon2[2], lat2[2];
+    std::vector<size_t> visited(n, SIZE_MAX);
+
+    rasterPriors.assign(n, std::vector<ui32_t>());
+    for (size_t k = 0; k < n; k++) {
+
+        rasters[k].getLongitudeBounds(lon);
+        rasters[k].getLatitudeBounds(lat);
+
+        for (ui32_t v = getIndexRow(lat[0]); v <= getIndexRow(lat[1]); v++) {
+            for (ui32_t u = getIndexColumn(lon[0]); u <= getIndexColumn(lon[1]); u++) {
+                
+                const std::vector<ui32_t>& cell = cells[(size_t)v*indexWidth + u];
+                for (size_t i = 0; i < cell.size() && cell[i] < k; i++) {
+
+                    ui32_t j = cell[i];
+                    if (visited[j] == k) {
+                        continue;
+                    }
+
+                    visited[j] = k;
+                    rasters[j].getLongitudeBounds(lon2);
+                    rasters[j].getLatitudeBounds(lat2);
+
+                    if (lon2[0] <= lon[1] && lon[0] <= lon2[1] && 
+                        lat2[0] <= lat[1] && lat[0] <= lat2[1]) {
+                        rasterPriors[k].push_back(j);
+                    }
+                }
+            }
+        }
+
+        std::sort(rasterPriors[k].begin(), rasterPriors[k].end());
+    }
+
+}
+
+template <typename F> 
+void RasterContainer::forEachRaster(const GeoRegion& region, F&& f) const {
+
+    double lon[2], lat[2];
+
+    ui32_t v0 = getIndexRow(region.lat[0]), v1 = getIndexRow(region.lat[1]);
+    for (size_t r = 0; r < region.n; r++) {
+
+        const double* lonBounds = region.lon[r];
+        ui32_t u0 = getIndexColumn(lonBounds[0]), u1 = getIndexColumn(lonBounds[1]);
+
+        for (ui32_t v = v0; v <= v1; v++) {
+            for (ui32_t u = u0; u <= u1; u++) {
+
+                size_t c = (size_t)v*indexWidth + u;
+                for (ui32_t i = indexOffsets[c]; i < indexOffsets[c+1]; i++) {
+
+                    ui32_t k = indexRasters[i];
+                    rasters[k].getLongitudeBounds(lon);
+                    rasters[k].getLatitudeBounds(lat);
+
+                    if (lon[1] < lonBounds[0] || lonBounds[1] < lon[0] || 
+                        lat[1] < region.lat[0] || region.lat[1] < lat[0]) {
+                        continue;
+                    }
+
+                    /* Rasters spanning several cells are only reported by the first cell 
+                     * they share with the region, and rasters crossing the antimeridian 
+                     * by the first longitude range. */
+                    if (MAX(getIndexColumn(lon[0]), u0) != u || 
+                        MAX(getIndexRow(lat[0]), v0) != v) {
+                        continue;
+                    }
+
+                    if (r > 0 && lon[0] <= region.lon[0][1] && region.lon[0][0] <= lon[1]) {
+                        continue;
+                    }
+
+                    f(k);
+                }
+            }
+        }
+    }
+
+}
+
+void RasterContainer::getRayIntervals(
+    const Ray& ray, double t0, double t1, std::vector<Interval>& intervals
+) const {
+
+    if (rasters.empty() || ray.minDistance() > indexMaxRadius) {
+        return;
+    }
+
+    double tIn, tOut; 
+    ray.getParameters(indexMaxRadius, tIn, tOut); 
+
+    t0 = MAX(t0, tIn); 
+    t1 = MIN(t1, tOut);
+
+    /* The ray is split at its point closest to the body centre, so that each part is 
+     * projected onto an arc shorter than a quarter circle. The portion within the inner 
+     * sphere can't cross any bounding volume. */
+    double tc = -dot(ray.origin(), ray.direction());
+    tIn = tOut = tc;
+
+    if (ray.minDistance() < indexMinRadius) {
+        ray.getParameters(indexMinRadius, tIn, tOut);
+    }
+
+    Interval parts[2] = {{t0, MIN(t1, tIn)}, {MAX(t0, tOut), t1}};
+    for (const Interval& p : parts) {
+
+        if (p.t0 > p.t1) {
+            continue;
+        }
+
+        GeoRegion region = getArcRegion(ray.at(p.t0), ray.at(p.t1), indexMargin);
+        forEachRaster(region, [&](ui32_t k) {
+            rasters[k].getBoundingVolume().intersect(ray, intervals);
+        });
+    }
+
+}
+
+void RasterContainer::getRadiusBounds(
+    const point3& apex, const vec3& dir, double angle, double rStop, 
+    double& rMin, double& rMax
+) const {
+
+    if (rasters.empty()) {
+        return;
+    }
+
+    GeoRegion region = getConeRegion(apex, dir, angle, rStop, indexMaxRadius, indexMargin);
+    forEachRaster(region, [&](ui32_t k) {
+
+        const SphericalVolume& vol = rasters[k].getBoundingVolume(); 
+        if (!vol.intersectCone(apex, dir, angle)) {
+            return;
         }
 
-        if (h != noDataVal) {
-            sk = 1 - sk/s; 
-            n += sk*h;
-            d += sk; 
-        } 
+        /* The pyramid of a loaded raster bounds its surface more tightly than the band 
+         * maximum. It is only read if the raster lock is free, so that the raster can't 
+         * be unloaded meanwhile and the caller is never stalled by a raster loading. */
+        double r = vol.maxRadius();
+
+        std::unique_lock<std::mutex> lock(status[k]->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            const RasterBand* band = rasters[k].getRasterBand(0);
+            r = MIN(r, rasters[k].crs()->GetSemiMajor() + band->getPyramidMaximum());
+        }
+
+        rMin = MIN(rMin, vol.minRadius()); 
+        rMax = MAX(rMax, r);
+
+    });
+
+}
+
+ui32_t RasterContainer::getIndexColumn(double lon) const {
+    double u = (lon - indexLon)/indexStepLon;
+    return u <= 0.0 ? 0 : MIN(static_cast<ui32_t>(u), indexWidth - 1);
+}
+
+ui32_t RasterContainer::getIndexRow(double lat) const {
+    double v = (lat - indexLat)/indexStepLat;
+    return v <= 0.0 ? 0 : MIN(static_cast<ui32_t>(v), indexHeight - 1);
+}
+
+void RasterContainer::acquireRaster(size_t k, ui32_t tid) {
+
+    // The rasters already pinned by the thread remain loaded until it releases them
+    std::vector<size_t>& pinned = lastRaster[tid].pinned;
+    if (std::find(pinned.begin(), pinned.end(), k) != pinned.end()) {
+        return;
+    }
+
+    /* A raster pinned by another thread is loaded and can't be unloaded while the pin 
+     * count is positive, thus it is pinned again without locking. */
+    RasterStatus& st = *status[k];
+    ui32_t n = st.pins.load(std::memory_order_acquire);
+    while (n > 0) {
+        if (st.pins.compare_exchange_weak(n, n + 1, std::memory_order_acq_rel)) {
+            pinned.push_back(k);
+            return;
+        }
+    }
+        
+    bool loaded = false;
+
+    {
+        /* Only the threads requiring this raster wait for its loading, whereas the 
+         * other ones keep accessing, or loading, the other rasters. */
+        std::unique_lock<std::mutex> lock(st.mutex);
+
+        loaded = openRaster(k);
+        st.pins.fetch_add(1, std::memory_order_acq_rel);
+        st.accessed = true;
+    }
+
+    pinned.push_back(k);
+
+    /* The cache is updated once the raster lock is released, since evicting other 
+     * rasters requires locking them. The raster is already pinned, thus it can't be 
+     * evicted by this call. */
+    if (cache) {
+        cache->access(this, k, loaded);
+    }
+
+}
+
+void RasterContainer::releaseRasters(ui32_t tid) {
+
+    std::vector<size_t>& pinned = lastRaster[tid].pinned;
+    for (size_t k : pinned) {
+        status[k]->pins.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    pinned.clear();
+
+}
+
+void RasterContainer::cleanupRasters(ui32_t threshold) {
+
+    // No query is in flight between two frames, thus all the pins are released
+    for (ui32_t tid = 0; tid < lastRaster.size(); tid++) {
+        releaseRasters(tid);
+    }
+
+    // Rasters may be concurrently prefetched for the next frame
+    for (size_t k = 0; k < rasters.size(); k++) {
+
+        RasterStatus& st = *status[k];
+        std::unique_lock<std::mutex> lock(st.mutex);
 
+        bool used = st.accessed;
+        st.accessed = false;
+
+        /* Prefetched rasters are kept until the frame they were loaded for starts, which 
+         * follows this cleanup, and are then handled as the other rasters. */
+        if (st.prefetched) {
+            if (st.nPrefetching == 0) {
+                st.pins.fetch_sub(1, std::memory_order_acq_rel);
+                st.prefetched = false;
+            }
+            st.unusedFrames = 0;
+        } 
+        // The cache is in charge of unloading the rasters
+        else if (cache || used) {
+            st.unusedFrames = 0;
+        }
+        else if (++st.unusedFrames >= threshold && 
+                 st.state.load(std::memory_order_relaxed) != RasterLoadState::UNLOADED) {
+            closeRaster(k);
+        }
     }
 
-    return n/d; 
 }
 
 /* -------------------------------------------------------
@@ -485,7 +3857,8 @@ double RasterContainer::interpolateRaster(const point2& pix, size_t rid) const {
 // Constructors 
 
 RasterManager::RasterManager(
-    std::vector<RasterDescriptor> descriptors, size_t nThreads, bool displayLogs
+    std::vector<RasterDescriptor> descriptors, size_t nThreads, bool displayLogs, 
+    const std::string& indexPath
 ) {
 
     // Register GDAL drivers to open raster datasets.
@@ -517,15 +3890,87 @@ RasterManager::RasterManager(
     // Store current time
     auto t1 = std::chrono::high_resolution_clock::now();
 
+    // Prevent opening an empty string 
+    descriptors.erase(
+        std::remove_if(descriptors.begin(), descriptors.end(), 
+            [](const RasterDescriptor& d) { return d.filename.empty(); }), 
+        descriptors.end()
+    );
+
+    nFiles = descriptors.size();
+
+    /* The rasters whose metadata is stored within the index are set up without opening 
+     * their dataset, whereas the remaining ones are opened in parallel, since computing 
+     * their statistics might require reading the whole files. */
+    std::map<std::string, RasterMetadata> index; 
+    if (!indexPath.empty()) {
+        index = readRasterIndex(indexPath);
+    }
+
+    std::vector<std::unique_ptr<RasterFile>> files(nFiles); 
+    std::vector<std::exception_ptr> errors(nFiles); 
+    std::vector<char> indexed(nFiles, 0);
+
+    auto setupRaster = [&](size_t k) {
+
+        try {
+
+            RasterMetadata m; 
+            std::string key = std::filesystem::absolute(descriptors[k].filename).string();
+            bool stamped = !indexPath.empty() && getRasterStamp(descriptors[k].filename, m);
+
+            auto it = index.find(key);
+            if (stamped && it != index.end() && it->second.size == m.size && 
+                it->second.mtime == m.mtime && it->second.prjMtime == m.prjMtime) {
+                files[k] = std::make_unique<RasterFile>(descriptors[k], it->second, nThreads);
+                return;
+            }
+
+            files[k] = std::make_unique<RasterFile>(descriptors[k], nThreads);
+            indexed[k] = stamped;
+
+        } catch (...) {
+            errors[k] = std::current_exception();
+        }
+
+    };
+
+    size_t nWorkers = MIN(MAX(nThreads, (size_t)1), nFiles);
+    if (nWorkers > 1) {
+
+        ThreadPool pool(nWorkers); 
+        for (size_t k = 0; k < nFiles; k++) {
+            pool.addTask([&setupRaster, k](const ThreadWorker&) { setupRaster(k); });
+        }
+
+        pool.startPool(); 
+        pool.waitCompletion();
+        pool.stopPool();
+
+    } else {
+        for (size_t k = 0; k < nFiles; k++) {
+            setupRaster(k);
+        }
+    }
+
     std::string filename; 
     size_t cIdx;
+    bool updateIndex = false;
 
-    for (auto d : descriptors) 
+    for (size_t k = 0; k < nFiles; k++) 
     {
-        // Prevent opening an empty string 
-        if (d.filename.empty()) {
-            nFiles--; 
-            continue;
+        const RasterDescriptor& d = descriptors[k];
+
+        if (errors[k]) {
+            std::rethrow_exception(errors[k]);
+        }
+
+        // Store the metadata of the rasters that have just been opened
+        if (indexed[k]) {
+            RasterMetadata m = files[k]->metadata(); 
+            getRasterStamp(d.filename, m);
+            index[std::filesystem::absolute(d.filename).string()] = std::move(m);
+            updateIndex = true;
         }
 
         // Retrieve the index of the element with the same resolution, if present
@@ -541,8 +3986,9 @@ RasterManager::RasterManager(
 
         }
 
-        // Append the descriptor to the set of rasters of the last container.
-        containers.back()->appendRaster(d);
+        // Append the raster to the set of rasters of the last container.
+        containers.back()->appendRaster(std::move(*files[k]));
+        files[k].reset();
 
         // Update the total number of rasters available
         _nRasters++;
@@ -554,6 +4000,15 @@ RasterManager::RasterManager(
 
     }
 
+    // Index the rasters of each container once all of them have been appended
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->buildIndex();
+    }
+
+    if (updateIndex && !writeRasterIndex(indexPath, index)) {
+        std::clog << "Failed to write raster index " << indexPath << std::endl;
+    }
+
     // Retrieve time to compute rendering duration
     auto t2 = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::seconds>(t2 - t1);
@@ -568,10 +4023,20 @@ RasterManager::RasterManager(RasterDescriptor desc, size_t nThreads, bool displa
     RasterManager(std::vector<RasterDescriptor>{desc}, nThreads, displayLogs) {}
 
 double RasterManager::getData(const point2& s, double res, ui32_t tid) {
+    RasterSample smp; 
+    return getData(s, res, smp, tid);
+}
+
+double RasterManager::getData(
+    const point2& s, double res, RasterSample& smp, ui32_t tid
+) {
 
     // Set the initial impact distance to -inf (i.e., no data available)
     double x = -inf;
 
+    smp.container = containers.size(); 
+    smp.res = inf;
+
     // Ensure at least one raster is loaded, otherwise return infinity.
     if (_nRasters == 0) {
         std::clog << "No rasters have been loaded in the container." << std::endl;
@@ -584,13 +4049,17 @@ double RasterManager::getData(const point2& s, double res, ui32_t tid) {
     // Check all the containers from this resolution and downwards 
     for (int k = static_cast<int>(cIdx); k >= 0; k--) {
         /* Retrieve the data from the container. Since the raster has a resolution higher 
-         * than the requested one, we don't need to perform any kind of interpolation. */  
-        x = containers[k]->getData(s, false, tid);
+         * than the requested one, we don't need to perform any kind of interpolation, 
+         * unless its overviews are sampled. */  
+        smp.level = getOverviewLevel(res, k);
+        x = containers[k]->getData(s, false, smp, tid);
 
         /* If the return value is not infinite, it means we successfully retrieved it and 
          * we thus can exit the loop after updating the latest used resolution. */
         if (!std::isinf(x)) {
-            lastRes[tid] = _resolutions[k];
+            smp.container = k; 
+            smp.res = _resolutions[k];
+            lastRes[tid] = smp.res;
             return x;
         }
     }
@@ -600,11 +4069,14 @@ double RasterManager::getData(const point2& s, double res, ui32_t tid) {
     for (size_t k = cIdx + 1; k < containers.size(); k++) {
         /* Retrieve the data from the container. Since the resolution of the raster is 
          * lower, we interpolate neighbouring pixel to retrieve a more accurate value. */
-        x = containers[k]->getData(s, true, tid); 
+        smp.level = 0;
+        x = containers[k]->getData(s, true, smp, tid); 
 
         /* If the return value is not infinite, we successfully retrieved it. */
         if (!std::isinf(x)) {
-            lastRes[tid] = _resolutions[k];
+            smp.container = k; 
+            smp.res = _resolutions[k];
+            lastRes[tid] = smp.res;
             return x;
         }
     }
@@ -614,6 +4086,331 @@ double RasterManager::getData(const point2& s, double res, ui32_t tid) {
 
 }
 
+void RasterManager::getData(
+    size_t n, const point2* s, const double* res, const bool* mask, double* h, 
+    RasterSample* smp, ui32_t tid
+) {
+
+    // Split large batches so that the working arrays can be stored on the stack
+    if (n > MAX_RASTER_BATCH) {
+        for (size_t j = 0; j < n; j += MAX_RASTER_BATCH) {
+            getData(
+                MIN(n - j, MAX_RASTER_BATCH), s + j, res + j, mask + j, h + j, smp + j, tid
+            );
+        }
+        return;
+    }
+
+    size_t cIdx[MAX_RASTER_BATCH], kIdx[MAX_RASTER_BATCH]; 
+    bool pending[MAX_RASTER_BATCH], queued[MAX_RASTER_BATCH], sel[MAX_RASTER_BATCH];
+
+    size_t nLeft = 0; 
+    for (size_t j = 0; j < n; j++) {
+
+        pending[j] = mask[j]; 
+        if (pending[j]) {
+            h[j] = -inf; 
+            smp[j].container = containers.size(); 
+            smp[j].res = inf;
+
+            cIdx[j] = findLast(_resolutions, res[j]); 
+            nLeft++;
+        }
+    }
+
+    if (_nRasters == 0) {
+        if (nLeft > 0) {
+            std::clog << "No rasters have been loaded in the container." << std::endl;
+        }
+        return;
+    }
+
+    /* Each point visits the containers in the same order of the single point query, i.e., 
+     * from its resolution downwards without interpolation and then upwards with 
+     * interpolation. At each round, the points that are visiting the same container are 
+     * queried together. */
+    for (size_t r = 0; r < containers.size() && nLeft > 0; r++) {
+
+        // Retrieve the container visited by each point in this round
+        for (size_t j = 0; j < n; j++) {
+            queued[j] = pending[j]; 
+            if (pending[j]) {
+                kIdx[j] = (r <= cIdx[j]) ? cIdx[j] - r : r;
+            }
+        }
+
+        for (size_t j0 = 0; j0 < n; j0++) {
+
+            if (!queued[j0]) {
+                continue;
+            }
+
+            /* Select all the points visiting the same container of the first queued one 
+             * in the same mode. The interpolation is only required when the container 
+             * resolution is lower than the desired one. */
+            size_t k = kIdx[j0]; 
+            bool interp = r > cIdx[j0];
+
+            for (size_t j = 0; j < n; j++) {
+                sel[j] = queued[j] && kIdx[j] == k && (r > cIdx[j]) == interp; 
+                queued[j] = queued[j] && !sel[j];
+
+                if (sel[j]) {
+                    smp[j].level = interp ? 0 : getOverviewLevel(res[j], k);
+                }
+            }
+
+            containers[k]->getData(n, s, interp, sel, h, smp, tid); 
+
+            // Flag the points that have been successfully retrieved
+            for (size_t j = 0; j < n; j++) {
+                if (sel[j] && !std::isinf(h[j])) {
+                    smp[j].container = k; 
+                    smp[j].res = _resolutions[k];
+
+                    pending[j] = false; 
+                    nLeft--;
+                }
+            }
+        }
+    }
+
+}
+
+double RasterManager::getSafeDistance(
+    const RasterSample& smp, double h, double dMin, ui32_t tid
+) {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return 0.0; 
+    }
+
+    double d = containers[smp.container]->getSafeDistance(smp, h);
+
+    /* Along the ray, the data might be retrieved from the other containers, whose 
+     * terrain is not described by the raster that provided the sample. The distance is 
+     * thus bounded by their rasters within reach. */
+    for (size_t k = 0; k < containers.size() && d > dMin; k++) {
+        if (k != smp.container) {
+            d = containers[k]->boundSafeDistance(smp.s, h, d, tid);
+        }
+    }
+
+    return d;
+
+}
+
+double RasterManager::getConeDistance(
+    const RasterSample& smp, double h, double a, double b
+) const {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return 0.0; 
+    }
+
+    return containers[smp.container]->getConeDistance(smp, h, a, b);
+
+}
+
+double RasterManager::getSlopeDistance(
+    const RasterSample& smp, double h, double a, double b
+) const {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return 0.0; 
+    }
+
+    return containers[smp.container]->getSlopeDistance(smp, h, a, b);
+
+}
+
+double RasterManager::getCellDistance(
+    const RasterSample& smp, const RasterSample& prev, double dt
+) const {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return 0.0; 
+    }
+
+    /* The pixel-space direction of the ray is estimated from the displacement between the 
+     * two samples, which is only meaningful if they lay in the same raster. */
+    point2 dpix(0.0, 0.0); 
+    if (prev.container == smp.container && prev.raster == smp.raster && dt > 0.0) {
+        dpix = (smp.pix - prev.pix)/dt;
+    }
+
+    const RasterFile* raster = containers[smp.container]->getRasterFile(smp.raster);
+    return raster->getCellDistance(smp.pix, dpix);
+
+}
+
+double RasterManager::getCellMaximum(const RasterSample& smp) const {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return -inf; 
+    }
+
+    return containers[smp.container]->getRasterFile(smp.raster)->getCellMaximum(smp.pix);
+
+}
+
+void RasterManager::getRayIntervals(
+    const Ray& ray, double t0, double t1, std::vector<Interval>& intervals
+) const {
+
+    intervals.clear(); 
+
+    // Collect the intervals within the bounding volumes of the rasters along the ray
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->getRayIntervals(ray, t0, t1, intervals);
+    }
+
+    // Clip the intervals to the requested bounds and remove the empty ones
+    size_t n = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        intervals[n].t0 = MAX(intervals[i].t0, t0); 
+        intervals[n].t1 = MIN(intervals[i].t1, t1); 
+        n += intervals[n].t0 <= intervals[n].t1;
+    }
+
+    intervals.resize(n);
+    mergeIntervals(intervals);
+
+}
+
+bool RasterManager::getRadiusBounds(
+    const point3& apex, const vec3& dir, double angle, double& rMin, double& rMax
+) const {
+
+    rMin = inf; 
+    rMax = -inf;
+
+    /* The rays are traced until they go below the surface of all the containers, thus 
+     * each container is searched up to the lowest of them. */
+    double rStop = inf; 
+    for (size_t k = 0; k < containers.size(); k++) {
+        if (containers[k]->nRasters() > 0) {
+            rStop = MIN(rStop, containers[k]->minRadius());
+        }
+    }
+
+    // Retrieve the radii of the rasters whose bounding volume is within the cone
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->getRadiusBounds(apex, dir, angle, rStop, rMin, rMax);
+    }
+
+    return rMin <= rMax;
+
+}
+
+SegmentHit RasterManager::intersectSegment(
+    const RasterSample& smp, const point2& s0, const point2& sm, const point2& s1, 
+    const point3& h, double& x, ui32_t tid
+) const {
+
+    // Check whether the sample was retrieved from any of the containers
+    if (smp.container >= containers.size()) {
+        return SegmentHit::UNKNOWN; 
+    }
+
+    return containers[smp.container]->intersectSegment(smp, s0, sm, s1, h, x, tid);
+
+}
+
+void RasterManager::enableConeMaps(bool flag) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->enableConeMaps(flag);
+    }
+}
+
+void RasterManager::buildConeMaps() {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->buildConeMaps();
+    }
+}
+
+void RasterManager::setCacheDirectory(const std::string& dir) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->setCacheDirectory(dir);
+    }
+}
+
+void RasterManager::enableBlockPreloading(bool flag) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->enableBlockPreloading(flag);
+    }
+}
+
+void RasterManager::enableTileCache(bool flag) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->enableTileCache(flag);
+    }
+}
+
+void RasterManager::setProjectionLattice(double tol) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->setProjectionLattice(tol);
+    }
+}
+
+void RasterManager::setOverviewReduction(OverviewReduction mode) {
+
+    overviewMode = mode;
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->setOverviewReduction(mode);
+    }
+
+}
+
+ui32_t RasterManager::getOverviewLevel(double res, size_t k) const {
+
+    if (overviewMode == OverviewReduction::NONE || !(res >= 2.0*_resolutions[k])) {
+        return 0;
+    }
+
+    // Coarsest level whose pixels are not larger than the requested resolution
+    int level = std::ilogb(res/_resolutions[k]);
+    return (ui32_t)MIN(level, RASTER_MAX_OVERVIEWS);
+
+}
+
+void RasterManager::setCache(RasterCache* c) {
+
+    cache = c;
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->setCache(c);
+    }
+
+}
+
+void RasterManager::prefetch(const GeoRegion& region, double res, ui32_t tid) {
+
+    if (_nRasters == 0) {
+        return;
+    }
+
+    // Visit the containers in the same order of the data queries
+    size_t cIdx = findLast(_resolutions, res); 
+
+    for (int k = static_cast<int>(cIdx); k >= 0; k--) {
+        if (containers[k]->prefetch(region, tid)) {
+            return;
+        }
+    }
+
+    for (size_t k = cIdx + 1; k < containers.size(); k++) {
+        if (containers[k]->prefetch(region, tid)) {
+            return;
+        }
+    }
+
+}
+
 void RasterManager::loadRasters() {
     // Iterate among all containers and load their rasters
     for (size_t k = 0; k < containers.size(); k++) {
@@ -628,6 +4425,12 @@ void RasterManager::unloadRasters() {
     }
 }
 
+void RasterManager::releaseRasters(ui32_t threadid) {
+    for (size_t k = 0; k < containers.size(); k++) {
+        containers[k]->releaseRasters(threadid);
+    }
+}
+
 void RasterManager::cleanupRasters(ui32_t threshold) {
 
     // Iterate among all the different containers
@@ -635,6 +4438,11 @@ void RasterManager::cleanupRasters(ui32_t threshold) {
         containers[k]->cleanupRasters(threshold);
     }
 
+    // Evict the rasters that were released by the last frame, if over budget
+    if (cache) {
+        cache->enforce();
+    }
+
 }
 
 void RasterManager::displayLoadingStatus(
@@ -1,9 +1,10 @@
 
 #include "ray.h"
 #include <cmath> 
+#include <stdexcept>
 
-Ray::Ray(const point3& origin, const vec3& direction) : 
-    p(origin), d(unit_vector(direction)), pd(dot(origin, d)), 
+Ray::Ray(const point3& origin, const vec3& direction, double spread) : 
+    p(origin), d(unit_vector(direction)), _spread(spread), pd(dot(origin, d)), 
     pd2(pd*pd), p2(origin.norm2()) {}
 
 const point3& Ray::origin() const { return p; }
@@ -28,4 +29,100 @@ void Ray::getParameters(double r, double& tMin, double& tMax) const {
     tMin = -pd - s; 
     tMax = -pd + s;  
     
-}
\ No newline at end of file
+}
+
+
+RayPacket::RayPacket() {
+    rays.reserve(RAY_PACKET_SIZE);
+    clear();
+}
+
+void RayPacket::push(const Ray& ray) {
+
+    if (isFull()) {
+        throw std::range_error("The ray packet is full.");
+    }
+
+    // Store the ray components in its lane
+    size_t k = rays.size(); 
+    for (size_t i = 0; i < 3; i++) {
+        o[i][k] = ray.origin()[i]; 
+        d[i][k] = ray.direction()[i];
+    }
+
+    rays.push_back(ray);
+
+}
+
+void RayPacket::clear() {
+
+    rays.clear(); 
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t k = 0; k < RAY_PACKET_SIZE; k++) {
+            o[i][k] = 0.0; 
+            d[i][k] = 0.0;
+        }
+    }
+
+}
+
+
+PacketFrames::PacketFrames(double radius) : radius(radius) {
+
+    // Unused lanes are left at the reference sphere, so that their updates stay finite
+    for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+        cx[j] = cy[j] = cz[j] = ta[j] = 0.0;
+        ux[j] = uy[j] = uz[j] = dx[j] = dy[j] = dz[j] = 0.0f;
+        qx[j] = qy[j] = qz[j] = 0.0f;
+        rc[j] = (float)radius;
+        hc[j] = h[j] = 0.0f;
+    }
+
+}
+
+void PacketFrames::reset(size_t j, const Ray& ray, double t) {
+
+    point3 c = ray.at(t); 
+    double rk = c.norm(); 
+
+    cx[j] = c[0]; 
+    cy[j] = c[1]; 
+    cz[j] = c[2];
+    ta[j] = t;
+
+    ux[j] = (float)(c[0]/rk); 
+    uy[j] = (float)(c[1]/rk); 
+    uz[j] = (float)(c[2]/rk);
+
+    dx[j] = (float)ray.direction()[0]; 
+    dy[j] = (float)ray.direction()[1]; 
+    dz[j] = (float)ray.direction()[2];
+
+    // The origin height is computed in double, since it is much smaller than its radius
+    rc[j] = (float)rk; 
+    hc[j] = (float)(rk - radius);
+
+}
+
+void PacketFrames::update(const double* t) {
+
+    for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+        float tau = (float)(t[j] - ta[j]); 
+        qx[j] = tau*dx[j]; 
+        qy[j] = tau*dy[j]; 
+        qz[j] = tau*dz[j];
+    }
+
+    /* The radius of the position c + q is rc*sqrt(1 + e), with e = n/rc^2 and 
+     * n = 2*rc*(u.q) + q.q, thus its height is hc + n/(|c + q| + rc), which only involves 
+     * small quantities. Within a frame |e| stays below 1e-2, thus the square root is 
+     * expanded to the second order, which keeps the error below a millimetre and the loop 
+     * free of the branches that would prevent its vectorisation. */
+    for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+        float s = ux[j]*qx[j] + uy[j]*qy[j] + uz[j]*qz[j]; 
+        float n = 2.0f*rc[j]*s + (qx[j]*qx[j] + qy[j]*qy[j] + qz[j]*qz[j]); 
+        float e = n/(rc[j]*rc[j]); 
+        h[j] = hc[j] + n/(rc[j]*(2.0f + e*(0.5f - 0.125f*e)));
+    }
+
+}
@@ -6,7 +6,8 @@
 #include <chrono>
 #include <cmath>
 #include <iomanip>
-#include <mutex>
+#include <memory>
+#include <stdexcept>
 
 // Constructor
 Renderer::Renderer(const RenderingOptions& opts, ui32_t nThreads) : 
@@ -20,33 +21,16 @@ Renderer::Renderer(const RenderingOptions& opts, ui32_t nThreads) :
 
 }
 
-// This function stores the output of each render task in the original class
-void Renderer::saveRenderTaskOutput(const std::vector<RenderedPixel>& pixels)
-{
-    {
-        std::unique_lock<std::mutex> lock(renderMutex); 
-        for (auto p : pixels) {
-            if (status >= RenderingStatus::TRACING)
-                renderedPixels.push_back(p);
-            else 
-            {
-                renderedPixels[p.id].updateSamples(p.nSamples);
-                for (size_t k = 0; k < p.nSamples; k++)
-                    renderedPixels[p.id].addPixelData(p.data[k]);
-            }
-        }
-    }
-}
-
 // This function renders a batch of pixels
 void Renderer::renderTask(
     const ThreadWorker& wk, const Camera* cam, World& w, 
-    const std::vector<TaskedPixel>& pixels
+    const TaskedPixel* pixels, size_t n
 ) {
 
-    // Create a vector storing the pixels to be rendered with the given memory
-    std::vector<RenderedPixel> output;
-    output.reserve(pixels.size()); 
+    if (opts.packetTracing) {
+        renderPacketTask(wk, cam, w, pixels, n); 
+        return;
+    }
 
     // Pixel center coordinates
     ui32_t u, v; 
@@ -58,11 +42,8 @@ void Renderer::renderTask(
     bool center;
     double dt;
 
-    for (size_t j = 0; j < pixels.size(); j++)
+    for (size_t j = 0; j < n; j++)
     { 
-        // Initialise the pixel to be rendered.
-        RenderedPixel rPix(pixels[j]);
-
         // Store the pixel resolution 
         dt = pixels[j].dt;
 
@@ -84,33 +65,156 @@ void Renderer::renderTask(
             // tMax = pixels[j].tMax + opts.ssaa.resMultiplier*dt;
         }
 
-        for (size_t k = 0; k < rPix.nSamples; k++) 
+        /* The samples of the pixel were allocated in the buffer when it was queued. Each 
+         * pixel is queued only once per pass, thus no other task writes them and no lock 
+         * is required. */
+        for (size_t k = 0; k < pixels[j].nSamples; k++) 
         {
             // Retrieve camera ray for this pixel
             Ray ray = cam->getRay(pixels[j].u[k], pixels[j].v[k], center); 
             
-            // Compute pixel data
-            rPix.addPixelData(w.traceRay(ray, dt, tMin, tMax, wk.id())); 
+            // Compute pixel data within the bounds of the surface seen by the pixel
+            double t0 = tMin, t1 = tMax;
+            if (boundRayInterval(ray, pixels[j], t0, t1)) {
+                renderBuffer.setSample(pixels[j].id, k, w.traceRay(ray, dt, t0, t1, wk.id())); 
+            } else {
+                renderBuffer.setSample(pixels[j].id, k, PixelData{inf, point3()});
+            }
         }
 
-        // Add the pixel to the list of computed pixels
-        output.push_back(rPix); 
-
         // Update the minimum distance reached in the last pixel
-        tStart = rPix.pixMinDistance(); 
+        tStart = renderBuffer.pixMinDistance(pixels[j].id); 
     }
 
-    // Save the rendered pixels in the Rendeder class 
-    saveRenderTaskOutput(output); 
+}
+
+// This function renders a batch of pixels tracing packets of coherent rays
+void Renderer::renderPacketTask(
+    const ThreadWorker& wk, const Camera* cam, World& w, 
+    const TaskedPixel* pixels, size_t n
+) {
+
+    RayPacket packet; 
+
+    // Pixel and sample indexes, resolution and t-value limits of each lane
+    size_t pid[RAY_PACKET_SIZE], sid[RAY_PACKET_SIZE];
+    double dt[RAY_PACKET_SIZE], tMin[RAY_PACKET_SIZE], tMax[RAY_PACKET_SIZE]; 
+    PixelData data[RAY_PACKET_SIZE];
+
+    /* Each lane marches through a contiguous run of the task pixels, which are adjacent 
+     * in the image, thus the rays of a packet remain coherent. Since a lane traces a 
+     * single ray per packet, the previous pixel of its run is always completed before 
+     * the next one is queued and the starting distance of each ray is adapted from the 
+     * one of its actual predecessor, as in renderTask. */
+    size_t nRuns = MIN(n, (size_t)RAY_PACKET_SIZE); 
+    size_t j0[RAY_PACKET_SIZE], j1[RAY_PACKET_SIZE], jk[RAY_PACKET_SIZE], kk[RAY_PACKET_SIZE];
+
+    for (size_t l = 0; l < nRuns; l++) {
+        j0[l] = l*n/nRuns;
+        j1[l] = (l + 1)*n/nRuns; 
+        jk[l] = j0[l];
+        kk[l] = 0;
+    }
+
+    bool center = (status == RenderingStatus::TRACING);
+
+    do {
+
+        packet.clear();
+
+        // Fill the packet with the next traceable sample of each run
+        for (size_t l = 0; l < nRuns; l++) {
+            while (jk[l] < j1[l]) {
+
+                size_t j = jk[l], k = kk[l];
+                if (++kk[l] == pixels[j].nSamples) {
+                    kk[l] = 0; 
+                    jk[l]++;
+                }
+
+                size_t i = packet.size();
+
+                pid[i] = j;
+                sid[i] = k;
+                dt[i] = pixels[j].dt;
+                tMax[i] = inf;
+
+                if (status == RenderingStatus::TRACING) {
+                    double tStart = (j > j0[l]) ? 
+                        renderBuffer.pixMinDistance(pixels[j - 1].id) : inf;
+
+                    tMin[i] = (opts.adaptiveTracing && tStart != inf) ? 
+                        tStart - 5*dt[i] : 0.0; 
+                } else {
+                    tMin[i] = pixels[j].tMin - opts.ssaa.resMultiplier*dt[i]; 
+                }
+
+                // Rays that can't reach the surface seen by the pixel are not traced
+                Ray ray = cam->getRay(pixels[j].u[k], pixels[j].v[k], center); 
+                if (boundRayInterval(ray, pixels[j], tMin[i], tMax[i])) {
+                    packet.push(ray); 
+                    break;
+                }
+
+                renderBuffer.setSample(pixels[j].id, k, PixelData{inf, point3()});
+            }
+        }
+
+        // Trace the rays in the packet and store their data in the corresponding pixels
+        if (packet.size() > 0) {
+
+            w.traceRayPacket(packet, dt, tMin, tMax, data, wk.id()); 
+
+            for (size_t i = 0; i < packet.size(); i++) {
+                renderBuffer.setSample(pixels[pid[i]].id, sid[i], data[i]);
+            }
+        }
+
+    } while (packet.size() > 0);
 
 }
 
 void Renderer::dispatchTaskQueue(
-    const std::vector<TaskedPixel>& task, const Camera* cam, World& w
+    std::vector<TaskedPixel>&& task, const Camera* cam, World& w
+) {
+
+    RenderBatch* batch = new RenderBatch(std::move(task)); 
+
+    /* The starting distance of each adaptive ray is seeded by the previous pixel of its 
+     * batch, thus the batches of the adaptive tracing pass are rendered by a single task, 
+     * in order. Splitting them would restart the adaptation at every sub-range. */
+    size_t grain = RENDER_TASK_GRAIN;
+    if (status == RenderingStatus::TRACING && opts.adaptiveTracing) {
+        grain = batch->pixels.size();
+    }
+
+    dispatchTaskRange(batch, 0, batch->pixels.size(), grain, cam, w);
+
+}
+
+void Renderer::dispatchTaskRange(
+    RenderBatch* batch, size_t i0, size_t i1, size_t grain, const Camera* cam, World& w
 ) {
     pool.addTask(
-        [this, cam, &w, task] (const ThreadWorker& worker) { 
-            renderTask(worker, cam, w, task); 
+        [this, cam, &w, batch, i0, i1, grain] (const ThreadWorker& worker) { 
+
+            /* Recursively split the batch in halves until the task grain is reached. The 
+             * second halves are queued on the worker deque, where they are either popped 
+             * back by the same worker or stolen by the idle ones. Each task is accounted 
+             * in the batch before being queued, so that the batch outlives all of them. */
+            size_t i = i1; 
+            while (i - i0 > grain) {
+                size_t im = i0 + (i - i0)/2; 
+                batch->nTasks.fetch_add(1, std::memory_order_relaxed);
+                dispatchTaskRange(batch, im, i, grain, cam, w); 
+                i = im;
+            }
+
+            renderTask(worker, cam, w, batch->pixels.data() + i0, i - i0); 
+
+            if (batch->nTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete batch;
+            }
         } 
     );
 }
@@ -128,8 +232,9 @@ void Renderer::updateTaskQueue(const TaskedPixel& tp, const Camera* cam, World&
 void Renderer::releaseTaskQueue(const Camera* cam, World& w) {
     // Add the task to the thread pool and clear the vector 
     if (taskQueue.size() > 0) {
-        dispatchTaskQueue(taskQueue, cam, w); 
+        dispatchTaskQueue(std::move(taskQueue), cam, w); 
         taskQueue.clear(); 
+        taskQueue.reserve(MIN(opts.gridHeight, opts.gridWidth)); 
     }
 }
 
@@ -221,9 +326,6 @@ void Renderer::generateBasicRenderTasks(
     const ScreenGrid& grid, const Camera* cam, World& w
 ) {
 
-    // Retrieve the ray resolution 
-    double dt = grid.getRayResolution();
-
     ui32_t id, u, v;
     for (ui32_t gid = 0; gid < grid.nPixels(); gid++) {
 
@@ -231,7 +333,7 @@ void Renderer::generateBasicRenderTasks(
         grid.getGPixelCoordinates(gid, u, v);
         grid.getGPixelId(gid);
 
-        updateTaskQueue(TaskedPixel(id, u, v, dt), cam, w); 
+        updateTaskQueue(createGridPixel(grid, id, u, v), cam, w); 
 
     }
 
@@ -245,9 +347,8 @@ void Renderer::generateColAdaptiveRenderTasks(
     const ScreenGrid& grid, const Camera* cam, World& w
 ) {
 
-    // Retrieve the ray distances and resolution
+    // Retrieve the ray distances
     const std::vector<double>* pRayDistances = grid.getRayDistances();
-    double dt = grid.getRayResolution();
 
     /* u, v are the coordinates of the pixel in the camera, ug and vg are the coordinates
      * of the pixel with respect to the grid size. */
@@ -277,7 +378,7 @@ void Renderer::generateColAdaptiveRenderTasks(
             for (size_t vg = 0; vg < grid.height(); vg++) {
                 id = grid.getGPixelId(ug, vg);
                 cam->getPixelCoordinates(id, u, v);
-                updateTaskQueue(TaskedPixel(id, u, v, dt));
+                updateTaskQueue(createGridPixel(grid, id, u, v));
             }
 
             releaseTaskQueue(cam, w);
@@ -288,7 +389,7 @@ void Renderer::generateColAdaptiveRenderTasks(
             for (int vg = grid.height() - 1; vg >= 0; vg--) {
                 id = grid.getGPixelId(ug, vg); 
                 cam->getPixelCoordinates(id, u, v);
-                updateTaskQueue(TaskedPixel(id, u, v, dt));
+                updateTaskQueue(createGridPixel(grid, id, u, v));
             }
 
             releaseTaskQueue(cam, w);
@@ -302,7 +403,7 @@ void Renderer::generateColAdaptiveRenderTasks(
             for (int vg = min_index; vg >= 0; vg--) {
                 id = grid.getGPixelId(ug, vg); 
                 cam->getPixelCoordinates(id, u, v);
-                updateTaskQueue(TaskedPixel(id, u, v, dt)); 
+                updateTaskQueue(createGridPixel(grid, id, u, v)); 
             }
 
             releaseTaskQueue(cam, w);
@@ -310,7 +411,7 @@ void Renderer::generateColAdaptiveRenderTasks(
             for (size_t vg = min_index + 1; vg < grid.height(); vg++) {
                 id = grid.getGPixelId(ug, vg);
                 cam->getPixelCoordinates(id, u, v); 
-                updateTaskQueue(TaskedPixel(id, u, v, dt)); 
+                updateTaskQueue(createGridPixel(grid, id, u, v)); 
             }
 
             releaseTaskQueue(cam, w);
@@ -323,9 +424,8 @@ void Renderer::generateRowAdaptiveRenderTasks(
     const ScreenGrid& grid, const Camera* cam, World& w
 ) {
 
-    // Retrieve the ray distances and resolution
+    // Retrieve the ray distances
     const std::vector<double>* pRayDistances = grid.getRayDistances();
-    double dt = grid.getRayResolution(); 
 
     /* u, v are the coordinates of the pixel in the camera, ug and vg are the coordinates
      * of the pixel with respect to the grid size. */
@@ -358,7 +458,7 @@ void Renderer::generateRowAdaptiveRenderTasks(
                 id = grid.getGPixelId(ug, vg);
                 cam->getPixelCoordinates(id, u, v);
 
-                updateTaskQueue(TaskedPixel(id, u, v, dt));
+                updateTaskQueue(createGridPixel(grid, id, u, v));
             
             }
 
@@ -373,7 +473,7 @@ void Renderer::generateRowAdaptiveRenderTasks(
                 id = grid.getGPixelId(ug, vg); 
                 cam->getPixelCoordinates(id, u, v);
 
-                updateTaskQueue(TaskedPixel(id, u, v, dt));
+                updateTaskQueue(createGridPixel(grid, id, u, v));
             }
 
             releaseTaskQueue(cam, w);
@@ -390,7 +490,7 @@ void Renderer::generateRowAdaptiveRenderTasks(
                 id = grid.getGPixelId(ug, vg);
                 cam->getPixelCoordinates(id, u, v); 
 
-                updateTaskQueue(TaskedPixel(id, u, v, dt)); 
+                updateTaskQueue(createGridPixel(grid, id, u, v)); 
             }
 
             releaseTaskQueue(cam, w);
@@ -400,7 +500,7 @@ void Renderer::generateRowAdaptiveRenderTasks(
                 id = grid.getGPixelId(ug, vg);
                 cam->getPixelCoordinates(id, u, v); 
 
-                updateTaskQueue(TaskedPixel(id, u, v, dt)); 
+                updateTaskQueue(createGridPixel(grid, id, u, v)); 
             }
 
             releaseTaskQueue(cam, w);
@@ -408,6 +508,45 @@ void Renderer::generateRowAdaptiveRenderTasks(
     }
 }
 
+TaskedPixel Renderer::createGridPixel(
+    const ScreenGrid& grid, ui32_t id, ui32_t u, ui32_t v
+) const {
+
+    TaskedPixel tp(id, u, v, grid.getRayResolution()); 
+
+    // Bound the rays with the radii of the surface seen by the grid
+    tp.rMin = grid.minRadius(); 
+    tp.rMax = grid.maxRadius(); 
+
+    return tp;
+
+}
+
+bool Renderer::boundRayInterval(
+    const Ray& ray, const TaskedPixel& tp, double& tMin, double& tMax
+) const {
+
+    // The ray does not reach the surface seen by the pixel
+    if (ray.minDistance() > tp.rMax) {
+        return false;
+    }
+
+    /* The search starts where the ray enters the sphere of maximum radius and it ends 
+     * where it either reaches the sphere of minimum radius, below which the impact has 
+     * already occurred, or it leaves the sphere of maximum radius. */
+    double t0, t1; 
+    ray.getParameters(tp.rMax, t0, t1);
+    tMin = MAX(tMin, t0); 
+
+    if (ray.minDistance() < tp.rMin) {
+        ray.getParameters(tp.rMin, t1, t0);
+    }
+
+    tMax = MIN(tMax, t1);
+    return tMax > 0.0 && tMin <= tMax;
+
+}
+
 double Renderer::initializeGrids(const Camera* cam, World& w) {
 
     // Compute the number of grids to be generated
@@ -432,8 +571,9 @@ double Renderer::initializeGrids(const Camera* cam, World& w) {
             // Initialize each screen grid
             ScreenGrid grid(p0, opts.gridWidth, opts.gridHeight, cam);
 
-            // Compute the grid resolution 
+            // Compute the grid resolution and the radii of the surface it sees
             w.computeRayResolution(grid, cam);
+            w.computeRadiusBounds(grid, cam);
             
             // Update the maximum ray resolution if different from infinity
             res = grid.getRayResolution();
@@ -449,14 +589,6 @@ double Renderer::initializeGrids(const Camera* cam, World& w) {
     return maxRes;
 }
 
-void Renderer::sortRenderOutput() {
-    // Sort the rendered pixel vector to have increasing pixel IDs; 
-    std::sort(renderedPixels.begin(), renderedPixels.end(), 
-        [] (const RenderedPixel& p1, const RenderedPixel& p2) { 
-            return p1.id < p2.id;
-    });
-}
-
 void Renderer::runAntiAliasing(const Camera* cam, World& w) {
     
     if (opts.ssaa.active) 
@@ -519,17 +651,22 @@ void Renderer::postProcessRender(const Camera* cam, World& w) {
 
 void Renderer::setupRenderer(const Camera* cam, World& w) {
 
+    /* The SSAA samples are stored in fixed-size arrays of the tasked pixels, thus their 
+     * number is validated before any task is dispatched to the pool. */
+    if (opts.ssaa.active && (opts.ssaa.nSamples == 0 || 
+        opts.ssaa.nSamples > MAX_PIX_SAMPLES)) {
+        throw std::invalid_argument("unsupported number of SSAA pixel samples.");
+    }
+
     // Retrieve number of pixels to be rendered
     nPixels = cam->nPixels(); 
     
     // Start the Thread pool, if not started already.
     pool.startPool(); 
 
-    // Clear the previous output
-    renderedPixels.clear();
-
-    // Pre-allocate all the space needed to store all the image pixels.
-    renderedPixels.reserve(nPixels); 
+    /* Allocate the render buffer with a sample slot for each image pixel, so that the 
+     * render tasks can write their pixels directly by ID. */
+    renderBuffer.reset(nPixels);
 
     // Clear the tasked pixels queue 
     taskQueue.clear(); 
@@ -609,9 +746,8 @@ void Renderer::renderBlack(const Camera* cam) {
     for (ui32_t id = 0; id < nPixels; id++) {
 
         // Update all pixels with the same value (and infinite resolution)
-        RenderedPixel pix(id, 1, inf); 
-        pix.addPixelData(data); 
-        renderedPixels.push_back(pix); 
+        renderBuffer.allocatePixel(id, 1, inf); 
+        renderBuffer.setSample(id, 0, data); 
 
     }
 
@@ -641,9 +777,6 @@ void Renderer::render(const Camera* cam, World& w) {
     // Wait for the completion of all jobs
     pool.waitCompletion();
 
-    // At this point we need to re-order all the rendered pixels.
-    sortRenderOutput(); 
-
     // Post process the first rendering depending on the camera type
     postProcessRender(cam, w);
      
@@ -671,6 +804,27 @@ void Renderer::computePixelBoundaries(const Camera* cam, ui32_t s) {
     double tMin, tMax;
     double dt, dtMin;
 
+    // Retrieve the min\max t-values of each pixel, streaming through the buffer samples
+    std::vector<double> pixT1(nPixels), pixT2(nPixels); 
+    
+    const double* t = renderBuffer.t(); 
+    const double* res = renderBuffer.resolutions();
+
+    for (ui32_t id = 0; id < nPixels; id++) {
+
+        const double* tk = t + renderBuffer.pixOffset(id); 
+        size_t nk = renderBuffer.pixSamples(id); 
+
+        t1 = inf; t2 = -inf;
+        for (size_t k = 0; k < nk; k++) {
+            t1 = tk[k] < t1 ? tk[k] : t1; 
+            t2 = tk[k] > t2 ? tk[k] : t2;
+        }
+
+        pixT1[id] = t1; 
+        pixT2[id] = t2;
+    }
+
     for (size_t id = 0; id < nPixels; id++) {
 
         // Get pixel coordinates 
@@ -699,9 +853,9 @@ void Renderer::computePixelBoundaries(const Camera* cam, ui32_t s) {
                 // Retrieve new pixel id
                 idx = cam->getPixelId(j, k);
 
-                dt = renderedPixels[idx].pixResolution();
-                t1 = renderedPixels[idx].pixMinDistance(); 
-                t2 = renderedPixels[idx].pixMaxDistance();
+                dt = res[idx];
+                t1 = pixT1[idx]; 
+                t2 = pixT2[idx];
                 
                 dtMin = dt < dtMin ? dt : dtMin;
                 tMin = t1 < tMin ? t1 : tMin; 
@@ -726,6 +880,17 @@ ui32_t Renderer::generateAntiAliasingTasks(const Camera* cam, World& w) {
     ui32_t u, v; 
     ui32_t nAliased = 0;
 
+    /* Reserve the buffer samples of the aliased pixels beforehand, so that the sample 
+     * arrays are not reallocated while the tasks write them. */
+    for (size_t id = 0; id < nPixels; id++) {
+        if ((pixMaxT[id] - pixMinT[id]) >= opts.ssaa.threshold*pixRes[id]) {
+            nAliased++;
+        }
+    }
+
+    renderBuffer.reserveSamples((size_t)nAliased*opts.ssaa.nSamples);
+    nAliased = 0;
+
     for (size_t id = 0; id < nPixels; id++) {
 
         // Retrieve pixel coordinates
@@ -760,6 +925,9 @@ ui32_t Renderer::generateAntiAliasingTasks(const Camera* cam, World& w) {
 
 ui32_t Renderer::generateDefocusBlurTasks(const Camera* cam, World& w) {
 
+    // Reserve the buffer samples of all the pixels beforehand
+    renderBuffer.reserveSamples((size_t)nPixels*9);
+
     ui32_t u, v; 
     for (size_t id = 0; id < nPixels; id++) {
         
@@ -783,10 +951,10 @@ ui32_t Renderer::generateDefocusBlurTasks(const Camera* cam, World& w) {
 }
 
 
-void Renderer::importRenderedData(const std::vector<RenderedPixel>& pixels) {
+void Renderer::importRenderedData(RenderBuffer&& buffer) {
 
-    // Copy the content 
-    renderedPixels = pixels;
+    // Move the content 
+    renderBuffer = std::move(buffer);
 
     // Update the rendering status
     status = RenderingStatus::COMPLETED;
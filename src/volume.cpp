@@ -0,0 +1,368 @@
+
+#include "volume.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void mergeIntervals(std::vector<Interval>& intervals) {
+
+    if (intervals.size() < 2) {
+        return;
+    }
+
+    std::sort(intervals.begin(), intervals.end(),
+        [](const Interval& a, const Interval& b) { return a.t0 < b.t0; }
+    );
+
+    // Extend the last disjoint interval until a gap is found
+    size_t k = 0;
+    for (size_t i = 1; i < intervals.size(); i++) {
+        if (intervals[i].t0 <= intervals[k].t1) {
+            intervals[k].t1 = std::max(intervals[k].t1, intervals[i].t1);
+        } else {
+            intervals[++k] = intervals[i];
+        }
+    }
+
+    intervals.resize(k + 1);
+
+}
+
+/* Set the longitude range [lon0, lon0 + width] of a region, all in radians, splitting it
+ * at the antimeridian. */
+static void setRegionLongitudes(GeoRegion& g, double lon0, double width) {
+
+    if (width >= 2.0*PI) {
+        g.n = 1;
+        g.lon[0][0] = -180.0;
+        g.lon[0][1] = 180.0;
+        return;
+    }
+
+    lon0 = rad2deg(lon0);
+    width = rad2deg(width);
+
+    if (lon0 < -180.0) {
+        lon0 += 360.0;
+    } else if (lon0 >= 180.0) {
+        lon0 -= 360.0;
+    }
+
+    g.lon[0][0] = lon0;
+    g.lon[0][1] = std::min(lon0 + width, 180.0);
+    g.n = 1;
+
+    if (lon0 + width > 180.0) {
+        g.lon[1][0] = -180.0;
+        g.lon[1][1] = lon0 + width - 360.0;
+        g.n = 2;
+    }
+
+}
+
+/* Set the latitude range of a region, in radians, and its longitude range, enlarged by
+ * an angular margin. The parallels shrink towards the poles, thus the longitude margin
+ * grows with the largest absolute latitude. */
+static void setRegionBounds(
+    GeoRegion& g, double lat0, double lat1, double lon0, double width, double margin
+) {
+
+    lat0 -= margin;
+    lat1 += margin;
+
+    g.lat[0] = rad2deg(std::max(lat0, -0.5*PI));
+    g.lat[1] = rad2deg(std::min(lat1, 0.5*PI));
+
+    if (lat0 <= -0.5*PI || lat1 >= 0.5*PI) {
+        setRegionLongitudes(g, 0.0, 2.0*PI);
+    } else {
+        double c = cos(std::max(fabs(lat0), fabs(lat1)));
+        double dLon = margin > 0.0 ? asin(std::min(sin(margin)/c, 1.0)) : 0.0;
+        setRegionLongitudes(g, lon0 - dLon, width + 2.0*dLon);
+    }
+
+}
+
+GeoRegion getArcRegion(const point3& p0, const point3& p1, double margin) {
+
+    point3 s0 = car2sph(p0), s1 = car2sph(p1);
+
+    double lat0 = std::min(s0[2], s1[2]);
+    double lat1 = std::max(s0[2], s1[2]);
+
+    /* The arc lies on the great circle orthogonal to n, whose northernmost and
+     * southernmost points bound the arc latitudes if they are crossed. */
+    vec3 n = cross(p0, p1);
+    double nn = n.norm();
+
+    if (nn > 0.0) {
+
+        vec3 q = vec3(0, 0, 1) - (n[2]/nn)*(n/nn);
+        double qn = q.norm();
+
+        if (qn > 0.0) {
+            q = q/qn;
+            if (dot(cross(p0, q), n) >= 0.0 && dot(cross(q, p1), n) >= 0.0) {
+                lat1 = asin(std::min(q[2], 1.0));
+            }
+            if (dot(cross(q, p0), n) >= 0.0 && dot(cross(p1, q), n) >= 0.0) {
+                lat0 = -asin(std::min(q[2], 1.0));
+            }
+        }
+    }
+
+    /* Unless the arc crosses a pole, its longitude is monotonic, increasing if the
+     * circle is travelled counter-clockwise around the body axis. Circles through the
+     * poles are travelled along the meridians, thus the shortest range is taken. */
+    double dLon = fmod(s1[1] - s0[1] + 4.0*PI, 2.0*PI);
+    double lon0 = s0[1];
+
+    bool meridian = fabs(n[2]) <= 1e-9*nn;
+    if ((!meridian && n[2] < 0.0) || (meridian && dLon > PI)) {
+        lon0 = s1[1];
+        dLon = 2.0*PI - dLon;
+    }
+
+    GeoRegion g;
+    setRegionBounds(g, lat0, lat1, lon0, dLon, margin);
+    return g;
+
+}
+
+GeoRegion getCapRegion(const vec3& axis, double angle) {
+
+    point3 s = car2sph(axis);
+
+    GeoRegion g;
+    setRegionBounds(g, s[2], s[2], s[1], 0.0, angle);
+    return g;
+
+}
+
+GeoRegion getConeRegion(
+    const point3& apex, const vec3& dir, double angle, double rMin, double rMax, 
+    double margin
+) {
+
+    double ra = apex.norm();
+    if (ra <= rMax || angle >= 0.5*PI) {
+        return getCapRegion(vec3(0, 0, 1), PI);
+    }
+
+    vec3 up = apex/ra;
+    double gamma = acos(std::max(std::min(dot(up, dir), 1.0), -1.0));
+
+    /* Along each ray, the direction from the body centre moves away from the apex one 
+     * towards the ray direction. The rays reaching the outer sphere make at most an 
+     * angle beta with the nadir, and the farthest point from the apex direction is 
+     * either their entry in the inner sphere or, if they miss it, their exit from the 
+     * outer one. */
+    double beta = std::min(PI - gamma + angle, asin(rMax/ra));
+    double p = ra*sin(beta);
+
+    double theta = p <= rMin ? asin(p/rMin) - beta : acos(rMin/ra) + acos(rMin/rMax);
+
+    /* The same directions lie between the apex one and the cone, thus they are also 
+     * bounded by the smallest cap containing both, if it is narrower. */
+    double hull = 0.5*(gamma + angle);
+    if (angle < gamma && gamma + angle < PI && hull < theta) {
+        vec3 e = unit_vector(dir - dot(dir, up)*up);
+        return getCapRegion(cos(hull)*up + sin(hull)*e, hull + margin);
+    }
+
+    return getCapRegion(up, theta + margin);
+
+}
+
+
+SphericalVolume::SphericalVolume() : 
+    rMin(0.0), rMax(0.0), axis(0, 0, 1), cosCap(-1.0), center(0, 0, 0), radius(0.0) {}
+
+SphericalVolume::SphericalVolume(
+    const double* lonBounds, const double* latBounds, double rMin, double rMax,
+    double margin
+) : rMin(rMin), rMax(rMax), cosCap(-1.0) {
+
+    // The cap is centred on the middle of the region limits
+    double lon = deg2rad(0.5*(lonBounds[0] + lonBounds[1]));
+    double lat = deg2rad(0.5*(latBounds[0] + latBounds[1]));
+
+    axis = sph2car(point3(1.0, lon, lat));
+
+    /* For regions narrower than a hemisphere in longitude, the angular distance from the
+     * centre is largest at one of the region corners. Caps wider than a hemisphere would
+     * not bound a convex cone, thus they are not used. */
+    if (lonBounds[1] - lonBounds[0] < 180.0) {
+
+        double cMin = 1.0;
+        for (size_t i = 0; i < 2; i++) {
+            for (size_t j = 0; j < 2; j++) {
+                point3 p = sph2car(
+                    point3(1.0, deg2rad(lonBounds[i]), deg2rad(latBounds[j]))
+                );
+                cMin = std::min(cMin, dot(axis, p));
+            }
+        }
+
+        double alpha = acos(std::max(std::min(cMin, 1.0), -1.0)) + margin;
+        if (alpha < 0.5*PI) {
+            cosCap = cos(alpha);
+        }
+    }
+
+    /* The points of the volume that are farthest from any point along the axis lie on 
+     * the cap border, either on the inner or the outer sphere. */
+    if (cosCap < 0.0) {
+        center = point3(0, 0, 0); 
+        radius = rMax;
+    } else {
+        double zc = 0.5*(rMin + rMax)*cosCap; 
+        double d2 = std::max(
+            rMin*rMin - 2.0*rMin*zc*cosCap, rMax*rMax - 2.0*rMax*zc*cosCap
+        );
+
+        center = zc*axis;
+        radius = sqrt(d2 + zc*zc);
+    }
+
+}
+
+size_t SphericalVolume::intersect(const Ray& ray, std::vector<Interval>& out) const {
+
+    // The ray does not cross the outer shell
+    double rRay = ray.minDistance();
+    if (rRay > rMax) {
+        return 0;
+    }
+
+    double c0 = -inf, c1 = inf;
+    if (!intersectCap(ray, c0, c1)) {
+        return 0;
+    }
+
+    /* Compute the intervals within the radial shell, which are split in two when the ray
+     * crosses the inner sphere. */
+    Interval shell[2];
+    size_t nShell = 1;
+
+    ray.getParameters(rMax, shell[0].t0, shell[0].t1);
+    if (rRay < rMin) {
+        shell[1].t1 = shell[0].t1;
+        ray.getParameters(rMin, shell[0].t1, shell[1].t0);
+        nShell = 2;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < nShell; i++) {
+        double t0 = std::max(shell[i].t0, c0);
+        double t1 = std::min(shell[i].t1, c1);
+        if (t0 <= t1) {
+            out.push_back(Interval{t0, t1});
+            n++;
+        }
+    }
+
+    return n;
+
+}
+
+bool SphericalVolume::intersectCap(const Ray& ray, double& t0, double& t1) const {
+
+    t0 = -inf;
+    t1 = inf;
+
+    if (cosCap < 0.0) {
+        return true;
+    }
+
+    /* A point p is within the cone if dot(p, axis) >= |p|*cos(alpha). Along the ray, this
+     * is equivalent to f(t) = A*t^2 + B*t + C >= 0 in the half-space dot(p, axis) >= 0,
+     * which excludes the mirrored cone. */
+    const point3& o = ray.origin();
+    const vec3& d = ray.direction();
+
+    double a = dot(o, axis);
+    double b = dot(d, axis);
+    double k = cosCap*cosCap;
+    double od = dot(o, d);
+
+    double A = b*b - k;
+    double B = 2.0*(a*b - k*od);
+    double C = a*a - k*o.norm2();
+
+    // Half-space interval
+    if (b > 0.0) {
+        t0 = -a/b;
+    } else if (b < 0.0) {
+        t1 = -a/b;
+    } else if (a < 0.0) {
+        return false;
+    }
+
+    double r0 = -inf, r1 = inf;
+    if (A == 0.0) {
+        // The ray is parallel to the cone surface
+        if (B > 0.0) {
+            r0 = -C/B;
+        } else if (B < 0.0) {
+            r1 = -C/B;
+        } else if (C < 0.0) {
+            return false;
+        }
+    }
+    else {
+
+        double delta = B*B - 4.0*A*C;
+        if (delta < 0.0) {
+            // The ray never crosses the cone surface
+            if (A < 0.0) {
+                return false;
+            }
+        }
+        else {
+
+            double s = sqrt(delta);
+            double x0 = (-B - s)/(2.0*A);
+            double x1 = (-B + s)/(2.0*A);
+            if (x0 > x1) {
+                std::swap(x0, x1);
+            }
+
+            if (A < 0.0) {
+                // The ray enters and leaves the cone
+                r0 = x0;
+                r1 = x1;
+            } else if (b > 0.0) {
+                // The ray enters the cone and never leaves it
+                r0 = x1;
+            } else {
+                // The ray starts within the cone and leaves it
+                r1 = x0;
+            }
+        }
+    }
+
+    t0 = std::max(t0, r0);
+    t1 = std::min(t1, r1);
+
+    return t0 <= t1;
+
+}
+
+bool SphericalVolume::intersectCone(const point3& apex, const vec3& dir, double angle) const {
+
+    // The apex is within the bounding sphere
+    vec3 v = center - apex; 
+    double d = v.norm(); 
+    if (d <= radius) {
+        return true;
+    }
+
+    /* The sphere is seen from the apex within a cone of half-angle asin(radius/d), which 
+     * must overlap the input one. */
+    double phi = acos(std::max(std::min(dot(v, dir)/d, 1.0), -1.0)); 
+    return phi <= angle + asin(radius/d);
+
+}
@@ -3,10 +3,27 @@
 #include "utils.h"
 
 #include <algorithm>
+#include <cmath>
+#include <iostream>
 
 
 World::World(const WorldOptions& opts, ui32_t nThreads) : 
-    dem(opts, nThreads), dom(opts, nThreads), opts(opts) {}
+    dem(opts, nThreads + opts.prefetchThreads), dom(opts, nThreads + opts.prefetchThreads), 
+    opts(opts), rayIntervals(nThreads*RAY_PACKET_SIZE), nThreads(nThreads) {
+
+    // The DEM and the DOM rasters share a single memory budget
+    if (opts.rasterMemoryBudget > 0) {
+        cache = std::make_unique<RasterCache>(opts.rasterMemoryBudget);
+        dem.setCache(cache.get());
+        dom.setCache(cache.get());
+    }
+
+    if (opts.prefetchThreads > 0) {
+        prefetchPool = std::make_unique<ThreadPool>(opts.prefetchThreads);
+        prefetchPool->startPool();
+    }
+
+}
 
 PixelData World::traceRay(
     const Ray& ray, double dt, double tMin, double tMax, ui32_t threadid, double maxErr
@@ -16,9 +33,281 @@ PixelData World::traceRay(
     PixelData data; 
     data.t = inf;
 
+    // Retrieve the t-intervals in which the ray can hit the surface
+    std::vector<Interval>& intervals = rayIntervals[threadid*RAY_PACKET_SIZE];
+    if (!getMarchingIntervals(ray, tMin, tMax, intervals)) {
+        return data;
+    }
+
+    // Index of the interval being marched
+    size_t i = 0;
+    double tk = intervals[0].t0; 
+
+    // Length of the last step, which brackets the ray impact location
+    double hk, dtk = dt; 
+
+    // Current ray resolution
+    double dtr = dt;
+
+    point3 pos, sph; 
+    point2 s2; 
+
+    // Raster location of the current DEM sample
+    RasterSample smp;
+
+    // Sample of the last DEM cell crossed by the ray 
+    RasterSample prev; 
+
+    // Whether the last DEM cell was intersected on its surface
+    bool exact = false;
+
+    bool hit = false;
+    while (!hit && i < intervals.size()) {
+
+        // Compute ray position
+        pos = ray.at(tk); 
+
+        // Convert to spherical coordinates and retrieve longitude and latitude
+        sph = car2sph(pos);
+
+        // Convert geographic coordinates to degrees
+        s2 = rad2deg(point2(sph[1], sph[2])); 
+
+        // Resolution matching the ray footprint at the current position
+        dtr = getRayResolution(ray, tk, dt);
+
+        // Retrieve altitude from the DEM model.
+        hk = dem.getData(s2, dtr, smp, threadid); 
+
+        /* When marching through the DEM cells, the impacts are searched on the bilinear 
+         * surface of each cell, unless such surface could not be reconstructed. */
+        bool sampled = opts.marchingMode != MarchingMode::DDA || !exact;
+        if (sampled && sph[0] <= (hk + dem.meanRadius())) {
+            
+            // We have an intersection
+            hit = true;
+
+            // Find the ray impact position minimising the localisation error.
+            findImpactLocation(data, ray, smp, dtr, tk - dtk, tk, threadid, maxErr);
+
+        } 
+        else if (sph[0] < dem.minRadius()) {
+            /* This means that the ray has crossed the Moon in an area 
+             * which does not have a loaded DEM available. Thus proceeding 
+             * with any other computation does not make any sense. */
+            break;
+        }
+        else {
+
+            double dtMin = dtr; 
+            if (opts.marchingMode == MarchingMode::DDA) {
+                
+                // Intersect the surface of the DEM cell until the ray leaves it
+                dtMin = getCellStep(ray, pos, sph[0], smp, prev, dtk, dtr); 
+
+                SegmentHit cell = intersectCell(data, ray, smp, tk, tk + dtMin, threadid);
+                if (cell == SegmentHit::HIT) {
+                    hit = true; 
+                    continue;
+                }
+
+                /* Cells whose surface can't be reconstructed are sampled at the ray 
+                 * resolution, as done by the fixed-step marching. */
+                exact = cell == SegmentHit::NONE;
+                if (!exact) {
+                    dtMin = MIN(dtMin, dtr);
+                }
+            }
+
+            dtk = getMarchingStep(ray, pos, sph[0], smp, dtMin, threadid);
+
+            // The next cell is adjacent to the current one only if no terrain is skipped
+            prev = (dtk > dtMin) ? RasterSample() : smp;
+
+            advanceRay(intervals, i, tk, dtk, prev, dtr);
+        }
+    }
+
+    // The DEM samples of the ray are no longer used
+    dem.releaseRasters(threadid);
+
+    return data; 
+
+}
+
+void World::traceRayPacket(
+    const RayPacket& packet, const double* dt, const double* tMin, const double* tMax, 
+    PixelData* data, ui32_t threadid, double maxErr
+) {
+
+    const size_t n = packet.size();
+
+    // Lane-wise marching state
+    double tk[RAY_PACKET_SIZE], dtk[RAY_PACKET_SIZE];
+    bool active[RAY_PACKET_SIZE];
+
+    // Lane-wise t-intervals and index of the interval being marched
+    std::vector<Interval>* intervals = &rayIntervals[threadid*RAY_PACKET_SIZE];
+    size_t iv[RAY_PACKET_SIZE];
+
+    // Lane-wise ray positions and DEM samples
+    double px[RAY_PACKET_SIZE], py[RAY_PACKET_SIZE], pz[RAY_PACKET_SIZE]; 
+    double r[RAY_PACKET_SIZE], lon[RAY_PACKET_SIZE], lat[RAY_PACKET_SIZE]; 
+    double hk[RAY_PACKET_SIZE], res[RAY_PACKET_SIZE]; 
+
+    point2 s2[RAY_PACKET_SIZE]; 
+    RasterSample smp[RAY_PACKET_SIZE], prev[RAY_PACKET_SIZE];
+
+    // Lanes whose last DEM cell was intersected on its surface
+    bool exact[RAY_PACKET_SIZE];
+
+    // Single-precision frames of the lanes, used by the mixed-precision marching
+    PacketFrames frames(dem.meanRadius());
+
+    size_t nActive = 0; 
+    for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+
+        tk[j] = 0.0; 
+        iv[j] = 0;
+        active[j] = false;
+        exact[j] = false;
+
+        if (j < n) {
+            data[j].t = inf; 
+            active[j] = getMarchingIntervals(packet[j], tMin[j], tMax[j], intervals[j]); 
+            if (active[j]) {
+                tk[j] = intervals[j][0].t0;
+                frames.reset(j, packet[j], tk[j]);
+            }
+
+            res[j] = dt[j];
+            dtk[j] = dt[j];
+
+            nActive += active[j];
+        }
+    }
+
+    const double* o[3] = {packet.origin(0), packet.origin(1), packet.origin(2)};
+    const double* d[3] = {packet.direction(0), packet.direction(1), packet.direction(2)};
+
+    while (nActive > 0) {
+
+        /* Compute the positions and the radii of all the lanes. These loops have no 
+         * branches, so that the compiler can vectorise them. Inactive lanes are 
+         * processed as well and their outputs are simply ignored. */
+        if (opts.mixedPrecision) {
+            frames.update(tk);
+        } else {
+            for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+                px[j] = o[0][j] + tk[j]*d[0][j]; 
+                py[j] = o[1][j] + tk[j]*d[1][j]; 
+                pz[j] = o[2][j] + tk[j]*d[2][j]; 
+            }
+
+            for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+                r[j] = std::sqrt(px[j]*px[j] + py[j]*py[j] + pz[j]*pz[j]); 
+            }
+        }
+
+        /* The trigonometric functions are not vectorised by the compiler, thus they 
+         * are only evaluated for the lanes that are still marching, in double 
+         * precision also when the positions are marched in float. */
+        for (size_t j = 0; j < n; j++) {
+            if (active[j]) {
+                if (opts.mixedPrecision) {
+                    point3 pj = frames.position(j); 
+                    px[j] = pj[0]; 
+                    py[j] = pj[1]; 
+                    pz[j] = pj[2]; 
+                    r[j] = dem.meanRadius() + frames.height(j);
+                }
+
+                lon[j] = atan2(py[j], px[j]); 
+                lat[j] = asin(pz[j]/r[j]);
+                s2[j] = rad2deg(point2(lon[j], lat[j])); 
+            }
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            if (active[j]) {
+                res[j] = getRayResolution(packet[j], tk[j], dt[j]);
+            }
+        }
+
+        // Retrieve the altitudes of all the active lanes at once
+        dem.getData(n, s2, res, active, hk, smp, threadid); 
+
+        for (size_t j = 0; j < n; j++) {
+
+            if (!active[j]) {
+                continue;
+            }
+
+            bool sampled = opts.marchingMode != MarchingMode::DDA || !exact[j];
+            if (sampled && r[j] <= (hk[j] + dem.meanRadius())) {
+                // We have an intersection
+                findImpactLocation(
+                    data[j], packet[j], smp[j], res[j], tk[j] - dtk[j], tk[j], threadid, 
+                    maxErr
+                );
+
+                active[j] = false;
+            } 
+            else if (r[j] < dem.minRadius()) {
+                // The ray has crossed the Moon in an area without DEM data
+                active[j] = false;
+            }
+            else {
+
+                point3 pos(px[j], py[j], pz[j]); 
+
+                double dtMin = res[j]; 
+                if (opts.marchingMode == MarchingMode::DDA) {
+                    
+                    dtMin = getCellStep(
+                        packet[j], pos, r[j], smp[j], prev[j], dtk[j], res[j]
+                    ); 
+
+                    SegmentHit cell = intersectCell(
+                        data[j], packet[j], smp[j], tk[j], tk[j] + dtMin, threadid
+                    );
+
+                    if (cell == SegmentHit::HIT) {
+                        active[j] = false; 
+                        nActive--;
+                        continue;
+                    }
+
+                    exact[j] = cell == SegmentHit::NONE;
+                    if (!exact[j]) {
+                        dtMin = MIN(dtMin, res[j]);
+                    }
+                }
+
+                dtk[j] = getMarchingStep(packet[j], pos, r[j], smp[j], dtMin, threadid);
+                prev[j] = (dtk[j] > dtMin) ? RasterSample() : smp[j];
+
+                advanceRay(intervals[j], iv[j], tk[j], dtk[j], prev[j], res[j]);
+                active[j] = iv[j] < intervals[j].size();
+
+                frames.follow(j, packet[j], tk[j]);
+            }
+
+            nActive -= !active[j];
+        }
+    }
+
+    dem.releaseRasters(threadid);
+
+}
+
+bool World::getMarchingInterval(
+    const Ray& ray, double tMin, double tMax, double& tk, double& tEnd
+) const {
+
     // The ray does not intersect the outer sphere
     if (ray.minDistance() > dem.maxRadius()) { 
-        return data;
+        return false;
     }
 
     /* Here we have an intersection. So we start by finding the two values
@@ -26,7 +315,6 @@ PixelData World::traceRay(
      * an interval bound was provided to the tracer, the t-boundaries are 
      * properly adjusted. */
 
-    double tk, tEnd;
     ray.getParameters(dem.maxRadius(), tk, tEnd); 
 
     /* If tk is negative, it means that the ray encounters the Moon in a direction 
@@ -35,7 +323,7 @@ PixelData World::traceRay(
      * can intersect a mountain. */
 
     if ((tk < 0.0) && (ray.origin().norm() > dem.maxRadius())) {
-        return data; 
+        return false; 
     }
 
     if (tMin != 0.0) {
@@ -49,63 +337,219 @@ PixelData World::traceRay(
     // Starting t-value can't be smaller than 0.0 (not going backwards!)
     tk = tk > 0 ? tk : 0.0; 
 
-    double hk; 
+    return true;
 
-    point3 pos, sph; 
-    point2 s2; 
+}
 
-    bool hit = false;
-    while (!hit && tk <= tEnd) {
+bool World::getMarchingIntervals(
+    const Ray& ray, double tMin, double tMax, std::vector<Interval>& intervals
+) const {
 
-        // Compute ray position
-        pos = ray.at(tk); 
+    intervals.clear();
 
-        // Convert to spherical coordinates and retrieve longitude and latitude
-        sph = car2sph(pos);
+    double tk, tEnd; 
+    if (!getMarchingInterval(ray, tMin, tMax, tk, tEnd) || tk > tEnd) {
+        return false;
+    }
 
-        // Convert geographic coordinates to degrees
-        s2 = rad2deg(point2(sph[1], sph[2])); 
+    /* Only the portions of the interval within the bounding volumes of the rasters can 
+     * produce an impact, thus the ray is not marched over regions without DEM data. */
+    if (opts.coverageCulling) {
+        dem.getRayIntervals(ray, tk, tEnd, intervals);
+    } else {
+        intervals.push_back(Interval{tk, tEnd});
+    }
 
-        // Retrieve altitude from the DEM model.
-        hk = dem.getData(s2, dt, threadid); 
+    return !intervals.empty();
 
-        if (sph[0] <= (hk + dem.meanRadius())) {
-            
-            // We have an intersection
-            hit = true;
+}
 
-            // Find the ray impact position minimising the localisation error.
-            findImpactLocation(data, ray, dt, tk, threadid, maxErr);
+void World::advanceRay(
+    const std::vector<Interval>& intervals, size_t& i, double& tk, double& dtk, 
+    RasterSample& prev, double dt
+) const {
+
+    /* The last sample of each interval is placed at its end, so that rays leaving an 
+     * interval below the surface are always detected. */
+    double t1 = intervals[i].t1; 
+    if (tk < t1 && tk + dtk > t1) {
+        dtk = t1 - tk; 
+        tk = t1; 
+        return; 
+    }
 
-        } 
-        else if (sph[0] < dem.minRadius()) {
-            /* This means that the ray has crossed the Moon in an area 
-             * which does not have a loaded DEM available. Thus proceeding 
-             * with any other computation does not make any sense. */
-            break;
+    tk += dtk;
+
+    // Move to the interval containing the new sample, if any
+    while (i < intervals.size() && tk > intervals[i].t1) {
+        i++;
+    }
+
+    // Restart the marching at the beginning of the next interval
+    if (i < intervals.size() && tk < intervals[i].t0) {
+        tk = intervals[i].t0; 
+        dtk = dt; 
+        prev = RasterSample();
+    }
+
+}
+
+double World::getRayResolution(const Ray& ray, double t, double dt) const {
+
+    if (!opts.rayDifferentials) {
+        return dt;
+    }
+
+    /* Similarly to the grid resolution, half the footprint is used to avoid aliasing 
+     * errors. Since the grid resolution is computed from its closest pixels, the 
+     * near-field rays keep it, whereas the far-field ones are marched and sampled at 
+     * coarser resolutions. */
+    double dtf = 0.5*ray.footprint(t); 
+    return MAX(dt, MIN(dtf, (double)opts.maxRes));
+
+}
+
+double World::getMarchingStep(
+    const Ray& ray, const point3& pos, double r, const RasterSample& smp, double dt, 
+    ui32_t threadid
+) {
+
+    double h = r - dem.meanRadius();
+    double dk = 0.0;
+
+    if (opts.marchingMode == MarchingMode::CONE || 
+        opts.marchingMode == MarchingMode::LIPSCHITZ) {
+
+        // Retrieve the horizontal and vertical (descending) ray direction components
+        double bk = -dot(ray.direction(), pos)/r;
+        double ak = sqrt(MAX(1.0 - bk*bk, 0.0))*dem.meanRadius()/r; 
+
+        if (opts.marchingMode == MarchingMode::CONE) {
+            /* Advance the ray within the terrain-free cone below it. The cones bound the 
+             * bilinear surface around the whole cell below the ray, thus the step can't 
+             * cross the terrain. */
+            dk = dem.getConeDistance(smp, h, ak, bk);
+        } else {
+            /* Advance the ray by its clearance above the terrain, shrunk by the maximum 
+             * terrain slope around it. Far from the surface the steps are large, 
+             * whereas they reduce to the minimum one close to it. */
+            dk = dem.getSlopeDistance(smp, h, ak, bk);
         }
+    }
 
-        tk += dt;
+    if (opts.emptySpaceSkipping) {
+        /* Retrieve the distance the ray can travel without reaching the terrain 
+         * described by the raster that provided the current sample. When such 
+         * distance exceeds the step size, the terrain below is skipped at once. */
+        dk = MAX(dk, dem.getSafeDistance(smp, h, MAX(dk, dt), threadid)); 
     }
 
-    return data; 
+    // The step is never smaller than the minimum one
+    return MAX(dk, dt);
+
+}
+
+double World::getCellStep(
+    const Ray& ray, const point3& pos, double r, const RasterSample& smp, 
+    const RasterSample& prev, double dtk, double dt
+) const {
+
+    // If no DEM cell is available, the fixed step is used
+    double dc = dem.getCellDistance(smp, prev, dtk); 
+    if (dc <= 0.0) {
+        return dt;
+    }
+
+    /* Nearly vertical rays remain within the same cell for very long distances, thus the 
+     * step is bounded by the distance required to reach the minimum radius. */
+    double pd = dot(pos, ray.direction()); 
+    double delta = pd*pd - r*r + dem.minRadius()*dem.minRadius(); 
+
+    if (pd < 0.0 && delta >= 0.0) {
+        dc = MIN(dc, -pd - sqrt(delta)); 
+    }
+
+    return dc;
+
+}
+
+SegmentHit World::intersectCell(
+    PixelData& data, const Ray& ray, const RasterSample& smp, double t0, double t1, 
+    ui32_t threadid
+) {
+
+    // Compute the minimum ray radius within the segment
+    double rMin = MIN(ray.at(t0).norm(), ray.at(t1).norm()); 
+
+    double tc = -dot(ray.origin(), ray.direction()); 
+    if (tc > t0 && tc < t1) {
+        rMin = ray.minDistance();
+    }
+
+    /* The ray never gets below the highest point of the cell. Cells without any valid 
+     * pixel can't be bounded. */
+    double hMax = dem.getCellMaximum(smp);
+    if (std::isinf(hMax)) {
+        return SegmentHit::UNKNOWN;
+    } else if (rMin > hMax + dem.meanRadius()) {
+        return SegmentHit::NONE;
+    }
+
+    return intersectSurface(data, ray, smp, t0, t1, threadid);
+
+}
+
+SegmentHit World::intersectSurface(
+    PixelData& data, const Ray& ray, const RasterSample& smp, double t0, double t1, 
+    ui32_t threadid
+) {
+
+    // Retrieve the ray positions at the bracket extremes and middle point
+    point3 sph0 = car2sph(ray.at(t0)); 
+    point3 sphm = car2sph(ray.at(0.5*(t0 + t1))); 
+    point3 sph1 = car2sph(ray.at(t1));
+
+    point3 h(
+        sph0[0] - dem.meanRadius(), sphm[0] - dem.meanRadius(), sph1[0] - dem.meanRadius()
+    );
+
+    // Intersect the ray with the bilinear surface of the raster that provided the sample
+    double x; 
+    SegmentHit hit = dem.intersectSegment(
+        smp, rad2deg(point2(sph0[1], sph0[2])), rad2deg(point2(sphm[1], sphm[2])), 
+        rad2deg(point2(sph1[1], sph1[2])), h, x, threadid
+    );
+
+    if (hit == SegmentHit::HIT) {
+        data.t = t0 + x*(t1 - t0); 
+        data.s = car2sph(ray.at(data.t)); 
+    }
+
+    return hit;
 
 }
 
 void World::findImpactLocation(
-    PixelData& data, const Ray& ray, double dt, double tk, ui32_t threadid, double maxErr
+    PixelData& data, const Ray& ray, const RasterSample& smp, double res, double t0, 
+    double t1, ui32_t threadid, double maxErr
 ) {
 
-    // We had an intersection at tk, thus we move backwards along the ray.
-    double dtn = dt/2; 
-    data.t = tk - dtn; 
+    // Intersect the ray with the bilinear surface of the raster that detected the impact
+    if (intersectSurface(data, ray, smp, t0, t1, threadid) == SegmentHit::HIT) {
+        return;
+    }
+
+    /* If the closed-form intersection is not available, we had an intersection at t1, 
+     * thus we move backwards along the ray halving the bracket. */
+    double dtn = (t1 - t0)/2; 
+    data.t = t1 - dtn; 
 
     // The default error is equal to half the dem resolution
     if (maxErr <= 0.0) {
-        maxErr = dem.getLastResolution(threadid);
+        maxErr = smp.res;
     }
     
-    point3 pos1 = ray.at(tk); 
+    point3 pos1 = ray.at(t1); 
     point3 pos2 = ray.at(data.t); 
     data.s = car2sph(pos2);
     
@@ -132,8 +576,9 @@ void World::findImpactLocation(
         // Convert geographic coordinates to degrees
         s2 = rad2deg(point2(data.s[1], data.s[2])); 
 
-        // Retrieve altitude from DEM 
-        hk = dem.getData(s2, interp, threadid); 
+        /* Retrieve altitude from DEM at the resolution of the hit footprint, so that the 
+         * same raster surface that detected the impact is sampled. */
+        hk = dem.getData(s2, res, threadid); 
 
         if (data.s[0] <= (hk + dem.meanRadius())) {
             // We have intersection, we need to move backwards
@@ -177,6 +622,37 @@ void World::computeRayResolution(ScreenGrid& grid, const Camera* cam) {
 
 }
 
+void World::computeRadiusBounds(ScreenGrid& grid, const Camera* cam) {
+
+    /* Pixel (u, v) spans from u - 0.5 to u + 0.5 in the ray coordinates, thus these are 
+     * the coordinates of the grid corners. */
+    Pixel p0 = grid.topLeft();
+
+    double u[2] = {p0[0] - 0.5, p0[0] + grid.width() - 0.5}; 
+    double v[2] = {p0[1] - 0.5, p0[1] + grid.height() - 0.5};
+
+    // Retrieve the ray through the grid centre
+    Ray ray(cam->getRay(0.5*(u[0] + u[1]), 0.5*(v[0] + v[1]), true));
+
+    /* The grid rays cross the image plane within a rectangle, thus the largest angle from 
+     * the central ray is attained at one of its corners. */
+    double cMin = 1.0; 
+    for (size_t j = 0; j < 2; j++) {
+        for (size_t k = 0; k < 2; k++) {
+            Ray ray_jk(cam->getRay(u[j], v[k], true)); 
+            cMin = MIN(cMin, dot(ray.direction(), ray_jk.direction()));
+        }
+    }
+
+    double angle = acos(MAX(cMin, -1.0)); 
+
+    // Retrieve the radii of the rasters seen within the cone enclosing the grid rays
+    double rMin, rMax; 
+    dem.getRadiusBounds(ray.origin(), ray.direction(), angle, rMin, rMax); 
+    grid.setRadiusBounds(rMin, rMax); 
+
+}
+
 double World::computeGSD(ScreenGrid& grid, const Camera* cam) {
 
     // Compute the intersection points of each ray 
@@ -254,6 +730,136 @@ double World::computeGSD(ScreenGrid& grid, const Camera* cam) {
 
 }
 
+void World::prefetch(const Camera* cam, const point3& pos, const dcm& orientation) {
+
+    if (!prefetchPool || dem.nRasters() == 0) {
+        return;
+    }
+
+    // Rotation from the current camera orientation to the upcoming one
+    dcm R = orientation*cam->getDCM().transpose();
+
+    double du = (cam->width() - 1.0)/(PREFETCH_GRID_SIZE - 1);
+    double dv = (cam->height() - 1.0)/(PREFETCH_GRID_SIZE - 1);
+
+    std::vector<Ray> rays;
+    rays.reserve(PREFETCH_GRID_SIZE*PREFETCH_GRID_SIZE);
+
+    for (size_t j = 0; j < PREFETCH_GRID_SIZE; j++) {
+        for (size_t k = 0; k < PREFETCH_GRID_SIZE; k++) {
+            Ray ray(cam->getRay(j*du, k*dv, true));
+            rays.push_back(
+                Ray(pos + R*(ray.origin() - cam->getPos()), R*ray.direction())
+            );
+        }
+    }
+
+    // Angle spanned by the central pixel, used to estimate the ray resolution
+    double uc = 0.5*cam->width(), vc = 0.5*cam->height();
+    vec3 d0 = cam->getRay(uc, vc, true).direction();
+    vec3 d1 = cam->getRay(uc + 1.0, vc, true).direction();
+    double pixAngle = acos(MIN(dot(d0, d1)/(d0.norm()*d1.norm()), 1.0));
+
+    double minRes = opts.minRes, maxRes = opts.maxRes;
+    prefetchPool->addTask(
+        [this, rays, pixAngle, minRes, maxRes](const ThreadWorker& wk) {
+            // The prefetching threads use the transformations following the rendering ones
+            try {
+                prefetchRays(rays, pixAngle, minRes, maxRes, nThreads + wk.id());
+            } catch (const std::exception& e) {
+                std::clog << "Raster prefetching failed: " << e.what() << std::endl;
+            }
+        }
+    );
+
+}
+
+void World::waitPrefetching() {
+    if (prefetchPool) {
+        prefetchPool->waitCompletion();
+    }
+}
+
+void World::prefetchRays(
+    const std::vector<Ray>& rays, double pixAngle, double minRes, double maxRes, 
+    ui32_t tid
+) {
+
+    double rMin = dem.minRadius(), rMax = dem.maxRadius();
+
+    /* The longitudes east and west of the prime meridian are bounded separately, so 
+     * that footprints crossing the antimeridian are split at it. */
+    double lonBounds[2] = {inf, -inf}; 
+    double eastBounds[2] = {inf, -inf}, westBounds[2] = {inf, -inf};
+    double latBounds[2] = {inf, -inf};
+    double tMin = inf;
+
+    for (const Ray& ray : rays) {
+
+        double r = ray.minDistance();
+        if (r > rMax) {
+            continue;
+        }
+
+        /* The surface seen by a ray lies between its entry in the outer sphere and either 
+         * its entry in the inner one or its exit from the outer one. */
+        double t0, t1, s0, s1; 
+        ray.getParameters(rMax, t0, t1);
+        if (t1 < 0.0) {
+            continue;
+        }
+
+        if (r < rMin) {
+            ray.getParameters(rMin, s0, s1);
+            if (s0 >= 0.0) {
+                t1 = s0;
+            }
+        }
+
+        t0 = MAX(t0, 0.0);
+        tMin = MIN(tMin, t0);
+
+        for (double t : {t0, t1}) {
+            point3 s = car2sph(ray.at(t));
+            double lon = rad2deg(s[1]), lat = rad2deg(s[2]);
+
+            double* b = lon >= 0.0 ? eastBounds : westBounds;
+            b[0] = MIN(b[0], lon); b[1] = MAX(b[1], lon);
+
+            lonBounds[0] = MIN(lonBounds[0], lon); lonBounds[1] = MAX(lonBounds[1], lon);
+            latBounds[0] = MIN(latBounds[0], lat); latBounds[1] = MAX(latBounds[1], lat);
+        }
+    }
+
+    // The surface is not seen from this pose
+    if (std::isinf(tMin)) {
+        return;
+    }
+
+    GeoRegion region; 
+    region.lat[0] = latBounds[0]; 
+    region.lat[1] = latBounds[1];
+
+    /* Footprints crossing the antimeridian are split into the range east of it, up to 
+     * 180 degrees, and the one west of it, from -180 degrees. */
+    if (lonBounds[1] - lonBounds[0] > 180.0) {
+        region.n = 2;
+        region.lon[0][0] = eastBounds[0]; region.lon[0][1] = 180.0;
+        region.lon[1][0] = -180.0; region.lon[1][1] = westBounds[1];
+    } else {
+        region.n = 1; 
+        region.lon[0][0] = lonBounds[0]; region.lon[0][1] = lonBounds[1];
+    }
+
+    // Expected ray resolution, computed as in computeRayResolution
+    double res = 0.5*tMin*pixAngle;
+    res = MIN(MAX(res, minRes), maxRes);
+
+    dem.prefetch(region, res, tid);
+    dom.prefetch(region, res, tid);
+
+}
+
 void World::cleanup() {
     // Unload both DEM and DOM unused files from memory
     cleanupDEM(); 
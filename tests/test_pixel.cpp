@@ -0,0 +1,170 @@
+#include "pixel.h"
+#include "testing.h"
+#include "utils.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Number of image pixels
+#define PIXEL_TEST_PIXELS (1000)
+
+// Number of threads writing the pixel samples concurrently
+#define PIXEL_TEST_THREADS (4)
+
+// Deterministic sample data, which is unique to each pixel sample
+static PixelData sampleData(ui32_t id, size_t k) {
+    double x = 100.0*id + k;
+    return PixelData{x, point3(1737.4 + x, 1e-3*x, -1e-3*x)};
+}
+
+static bool isSampleData(const PixelData& d, ui32_t id, size_t k) {
+    PixelData e = sampleData(id, k);
+    return d.t == e.t && d.s[0] == e.s[0] && d.s[1] == e.s[1] && d.s[2] == e.s[2];
+}
+
+// Number of samples assigned to each pixel, including some with supersampling
+static size_t pixelSamples(ui32_t id) {
+    return id % 7 == 3 ? 1 + id % MAX_PIX_SAMPLES : 1;
+}
+
+// A reset buffer has no samples and single-sample pixels are stored in their own slots
+static void testReset() {
+
+    RenderBuffer buffer(PIXEL_TEST_PIXELS);
+
+    bool empty = buffer.nPixels() == PIXEL_TEST_PIXELS;
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        empty &= buffer.pixSamples(id) == 0 && buffer.pixResolution(id) == inf;
+    }
+    check(empty, "the reset buffer is not empty");
+
+    bool contiguous = true;
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        buffer.allocatePixel(id, 1, 0.5);
+        buffer.setSample(id, 0, sampleData(id, 0));
+    }
+
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        contiguous &= buffer.pixOffset(id) == id && buffer.t()[id] == sampleData(id, 0).t;
+    }
+    check(contiguous, "the single-sample pixels are not sorted by ID");
+
+}
+
+/* Pixels with several samples are appended after the single-sample slots without
+ * overlapping, and reallocating a pixel replaces its samples. */
+static void testAllocation() {
+
+    RenderBuffer buffer(PIXEL_TEST_PIXELS);
+
+    size_t nExtra = 0;
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        size_t n = pixelSamples(id);
+        nExtra += n > 1 ? n : 0;
+    }
+
+    buffer.reserveSamples(nExtra);
+    const double* t = buffer.t();
+
+    std::vector<ui32_t> owners(PIXEL_TEST_PIXELS + nExtra, PIXEL_TEST_PIXELS);
+    bool disjoint = true;
+
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        size_t n = pixelSamples(id);
+        buffer.allocatePixel(id, n, 0.25*id);
+
+        size_t j0 = buffer.pixOffset(id);
+        disjoint &= n == 1 ? j0 == id : j0 >= PIXEL_TEST_PIXELS;
+        for (size_t j = j0; j < j0 + n; j++) {
+            disjoint &= j < owners.size() && owners[j] == PIXEL_TEST_PIXELS;
+            if (j < owners.size()) {
+                owners[j] = id;
+            }
+        }
+    }
+
+    check(disjoint, "the allocated pixel samples overlap");
+    check(t == buffer.t(), "the reserved sample arrays were reallocated");
+
+    bool initialised = true;
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+        initialised &= buffer.pixSamples(id) == pixelSamples(id);
+        initialised &= buffer.pixResolution(id) == 0.25*id;
+        initialised &= buffer.pixMinDistance(id) == inf;
+    }
+    check(initialised, "the allocated pixels were not initialised");
+
+    // Pixels are written concurrently, each by a single thread
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < PIXEL_TEST_THREADS; k++) {
+        threads.emplace_back([&buffer, k] {
+            for (ui32_t id = k; id < PIXEL_TEST_PIXELS; id += PIXEL_TEST_THREADS) {
+                for (size_t j = 0; j < pixelSamples(id); j++) {
+                    buffer.setSample(id, j, sampleData(id, j));
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    bool stored = true;
+    for (ui32_t id = 0; id < PIXEL_TEST_PIXELS; id++) {
+
+        size_t n = pixelSamples(id);
+        RenderedPixel pixel = buffer.pixel(id);
+
+        stored &= pixel.id == id && pixel.nSamples == n;
+        for (size_t j = 0; j < n; j++) {
+            stored &= isSampleData(pixel.data(j), id, j);
+        }
+
+        stored &= pixel.pixDistance() == sampleData(id, 0).t;
+        stored &= pixel.pixMinDistance() == sampleData(id, 0).t;
+        stored &= pixel.pixMaxDistance() == sampleData(id, n - 1).t;
+        stored &= pixel.pixResolution() == 0.25*id;
+    }
+    check(stored, "the pixel samples do not match the written data");
+
+    // A supersampled pixel that is rendered again with a single sample uses its own slot
+    ui32_t id = 3;
+    buffer.allocatePixel(id, 1, 1.0);
+    buffer.setSample(id, 0, sampleData(id, 5));
+
+    check(
+        buffer.pixOffset(id) == id && buffer.pixSamples(id) == 1 &&
+        isSampleData(buffer.getSample(id, 0), id, 5) && isSampleData(buffer.getSample(4, 0), 4, 0),
+        "the reallocated pixel was not moved to its own slot"
+    );
+
+}
+
+// Pixels cannot store more than the maximum number of samples
+static void testLimits() {
+
+    RenderBuffer buffer(10);
+
+    bool thrown = false;
+    try {
+        buffer.allocatePixel(0, MAX_PIX_SAMPLES + 1, 1.0);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+
+    check(thrown, "too many pixel samples were allocated");
+
+}
+
+int main() {
+
+    testReset();
+    testAllocation();
+    testLimits();
+
+    return nFailures > 0 ? 1 : 0;
+
+}
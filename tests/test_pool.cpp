@@ -0,0 +1,234 @@
+#include "pool.h"
+#include "testing.h"
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Number of tasks exchanged in the concurrent tests
+#define POOL_TEST_TASKS (200000)
+
+// Number of threads stealing from, or popping, the tested containers
+#define POOL_TEST_THREADS (4)
+
+// Task identified by an index, which is only stored and never run
+class IndexTask : public PoolTask {
+    public:
+        explicit IndexTask(size_t id) : id(id) {}
+        void run(const ThreadWorker&) override {}
+        size_t id;
+};
+
+static std::vector<std::unique_ptr<IndexTask>> createTasks(size_t n) {
+    std::vector<std::unique_ptr<IndexTask>> tasks;
+    tasks.reserve(n);
+    for (size_t k = 0; k < n; k++) {
+        tasks.emplace_back(std::make_unique<IndexTask>(k));
+    }
+    return tasks;
+}
+
+// Record a retrieved task, returning false if it had already been retrieved
+static bool retrieve(PoolTask* task, std::vector<std::atomic<ui32_t>>& counts) {
+    return counts[static_cast<IndexTask*>(task)->id].fetch_add(1) == 0;
+}
+
+/* The owner pops the most recent task and the thieves steal the oldest one, also
+ * after the deque has grown beyond its initial capacity. */
+static void testDequeOrder() {
+
+    std::vector<std::unique_ptr<IndexTask>> tasks = createTasks(100);
+    WorkStealingDeque deque(8);
+
+    for (auto& task : tasks) {
+        deque.push(task.get());
+    }
+
+    bool ordered = true;
+    for (size_t k = 0; k < 50; k++) {
+        PoolTask* task = deque.steal();
+        ordered &= task && static_cast<IndexTask*>(task)->id == k;
+    }
+
+    for (size_t k = 100; k-- > 50;) {
+        PoolTask* task = deque.pop();
+        ordered &= task && static_cast<IndexTask*>(task)->id == k;
+    }
+
+    check(ordered, "the deque does not pop in LIFO and steal in FIFO order");
+    check(!deque.pop() && !deque.steal(), "the emptied deque still returns tasks");
+
+}
+
+/* The owner pushes and pops tasks while several thieves steal them, so that every task
+ * must be retrieved exactly once. */
+static void testDequeConcurrency() {
+
+    std::vector<std::unique_ptr<IndexTask>> tasks = createTasks(POOL_TEST_TASKS);
+    std::vector<std::atomic<ui32_t>> counts(POOL_TEST_TASKS);
+
+    WorkStealingDeque deque(16);
+    std::atomic<bool> done{false};
+    std::atomic<size_t> nDuplicates{0};
+
+    std::vector<std::thread> thieves;
+    for (size_t k = 0; k < POOL_TEST_THREADS; k++) {
+        thieves.emplace_back([&] {
+            while (!done.load()) {
+                if (PoolTask* task = deque.steal()) {
+                    nDuplicates += !retrieve(task, counts);
+                }
+            }
+        });
+    }
+
+    for (size_t k = 0; k < POOL_TEST_TASKS; k++) {
+        deque.push(tasks[k].get());
+        // Pop one task every third push, so that the deque both grows and shrinks
+        if (k % 3 == 2) {
+            if (PoolTask* task = deque.pop()) {
+                nDuplicates += !retrieve(task, counts);
+            }
+        }
+    }
+
+    while (PoolTask* task = deque.pop()) {
+        nDuplicates += !retrieve(task, counts);
+    }
+
+    done = true;
+    for (std::thread& thief : thieves) {
+        thief.join();
+    }
+
+    size_t nMissing = 0;
+    for (auto& count : counts) {
+        nMissing += count.load() == 0;
+    }
+
+    check(nDuplicates == 0, "the deque returned a task more than once");
+    check(nMissing == 0, "the deque lost some tasks");
+
+}
+
+// The queue preserves the FIFO order also once its lock-free slots are full
+static void testQueueOrder() {
+
+    std::vector<std::unique_ptr<IndexTask>> tasks = createTasks(100);
+    TaskQueue queue(4);
+
+    for (size_t k = 0; k < 60; k++) {
+        queue.push(tasks[k].get());
+    }
+
+    bool ordered = true;
+    for (size_t k = 0; k < 30; k++) {
+        PoolTask* task = queue.pop();
+        ordered &= task && static_cast<IndexTask*>(task)->id == k;
+    }
+
+    for (size_t k = 60; k < 100; k++) {
+        queue.push(tasks[k].get());
+    }
+
+    for (size_t k = 30; k < 100; k++) {
+        PoolTask* task = queue.pop();
+        ordered &= task && static_cast<IndexTask*>(task)->id == k;
+    }
+
+    check(ordered, "the queue does not pop in FIFO order");
+    check(!queue.pop(), "the emptied queue still returns tasks");
+
+}
+
+// Several producers and consumers share the queue, retrieving every task exactly once
+static void testQueueConcurrency() {
+
+    std::vector<std::unique_ptr<IndexTask>> tasks = createTasks(POOL_TEST_TASKS);
+    std::vector<std::atomic<ui32_t>> counts(POOL_TEST_TASKS);
+
+    TaskQueue queue(64);
+    std::atomic<size_t> nRetrieved{0};
+    std::atomic<size_t> nDuplicates{0};
+
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < POOL_TEST_THREADS; k++) {
+
+        // Each producer pushes an interleaved subset of the tasks
+        threads.emplace_back([&, k] {
+            for (size_t j = k; j < POOL_TEST_TASKS; j += POOL_TEST_THREADS) {
+                queue.push(tasks[j].get());
+            }
+        });
+
+        threads.emplace_back([&] {
+            while (nRetrieved.load() < POOL_TEST_TASKS) {
+                if (PoolTask* task = queue.pop()) {
+                    nDuplicates += !retrieve(task, counts);
+                    nRetrieved++;
+                }
+            }
+        });
+
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    size_t nMissing = 0;
+    for (auto& count : counts) {
+        nMissing += count.load() == 0;
+    }
+
+    check(nDuplicates == 0, "the queue returned a task more than once");
+    check(nMissing == 0, "the queue lost some tasks");
+
+}
+
+/* Tasks queued both by the main thread and by the workers themselves are all executed
+ * before the completion wait returns. */
+static void testThreadPool() {
+
+    std::atomic<size_t> nExecuted{0};
+    ThreadPool pool(POOL_TEST_THREADS);
+
+    // Queue some tasks before starting the pool
+    for (size_t k = 0; k < 100; k++) {
+        pool.addTask([&](const ThreadWorker&) { nExecuted++; });
+    }
+
+    pool.startPool();
+
+    for (size_t k = 0; k < 1000; k++) {
+        pool.addTask([&](const ThreadWorker&) {
+            nExecuted++;
+            // Spawn nested tasks, which are pushed on the worker deque
+            for (size_t j = 0; j < 10; j++) {
+                pool.addTask([&](const ThreadWorker&) { nExecuted++; });
+            }
+        });
+    }
+
+    pool.waitCompletion();
+
+    check(nExecuted.load() == 100 + 1000*11, "the pool did not execute every task");
+    check(pool.nPendingTasks() == 0, "the pool still has pending tasks");
+
+    pool.stopPool();
+
+}
+
+int main() {
+
+    testDequeOrder();
+    testDequeConcurrency();
+    testQueueOrder();
+    testQueueConcurrency();
+    testThreadPool();
+
+    return nFailures > 0 ? 1 : 0;
+
+}
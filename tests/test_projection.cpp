@@ -0,0 +1,146 @@
+#include "crsutils.h"
+#include "projection.h"
+#include "testing.h"
+#include "utils.h"
+
+#include "ogr_spatialref.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Maximum disagreement, in meters, allowed between the native projections and PROJ
+#define PROJECTION_TOLERANCE (1e-4)
+
+// Points sampled along each axis of the tested regions
+#define PROJECTION_TEST_SAMPLES (41)
+
+/* Compare the native projection of a reference system with the PROJ transformations, 
+ * computed through OGR, within a geographic region. */
+static void testProjection(
+    const std::string& name, const OGRSpatialReference& crs, ProjectionType type, 
+    const double* lonBounds, const double* latBounds
+) {
+
+    MapProjection projection(&crs);
+    if (projection.type() != type) {
+        std::cerr << name << ": unexpected projection type" << std::endl;
+        nFailures++;
+        return;
+    }
+
+    OGRSpatialReference sCRS = MoonGeographicCRS();
+
+    std::unique_ptr<OGRCoordinateTransformation> s2m(
+        OGRCreateCoordinateTransformation(&sCRS, &crs)
+    );
+
+    std::unique_ptr<OGRCoordinateTransformation> m2s(
+        OGRCreateCoordinateTransformation(&crs, &sCRS)
+    );
+
+    double toMeters = crs.GetLinearUnits();
+    double radius = crs.GetSemiMajor();
+
+    double errForward = 0.0, errInverse = 0.0;
+
+    const size_t n = PROJECTION_TEST_SAMPLES;
+    for (size_t j = 0; j < n; j++) {
+        for (size_t k = 0; k < n; k++) {
+
+            point2 s(
+                lonBounds[0] + (lonBounds[1] - lonBounds[0])*j/(n - 1.0), 
+                latBounds[0] + (latBounds[1] - latBounds[0])*k/(n - 1.0)
+            );
+
+            point2 m = s; 
+            if (!s2m->Transform(1, &m.e[0], &m.e[1], nullptr, nullptr)) {
+                continue;
+            }
+
+            // Distance between the projected coordinates
+            point2 mk = projection.forward(s);
+            errForward = MAX(errForward, (mk - m).norm()*toMeters);
+
+            // Distance between the geographic coordinates of the same map point
+            point2 so = m;
+            if (!m2s->Transform(1, &so.e[0], &so.e[1], nullptr, nullptr)) {
+                continue;
+            }
+
+            point2 sk = projection.inverse(m); 
+
+            double dLon = fabs(sk[0] - so[0]); 
+            dLon = MIN(dLon, 360.0 - dLon)*cos(deg2rad(so[1]));
+
+            double dLat = sk[1] - so[1];
+            errInverse = MAX(errInverse, radius*deg2rad(sqrt(dLon*dLon + dLat*dLat)));
+        }
+    }
+
+    if (!(errForward <= PROJECTION_TOLERANCE && errInverse <= PROJECTION_TOLERANCE)) {
+        std::cerr << name << ": forward error " << errForward << " m, inverse error " 
+                  << errInverse << " m" << std::endl;
+        nFailures++;
+    }
+
+}
+
+// Create a projected reference system on the lunar sphere, in meters
+static OGRSpatialReference projectedCRS(const char* name) {
+
+    OGRSpatialReference crs = MoonGeographicCRS(); 
+    crs.SetProjCS(name);
+    crs.SetLinearUnits(SRS_UL_METER, 1.0);
+
+    crs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    return crs;
+
+}
+
+int main() {
+
+    {
+        // Equirectangular, with a standard parallel and false origin
+        OGRSpatialReference crs = projectedCRS("Moon_Equirectangular");
+        crs.SetEquirectangular2(0.0, 30.0, 15.0, 1000.0, -2000.0);
+
+        double lon[2] = {-150.0, 150.0}, lat[2] = {-80.0, 80.0};
+        testProjection("equirectangular", crs, ProjectionType::EQUIRECTANGULAR, lon, lat);
+    }
+
+    {
+        // North polar stereographic, with the scale factor at the pole
+        OGRSpatialReference crs = projectedCRS("Moon_North_Pole_Stereographic");
+        crs.SetPS(90.0, 0.0, 1.0, 0.0, 0.0);
+
+        double lon[2] = {-180.0, 180.0}, lat[2] = {45.0, 90.0};
+        testProjection(
+            "north stereographic", crs, ProjectionType::POLAR_STEREOGRAPHIC, lon, lat
+        );
+    }
+
+    {
+        // South polar stereographic, with a latitude of true scale
+        OGRSpatialReference crs = projectedCRS("Moon_South_Pole_Stereographic");
+        crs.SetPS(-80.0, 45.0, 1.0, 500.0, 500.0);
+
+        double lon[2] = {-180.0, 180.0}, lat[2] = {-90.0, -45.0};
+        testProjection(
+            "south stereographic", crs, ProjectionType::POLAR_STEREOGRAPHIC, lon, lat
+        );
+    }
+
+    {
+        // Orthographic, within the visible hemisphere
+        OGRSpatialReference crs = projectedCRS("Moon_Orthographic");
+        crs.SetOrthographic(20.0, 10.0, 0.0, 0.0);
+
+        double lon[2] = {-50.0, 70.0}, lat[2] = {-40.0, 80.0};
+        testProjection("orthographic", crs, ProjectionType::ORTHOGRAPHIC, lon, lat);
+    }
+
+    return nFailures > 0 ? 1 : 0;
+
+}
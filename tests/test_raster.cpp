@@ -0,0 +1,288 @@
+#include "raster.h"
+#include "testing.h"
+#include "utils.h"
+
+#include "gdal_priv.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#define BAND_WIDTH  (300)
+#define BAND_HEIGHT (200)
+#define BAND_NODATA (-9999.0)
+
+// Number of random segments intersected with the band surface
+#define SEGMENT_TEST_SEGMENTS (1000)
+
+// Samples of each segment used to locate its intersection by dense sampling
+#define SEGMENT_TEST_SAMPLES (20000)
+
+// Tolerance on the height difference between a segment and the surface
+#define SEGMENT_TOLERANCE (1e-3)
+
+// Deterministic pixel values, spanning less than 16 bits, with a no data corner
+static double pixelValue(ui32_t u, ui32_t v) {
+    if (u < 2 && v < 2) {
+        return BAND_NODATA;
+    }
+    return 20000.0 + (double)((u*7919u + v*104729u) % 45000u);
+}
+
+// Create an in-memory 32-bit integer dataset, whose statistics are only approximate
+static std::shared_ptr<GDALDataset> createDataset() {
+
+    GDALDriver* pDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset* pDataset = pDriver->Create("", BAND_WIDTH, BAND_HEIGHT, 1, GDT_Int32, nullptr);
+
+    std::vector<int32_t> data((size_t)BAND_WIDTH*BAND_HEIGHT);
+    for (ui32_t v = 0; v < BAND_HEIGHT; v++) {
+        for (ui32_t u = 0; u < BAND_WIDTH; u++) {
+            data[(size_t)v*BAND_WIDTH + u] = (int32_t)pixelValue(u, v);
+        }
+    }
+
+    GDALRasterBand* pBand = pDataset->GetRasterBand(1);
+    pBand->SetNoDataValue(BAND_NODATA);
+    
+    CPLErr err = pBand->RasterIO(
+        GF_Write, 0, 0, BAND_WIDTH, BAND_HEIGHT, data.data(), BAND_WIDTH, BAND_HEIGHT, 
+        GDT_Int32, 0, 0
+    );
+    check(err == CE_None, "failed to write the test dataset");
+
+    // Statistics narrower than the data, as those of approximate computations
+    pBand->SetStatistics(21000.0, 60000.0, 40000.0, 10000.0);
+
+    return std::shared_ptr<GDALDataset>(pDataset, [](GDALDataset* p) { GDALClose(p); });
+
+}
+
+static RasterBand openBand(std::shared_ptr<GDALDataset> pDataset, OverviewReduction mode) {
+
+    RasterDescriptor desc; 
+    RasterBand band(desc, pDataset, 1);
+
+    band.attach(pDataset->GetRasterBand(1), std::make_shared<std::mutex>());
+    band.setOverviewReduction(mode);
+    band.loadData();
+
+    return band;
+
+}
+
+// The quantized pixels must be decoded to their exact values
+static void testQuantization(std::shared_ptr<GDALDataset> pDataset) {
+
+    RasterBand band = openBand(pDataset, OverviewReduction::NONE);
+
+    check(band.storage() == RasterStorage::QUANT16, "the band is not quantized");
+    check(band.min() == 20000.0, "the band minimum is not exact");
+
+    size_t nErrors = 0;
+    for (ui32_t v = 0; v < BAND_HEIGHT; v++) {
+        for (ui32_t u = 0; u < BAND_WIDTH; u++) {
+            nErrors += band.getData(u, v) != pixelValue(u, v);
+        }
+    }
+
+    check(nErrors == 0, "the quantized pixels are not decoded exactly");
+
+}
+
+// Overview pixels reduce the pixels with data of their 2x2 tile
+static void testOverview(std::shared_ptr<GDALDataset> pDataset, OverviewReduction mode) {
+
+    RasterBand band = openBand(pDataset, mode);
+    check(band.nOverviewLevels() > 0, "the overview levels are missing");
+
+    size_t nErrors = 0;
+    for (ui32_t v = 0; v < BAND_HEIGHT/2; v++) {
+        for (ui32_t u = 0; u < BAND_WIDTH/2; u++) {
+
+            double acc = mode == OverviewReduction::MAX ? -INFINITY : 0.0; 
+            size_t cnt = 0;
+
+            for (ui32_t j = 2*v; j < 2*v + 2; j++) {
+                for (ui32_t i = 2*u; i < 2*u + 2; i++) {
+                    double x = pixelValue(i, j);
+                    if (x == BAND_NODATA) {
+                        continue;
+                    }
+                    acc = mode == OverviewReduction::MAX ? std::fmax(acc, x) : acc + x;
+                    cnt++;
+                }
+            }
+
+            // The overview pixel is centred on its tile
+            double h = band.getOverviewData(point2(2.0*u + 0.5, 2.0*v + 0.5), 1);
+
+            if (cnt == 0) {
+                nErrors += !std::isnan(h);
+            } else {
+                double expected = mode == OverviewReduction::MEAN ? acc/cnt : acc;
+                nErrors += !(std::fabs(h - expected) <= 1e-2);
+            }
+        }
+    }
+
+    check(nErrors == 0, "the overview pixels do not match the reduced band");
+
+}
+
+// Cells ignore the corners without data, thus those without any data are unbounded
+static void testCellMaximum(std::shared_ptr<GDALDataset> pDataset) {
+
+    RasterBand band = openBand(pDataset, OverviewReduction::NONE);
+
+    check(std::isinf(band.getCellMaximum(0, 0)), "the cell without data is bounded");
+
+    double expected = std::fmax(
+        pixelValue(2, 1), std::fmax(pixelValue(1, 2), pixelValue(2, 2))
+    );
+    check(band.getCellMaximum(1, 1) == expected, "the cell maximum includes no data corners");
+
+}
+
+// Bilinear surface of the test band, whose last row and column are extended
+static double surfaceValue(const point2& p) {
+
+    ui32_t i = static_cast<ui32_t>(p[0]), j = static_cast<ui32_t>(p[1]);
+    double u = p[0] - i, v = p[1] - j;
+
+    ui32_t i1 = std::min(i + 1, (ui32_t)BAND_WIDTH - 1);
+    ui32_t j1 = std::min(j + 1, (ui32_t)BAND_HEIGHT - 1);
+
+    return (1 - u)*(1 - v)*pixelValue(i, j) + u*(1 - v)*pixelValue(i1, j) + 
+        (1 - u)*v*pixelValue(i, j1) + u*v*pixelValue(i1, j1);
+
+}
+
+// Height difference between a segment and the surface at a segment fraction
+static double segmentGap(const point2& p0, const point2& p1, const point3& h, double x) {
+
+    // Quadratic interpolation of the start, middle and end heights
+    double hx = h[0]*(1 - x)*(1 - 2*x) + 4*h[1]*x*(1 - x) + h[2]*x*(2*x - 1);
+    return hx - surfaceValue(p0 + x*(p1 - p0));
+
+}
+
+/* Random segments are intersected with the band surface, which is also densely sampled 
+ * along them. The returned intersections must lie on the surface and the segments must 
+ * not go below it before them, whereas the missing segments must remain above it. */
+static void testSegmentSampling(std::shared_ptr<GDALDataset> pDataset) {
+
+    RasterBand band = openBand(pDataset, OverviewReduction::NONE);
+
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    size_t nHits = 0, nMisses = 0, nErrors = 0;
+    for (size_t k = 0; k < SEGMENT_TEST_SEGMENTS; k++) {
+
+        // Segments of up to 12 pixels, away from the no data corner and the band limits
+        point2 p0(
+            15.0 + (BAND_WIDTH - 30)*uniform(gen), 15.0 + (BAND_HEIGHT - 30)*uniform(gen)
+        );
+
+        double a = 2.0*PI*uniform(gen), len = 0.1 + 12.0*uniform(gen);
+        point2 p1 = p0 + point2(len*cos(a), len*sin(a));
+
+        // The segments start above the surface and end either above or below it
+        double h0 = surfaceValue(p0) + 20000.0*uniform(gen);
+        double h2 = surfaceValue(p1) + 20000.0*(2.0*uniform(gen) - 1.0);
+        point3 h(h0, 0.5*(h0 + h2) + 5000.0*(2.0*uniform(gen) - 1.0), h2);
+
+        double x = -1.0;
+        SegmentHit hit = band.intersectSegment(p0, p1, h, x);
+
+        if (hit == SegmentHit::UNKNOWN) {
+            nErrors++;
+            continue;
+        }
+
+        double xMax = 1.0;
+        if (hit == SegmentHit::HIT) {
+            nHits++;
+            xMax = x;
+            nErrors += x < 0.0 || x > 1.0 || 
+                std::fabs(segmentGap(p0, p1, h, x)) > SEGMENT_TOLERANCE;
+        } else {
+            nMisses++;
+        }
+
+        for (size_t j = 0; j <= SEGMENT_TEST_SAMPLES; j++) {
+            double xj = static_cast<double>(j)/SEGMENT_TEST_SAMPLES;
+            if (xj >= xMax) {
+                break;
+            }
+
+            if (segmentGap(p0, p1, h, xj) < -SEGMENT_TOLERANCE) {
+                nErrors++;
+                break;
+            }
+        }
+    }
+
+    check(nHits > 0 && nMisses > 0, "the random segments do not both hit and miss");
+    check(nErrors == 0, "the segment intersections do not match the sampled surface");
+
+}
+
+/* Segments within a single cell, whose heights differ from the surface by a parabola. The 
+ * coordinates and heights are dyadic, thus the intersection is computed exactly. */
+static void testSegmentRoots(std::shared_ptr<GDALDataset> pDataset) {
+
+    RasterBand band = openBand(pDataset, OverviewReduction::NONE);
+
+    point2 p0(40.25, 30.5), p1(40.75, 30.5);
+    double s0 = surfaceValue(p0), sm = surfaceValue(0.5*(p0 + p1)), s1 = surfaceValue(p1);
+
+    // The gap 256*(x - 0.5)^2 touches the surface in the middle of the segment
+    double x = -1.0;
+    SegmentHit hit = band.intersectSegment(p0, p1, point3(s0 + 64.0, sm, s1 + 64.0), x);
+    check(hit == SegmentHit::HIT && x == 0.5, "the tangent segment does not touch the surface");
+
+    // Raising the segment moves it entirely above the surface
+    hit = band.intersectSegment(p0, p1, point3(s0 + 65.0, sm + 1.0, s1 + 65.0), x);
+    check(hit == SegmentHit::NONE, "the segment above the surface intersects it");
+
+    // Lowering the segment yields two roots, at 0.25 and 0.75, of which the first is taken
+    hit = band.intersectSegment(p0, p1, point3(s0 + 48.0, sm - 16.0, s1 + 48.0), x);
+    check(hit == SegmentHit::HIT && x == 0.25, "the first of the two roots is not returned");
+
+    // Segments entering below the surface intersect it at their start
+    hit = band.intersectSegment(p0, p1, point3(s0 - 1.0, sm + 100.0, s1 + 100.0), x);
+    check(hit == SegmentHit::HIT && x == 0.0, "the segment starting below the surface misses it");
+
+    // Segments crossing cells without data or leaving the band are unknown
+    point3 high(1e6, 1e6, 1e6);
+
+    hit = band.intersectSegment(point2(5.5, 5.5), point2(0.5, 0.5), high, x);
+    check(hit == SegmentHit::UNKNOWN, "the segment crossing the no data corner is known");
+
+    hit = band.intersectSegment(
+        point2(BAND_WIDTH - 5.5, 10.5), point2(BAND_WIDTH + 5.5, 10.5), high, x
+    );
+    check(hit == SegmentHit::UNKNOWN, "the segment leaving the band is known");
+
+}
+
+int main() {
+
+    GDALAllRegister();
+    std::shared_ptr<GDALDataset> pDataset = createDataset();
+
+    testQuantization(pDataset);
+    testOverview(pDataset, OverviewReduction::MEAN);
+    testOverview(pDataset, OverviewReduction::MAX);
+    testCellMaximum(pDataset);
+    testSegmentSampling(pDataset);
+    testSegmentRoots(pDataset);
+
+    return nFailures > 0 ? 1 : 0;
+
+}
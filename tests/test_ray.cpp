@@ -0,0 +1,91 @@
+#include "ray.h"
+#include "testing.h"
+#include "utils.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Reference sphere radius, in meters
+#define RAY_RADIUS (1737400.0)
+
+// Number of tested packets
+#define RAY_TEST_PACKETS (2000)
+
+// Maximum disagreement, in meters, between the single and double-precision positions
+#define RAY_TOLERANCE (2e-3)
+
+// Additional height disagreement, relative to the height, due to its float rounding
+#define RAY_HEIGHT_RTOL (2.4e-7)
+
+/* The packet rays are marched in steps from above the sphere to below it, moving their
+ * frames as in the ray marching. The single-precision heights and positions must match
+ * those computed in double precision, up to the float rounding of the heights. */
+static void testPacketFrames() {
+
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    double maxHeightErr = 0.0, maxPosErr = 0.0;
+
+    for (size_t k = 0; k < RAY_TEST_PACKETS; k++) {
+
+        PacketFrames frames(RAY_RADIUS);
+
+        std::vector<Ray> rays;
+
+        double t[RAY_PACKET_SIZE], dt[RAY_PACKET_SIZE];
+        for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+
+            // Random origins up to 200 km above the sphere, with grazing to nadir rays
+            point3 o = sph2car(point3(
+                RAY_RADIUS + 2e5*uniform(gen), PI*(2.0*uniform(gen) - 1.0),
+                0.5*PI*(2.0*uniform(gen) - 1.0)
+            ));
+
+            vec3 up = o/o.norm();
+            vec3 w(uniform(gen) - 0.5, uniform(gen) - 0.5, uniform(gen) - 0.5);
+            w = w - dot(w, up)*up;
+
+            rays.emplace_back(o, w/w.norm() - (0.05 + uniform(gen))*up);
+
+            t[j] = 0.0;
+            dt[j] = 10.0 + 500.0*uniform(gen);
+            frames.reset(j, rays[j], t[j]);
+        }
+
+        for (size_t i = 0; i < 2000; i++) {
+
+            frames.update(t);
+
+            for (size_t j = 0; j < RAY_PACKET_SIZE; j++) {
+                point3 p = rays[j].at(t[j]);
+                double h = p.norm() - RAY_RADIUS;
+                maxHeightErr = std::max(
+                    maxHeightErr, 
+                    std::fabs(frames.height(j) - h) - RAY_HEIGHT_RTOL*std::fabs(h)
+                );
+                maxPosErr = std::max(maxPosErr, (frames.position(j) - p).norm());
+
+                t[j] += dt[j];
+                frames.follow(j, rays[j], t[j]);
+            }
+        }
+    }
+
+    if (maxHeightErr > RAY_TOLERANCE || maxPosErr > RAY_TOLERANCE) {
+        std::cerr << "packet frames: height error " << maxHeightErr << " m, position error "
+            << maxPosErr << " m" << std::endl;
+        nFailures++;
+    }
+
+}
+
+int main() {
+
+    testPacketFrames();
+
+    return nFailures > 0 ? 1 : 0;
+
+}
@@ -0,0 +1,212 @@
+#include "volume.h"
+#include "testing.h"
+#include "utils.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Reference body radius, in kilometers
+#define VOLUME_RADIUS (1737.4)
+
+// Rays traced against each tested volume
+#define VOLUME_TEST_RAYS (2000)
+
+// Points sampled along each ray
+#define VOLUME_TEST_SAMPLES (2000)
+
+// Tolerance, in kilometers, on the t-values of the intervals
+#define VOLUME_TOLERANCE (1e-6)
+
+static bool sameIntervals(const std::vector<Interval>& a, const std::vector<Interval>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < a.size(); k++) {
+        if (a[k].t0 != b[k].t0 || a[k].t1 != b[k].t1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Unsorted, nested, touching and disjoint intervals are reduced to the sorted union
+static void testMergeIntervals() {
+
+    std::vector<Interval> intervals;
+    mergeIntervals(intervals);
+    check(intervals.empty(), "merging no intervals returned some");
+
+    intervals = {{2.0, 3.0}};
+    mergeIntervals(intervals);
+    check(sameIntervals(intervals, {{2.0, 3.0}}), "a single interval was modified");
+
+    intervals = {{7.0, 9.0}, {1.0, 4.0}, {2.0, 3.0}, {4.0, 5.0}, {10.0, 11.0}, {8.0, 10.0}};
+    mergeIntervals(intervals);
+    check(
+        sameIntervals(intervals, {{1.0, 5.0}, {7.0, 11.0}}),
+        "overlapping intervals were not merged"
+    );
+
+    intervals = {{5.0, 6.0}, {-1.0, 0.0}, {2.0, 3.0}};
+    mergeIntervals(intervals);
+    check(
+        sameIntervals(intervals, {{-1.0, 0.0}, {2.0, 3.0}, {5.0, 6.0}}),
+        "disjoint intervals were not sorted"
+    );
+
+}
+
+// Check whether a point lies within the geographic region and the radial shell
+static bool isInRegion(
+    const point3& p, const double* lonBounds, const double* latBounds, double rMin, double rMax
+) {
+    point3 s = car2sph(p);
+    double lon = rad2deg(s[1]), lat = rad2deg(s[2]);
+
+    return s[0] >= rMin && s[0] <= rMax &&
+        lon >= lonBounds[0] && lon <= lonBounds[1] &&
+        lat >= latBounds[0] && lat <= latBounds[1];
+}
+
+/* Rays are aimed at random points of the region from outside the volume. Every sampled
+ * ray point that is within the region must fall within the returned intervals, which must
+ * be sorted and disjoint. */
+static void testVolume(const char* name, const double* lonBounds, const double* latBounds) {
+
+    double rMin = VOLUME_RADIUS - 10.0;
+    double rMax = VOLUME_RADIUS + 10.0;
+    SphericalVolume volume(lonBounds, latBounds, rMin, rMax);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    size_t nMissed = 0, nUnordered = 0, nHits = 0;
+    std::vector<Interval> intervals;
+
+    for (size_t k = 0; k < VOLUME_TEST_RAYS; k++) {
+
+        // Random target within the region, slightly beyond the shell limits
+        point3 target = sph2car(point3(
+            rMin - 5.0 + (rMax - rMin + 10.0)*uniform(gen),
+            deg2rad(lonBounds[0] + (lonBounds[1] - lonBounds[0])*uniform(gen)),
+            deg2rad(latBounds[0] + (latBounds[1] - latBounds[0])*uniform(gen))
+        ));
+
+        // Random origin, at up to two radii from the body surface
+        vec3 u(uniform(gen) - 0.5, uniform(gen) - 0.5, uniform(gen) - 0.5);
+        point3 origin = (VOLUME_RADIUS*(2.0 + uniform(gen))/u.norm())*u;
+
+        Ray ray(origin, target - origin);
+
+        intervals.clear();
+        size_t n = volume.intersect(ray, intervals);
+
+        nUnordered += n != intervals.size() || n > 2;
+        for (size_t i = 0; i < intervals.size(); i++) {
+            nUnordered += intervals[i].t0 > intervals[i].t1;
+            if (i > 0) {
+                nUnordered += intervals[i].t0 < intervals[i-1].t1;
+            }
+        }
+
+        double tMax = 2.0*(target - origin).norm();
+        for (size_t j = 0; j <= VOLUME_TEST_SAMPLES; j++) {
+
+            double t = tMax*j/VOLUME_TEST_SAMPLES;
+            if (!isInRegion(ray.at(t), lonBounds, latBounds, rMin, rMax)) {
+                continue;
+            }
+
+            nHits++;
+
+            bool inside = false;
+            for (const Interval& it : intervals) {
+                inside |= t >= it.t0 - VOLUME_TOLERANCE && t <= it.t1 + VOLUME_TOLERANCE;
+            }
+            nMissed += !inside;
+        }
+    }
+
+    if (nHits == 0 || nMissed > 0 || nUnordered > 0) {
+        std::cerr << name << ": " << nMissed << " of " << nHits << " region points "
+            << "outside the intervals, " << nUnordered << " invalid intervals" << std::endl;
+        nFailures++;
+    }
+
+}
+
+/* Cones whose rays reach a point of the region must be reported as possibly crossing the
+ * volume, whereas those pointing away from the body must not. */
+static void testVolumeCone(const char* name, const double* lonBounds, const double* latBounds) {
+
+    double rMin = VOLUME_RADIUS - 10.0;
+    double rMax = VOLUME_RADIUS + 10.0;
+    SphericalVolume volume(lonBounds, latBounds, rMin, rMax);
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    size_t nMissed = 0, nFalse = 0;
+    for (size_t k = 0; k < VOLUME_TEST_RAYS; k++) {
+
+        point3 target = sph2car(point3(
+            rMin + (rMax - rMin)*uniform(gen),
+            deg2rad(lonBounds[0] + (lonBounds[1] - lonBounds[0])*uniform(gen)),
+            deg2rad(latBounds[0] + (latBounds[1] - latBounds[0])*uniform(gen))
+        ));
+
+        vec3 u(uniform(gen) - 0.5, uniform(gen) - 0.5, uniform(gen) - 0.5);
+        point3 apex = (3.0*VOLUME_RADIUS/u.norm())*u;
+
+        // The target lies on the boundary of the cone, whose axis is randomly tilted
+        double angle = deg2rad(0.1 + 5.0*uniform(gen));
+        vec3 w = target - apex;
+        w /= w.norm();
+
+        vec3 e(uniform(gen) - 0.5, uniform(gen) - 0.5, uniform(gen) - 0.5);
+        e = e - dot(e, w)*w;
+        e /= e.norm();
+
+        vec3 dir = cos(angle)*w + sin(angle)*e;
+        nMissed += !volume.intersectCone(apex, dir, angle);
+
+        // A narrow cone pointing away from the body centre
+        vec3 out = apex/apex.norm();
+        nFalse += volume.intersectCone(apex, out, deg2rad(1.0));
+
+    }
+
+    if (nMissed > 0 || nFalse > 0) {
+        std::cerr << name << ": " << nMissed << " cones missed the volume, " << nFalse
+            << " cones pointing away crossed it" << std::endl;
+        nFailures++;
+    }
+
+}
+
+int main() {
+
+    // Small region, which is bounded by a narrow cap
+    double lonSmall[2] = {10.0, 12.0}, latSmall[2] = {-31.0, -29.0};
+
+    // Polar region, spanning a wide longitude range
+    double lonPolar[2] = {-80.0, 80.0}, latPolar[2] = {75.0, 90.0};
+
+    // Region wider than a hemisphere, which is only bounded by the radial shell
+    double lonWide[2] = {-150.0, 150.0}, latWide[2] = {-20.0, 40.0};
+
+    testMergeIntervals();
+
+    testVolume("small", lonSmall, latSmall);
+    testVolume("polar", lonPolar, latPolar);
+    testVolume("wide", lonWide, latWide);
+
+    testVolumeCone("small", lonSmall, latSmall);
+    testVolumeCone("polar", lonPolar, latPolar);
+    testVolumeCone("wide", lonWide, latWide);
+
+    return nFailures > 0 ? 1 : 0;
+
+}
@@ -0,0 +1,17 @@
+#ifndef TESTING_H
+#define TESTING_H
+
+#include <iostream>
+
+// Number of failed checks, which sets the exit code of the test executable
+inline int nFailures = 0;
+
+// Report a failed check, without stopping the test
+inline void check(bool cond, const char* msg) {
+    if (!cond) {
+        std::cerr << msg << std::endl;
+        nFailures++;
+    }
+}
+
+#endif